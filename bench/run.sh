@@ -0,0 +1,26 @@
+# Times each benchmark with the superinstructions on and off (JIS_FUSE=0), best of 3 runs.
+# Both run with --tier-threshold 0, or the hot loops would be compiled either way and the two would time the same;
+# the last column is the default run, with the superinstructions and the tiering.
+# Usage: sh bench/run.sh, after sh build.sh; the results are also written to bench_output.txt
+
+best_ms() {
+    best=""
+    for run in 1 2 3; do
+        start=$(date +%s%N)
+        env "$@" > /dev/null
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then best=$ms; fi
+    done
+    echo "$best"
+}
+
+{
+    printf "%-20s %10s %10s %10s\n" "benchmark" "fused ms" "plain ms" "tiered ms"
+    for f in bench/*.jis; do
+        fused=$(best_ms JIS_FUSE=1 ./jis --no-cache --tier-threshold 0 "$f")
+        plain=$(best_ms JIS_FUSE=0 ./jis --no-cache --tier-threshold 0 "$f")
+        tiered=$(best_ms JIS_FUSE=1 ./jis --no-cache "$f")
+        printf "%-20s %10s %10s %10s\n" "$(basename "$f")" "$fused" "$plain" "$tiered"
+    done
+} | tee bench_output.txt
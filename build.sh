@@ -2,4 +2,4 @@
 
 set -xe
 
-gcc -Wall -Wextra -std=c11 -pedantic src/*.c -o jis
+gcc -Wall -Wextra -std=c11 -pedantic $CFLAGS src/*.c -o jis -pthread
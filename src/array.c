@@ -0,0 +1,477 @@
+#include "array.h"
+
+/* Element-wise kernels run on AVX2 or SSE2 when the cpu has them, otherwise on plain loops.
+Every path gives the same bits: element-wise operations are exact per element,
+and reductions always accumulate in 4 lanes (element i goes to lane i % 4), combined in the same order.
+JIS_SIMD=sse2 or JIS_SIMD=none lowers the level, to compare them. */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_SIMD
+#endif
+
+typedef enum Kernel {
+    K_ADD, K_SUB, K_MUL, K_DIV,
+    K_LT, K_GT, K_LE, K_GE, K_EQ, K_NE,
+} Kernel;
+
+typedef enum Reduction {
+    R_SUM, R_MIN, R_MAX,
+} Reduction;
+
+typedef enum SimdLevel {
+    SIMD_NONE,
+    SIMD_SSE2,
+    SIMD_AVX2,
+} SimdLevel;
+
+// Same choice of _mm_min_pd() and _mm_max_pd() when the elements are equal or NaN
+#define MIN(x, acc) ((x) < (acc) ? (x) : (acc))
+#define MAX(x, acc) ((x) > (acc) ? (x) : (acc))
+
+static Value elementwise(Kernel kernel, Value l_val, Value r_val);
+static void binary(Kernel kernel, double *out, const double *l, const double *r, int n, bool l_num, bool r_num);
+static double reduce(Reduction reduction, const double *data, int n);
+static Kernel get_kernel(TokType tok_type);
+static SimdLevel get_simd_level(void);
+
+static void binary_scalar(Kernel kernel, double *out, const double *l, const double *r, int i, int n, bool l_num, bool r_num);
+static int reduce_scalar(Reduction reduction, const double *data, int i, int n, double *lanes);
+
+#ifdef X86_SIMD
+static int binary_avx2(Kernel kernel, double *out, const double *l, const double *r, int n, bool l_num, bool r_num);
+static int binary_sse2(Kernel kernel, double *out, const double *l, const double *r, int n, bool l_num, bool r_num);
+static int int_avx2(Kernel kernel, int64_t *out, const int64_t *l, const int64_t *r, int n, uint64_t *exact);
+static int reduce_avx2(Reduction reduction, const double *data, int i, int n, double *lanes);
+static int reduce_sse2(Reduction reduction, const double *data, int i, int n, double *lanes);
+#endif
+
+Value array_arithmetic(TokType tok_type, Value l_val, Value r_val)
+{
+    return elementwise(get_kernel(tok_type), l_val, r_val);
+}
+
+Value array_comparison(TokType tok_type, Value l_val, Value r_val)
+{
+    return elementwise(get_kernel(tok_type), l_val, r_val);
+}
+
+double array_sum(Array *arr)
+{
+    return reduce(R_SUM, arr->data, arr->len);
+}
+
+double array_min(Array *arr)
+{
+    return reduce(R_MIN, arr->data, arr->len);
+}
+
+double array_max(Array *arr)
+{
+    return reduce(R_MAX, arr->data, arr->len);
+}
+
+void double_lanes(TokType tok_type, double *out, const double *l, const double *r, int n)
+{
+    binary(get_kernel(tok_type), out, l, r, n, false, false);
+}
+
+// The same results as the integer fast path of perform_arithmetic_op() and perform_comparison_op()
+uint64_t int_lanes(TokType tok_type, int64_t *out, const int64_t *l, const int64_t *r, int n)
+{
+    Kernel kernel = get_kernel(tok_type);
+    uint64_t exact = 0;
+    int i = 0;
+#ifdef X86_SIMD
+    if (get_simd_level() == SIMD_AVX2) {
+        i = int_avx2(kernel, out, l, r, n, &exact);
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        int64_t a = l[i], b = r[i];
+        bool ok = true;
+        switch (kernel)
+        {
+        case K_ADD: ok = !__builtin_add_overflow(a, b, &out[i]); break;
+        case K_SUB: ok = !__builtin_sub_overflow(a, b, &out[i]); break;
+        case K_MUL: ok = !__builtin_mul_overflow(a, b, &out[i]); break;
+        case K_DIV:
+            ok = b != 0 && !(a == INT64_MIN && b == -1) && a % b == 0;
+            out[i] = ok ? a / b : 0;
+            break;
+        case K_LT: out[i] = a < b; break;
+        case K_GT: out[i] = a > b; break;
+        case K_LE: out[i] = a <= b; break;
+        case K_GE: out[i] = a >= b; break;
+        case K_EQ: out[i] = a == b; break;
+        case K_NE: out[i] = a != b; break;
+        }
+        if (ok) exact |= (uint64_t)1 << i;
+    }
+
+    return exact;
+}
+
+static Value elementwise(Kernel kernel, Value l_val, Value r_val)
+{
+    // A number operand is read at index 0 for every element
+    bool l_num = l_val.type != VAL_ARRAY;
+    bool r_num = r_val.type != VAL_ARRAY;
+    double l_scalar = l_num ? value_as_double(l_val) : 0;
+    double r_scalar = r_num ? value_as_double(r_val) : 0;
+    const double *l = l_num ? &l_scalar : l_val.arr->data;
+    const double *r = r_num ? &r_scalar : r_val.arr->data;
+    int n = l_num ? r_val.arr->len : l_val.arr->len;
+
+    Array *out;
+    if (!l_num && l_val.arr->refs == 1) out = l_val.arr;
+    else if (!r_num && r_val.arr->refs == 1) out = r_val.arr;
+    else out = new_array(n);
+
+    binary(kernel, out->data, l, r, n, l_num, r_num);
+
+    if (l_num || out != l_val.arr) release_value(l_val);
+    if (r_num || out != r_val.arr) release_value(r_val);
+
+    return ARRAY_VALUE(out);
+}
+
+static void binary(Kernel kernel, double *out, const double *l, const double *r, int n, bool l_num, bool r_num)
+{
+    int i = 0;
+#ifdef X86_SIMD
+    switch (get_simd_level())
+    {
+    case SIMD_AVX2:
+        i = binary_avx2(kernel, out, l, r, n, l_num, r_num);
+        break;
+    case SIMD_SSE2:
+        i = binary_sse2(kernel, out, l, r, n, l_num, r_num);
+        break;
+    case SIMD_NONE:
+        break;
+    }
+#endif
+    binary_scalar(kernel, out, l, r, i, n, l_num, r_num);
+}
+
+static double reduce(Reduction reduction, const double *data, int n)
+{
+    // min and max start from the first elements, so they need no neutral value
+    double lanes[4] = {0, 0, 0, 0};
+    int i = 0;
+    if (reduction != R_SUM) {
+        if (n < 4) {
+            lanes[0] = lanes[1] = lanes[2] = lanes[3] = data[0];
+            i = 1;
+        } else {
+            memcpy(lanes, data, sizeof(lanes));
+            i = 4;
+        }
+    }
+
+#ifdef X86_SIMD
+    switch (get_simd_level())
+    {
+    case SIMD_AVX2:
+        i = reduce_avx2(reduction, data, i, n, lanes);
+        break;
+    case SIMD_SSE2:
+        i = reduce_sse2(reduction, data, i, n, lanes);
+        break;
+    case SIMD_NONE:
+        break;
+    }
+#endif
+    i = reduce_scalar(reduction, data, i, n, lanes);
+
+    double res;
+    switch (reduction)
+    {
+    case R_SUM:
+        res = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        for (; i < n; i++) res += data[i];
+        break;
+    case R_MIN:
+        res = MIN(MIN(lanes[0], lanes[1]), MIN(lanes[2], lanes[3]));
+        for (; i < n; i++) res = MIN(data[i], res);
+        break;
+    case R_MAX:
+        res = MAX(MAX(lanes[0], lanes[1]), MAX(lanes[2], lanes[3]));
+        for (; i < n; i++) res = MAX(data[i], res);
+        break;
+    default:
+        assert("Unreachable" && false);
+        res = 0;
+        break;
+    }
+
+    return res;
+}
+
+static Kernel get_kernel(TokType tok_type)
+{
+    switch (tok_type)
+    {
+    case TOK_PLUS:  return K_ADD;
+    case TOK_MINUS: return K_SUB;
+    case TOK_STAR:  return K_MUL;
+    case TOK_SLASH: return K_DIV;
+    case TOK_LT:    return K_LT;
+    case TOK_GT:    return K_GT;
+    case TOK_LE:    return K_LE;
+    case TOK_GE:    return K_GE;
+    case TOK_EQ:    return K_EQ;
+    case TOK_NE:    return K_NE;
+    default:
+        assert("Unreachable" && false);
+        break;
+    }
+    return K_ADD;
+}
+
+// Detected at the first use
+static SimdLevel get_simd_level(void)
+{
+    static _Atomic int detected = -1; // threads may race to detect it, they all get the same
+
+    int level = detected;
+    if (level == -1)
+    {
+        level = SIMD_NONE;
+#ifdef X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) level = SIMD_AVX2;
+        else if (__builtin_cpu_supports("sse2")) level = SIMD_SSE2;
+#endif
+        char *env = getenv("JIS_SIMD");
+        if (env != NULL && strcmp(env, "none") == 0) level = SIMD_NONE;
+        else if (env != NULL && strcmp(env, "sse2") == 0 && level > SIMD_SSE2) level = SIMD_SSE2;
+        detected = level;
+    }
+
+    return level;
+}
+
+/*
+ *
+ *  Scalar kernels, also used for the elements left by the SIMD ones
+ */
+
+#define SCALAR_LOOP(EXPR) \
+    for (; i < n; i++) { \
+        double a = l[l_num ? 0 : i], b = r[r_num ? 0 : i]; \
+        out[i] = (EXPR); \
+    } \
+    break;
+
+static void binary_scalar(Kernel kernel, double *out, const double *l, const double *r, int i, int n, bool l_num, bool r_num)
+{
+    switch (kernel)
+    {
+    case K_ADD: SCALAR_LOOP(a + b)
+    case K_SUB: SCALAR_LOOP(a - b)
+    case K_MUL: SCALAR_LOOP(a * b)
+    case K_DIV: SCALAR_LOOP(a / b)
+    case K_LT:  SCALAR_LOOP(a < b)
+    case K_GT:  SCALAR_LOOP(a > b)
+    case K_LE:  SCALAR_LOOP(a <= b)
+    case K_GE:  SCALAR_LOOP(a >= b)
+    case K_EQ:  SCALAR_LOOP(a == b)
+    case K_NE:  SCALAR_LOOP(a != b)
+    }
+}
+
+// Whole groups of 4 elements, the rest is left to reduce()
+static int reduce_scalar(Reduction reduction, const double *data, int i, int n, double *lanes)
+{
+    for (; i + 4 <= n; i += 4) {
+        for (int j = 0; j < 4; j++) {
+            switch (reduction)
+            {
+            case R_SUM: lanes[j] += data[i + j]; break;
+            case R_MIN: lanes[j] = MIN(data[i + j], lanes[j]); break;
+            case R_MAX: lanes[j] = MAX(data[i + j], lanes[j]); break;
+            }
+        }
+    }
+    return i;
+}
+
+/*
+ *
+ *  SIMD kernels: they return the index of the first element they didn't process
+ */
+
+#ifdef X86_SIMD
+
+#define AVX2_LOAD(p, num) ((num) ? _mm256_set1_pd((p)[0]) : _mm256_loadu_pd(&(p)[i]))
+
+#define AVX2_LOOP(EXPR) \
+    for (; i + 4 <= n; i += 4) { \
+        __m256d a = AVX2_LOAD(l, l_num), b = AVX2_LOAD(r, r_num); \
+        _mm256_storeu_pd(&out[i], (EXPR)); \
+    } \
+    break;
+
+// A comparison gives a mask of all ones, turned into 1.0
+#define AVX2_CMP(PRED) AVX2_LOOP(_mm256_and_pd(_mm256_cmp_pd(a, b, PRED), one))
+
+__attribute__((target("avx2")))
+static int binary_avx2(Kernel kernel, double *out, const double *l, const double *r, int n, bool l_num, bool r_num)
+{
+    __m256d one = _mm256_set1_pd(1.0);
+    int i = 0;
+
+    switch (kernel)
+    {
+    case K_ADD: AVX2_LOOP(_mm256_add_pd(a, b))
+    case K_SUB: AVX2_LOOP(_mm256_sub_pd(a, b))
+    case K_MUL: AVX2_LOOP(_mm256_mul_pd(a, b))
+    case K_DIV: AVX2_LOOP(_mm256_div_pd(a, b))
+    case K_LT:  AVX2_CMP(_CMP_LT_OQ)
+    case K_GT:  AVX2_CMP(_CMP_GT_OQ)
+    case K_LE:  AVX2_CMP(_CMP_LE_OQ)
+    case K_GE:  AVX2_CMP(_CMP_GE_OQ)
+    case K_EQ:  AVX2_CMP(_CMP_EQ_OQ)
+    case K_NE:  AVX2_CMP(_CMP_NEQ_UQ)
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int reduce_avx2(Reduction reduction, const double *data, int i, int n, double *lanes)
+{
+    __m256d acc = _mm256_loadu_pd(lanes);
+
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_loadu_pd(&data[i]);
+        switch (reduction)
+        {
+        case R_SUM: acc = _mm256_add_pd(acc, x); break;
+        case R_MIN: acc = _mm256_min_pd(x, acc); break;
+        case R_MAX: acc = _mm256_max_pd(x, acc); break;
+        }
+    }
+
+    _mm256_storeu_pd(lanes, acc);
+    return i;
+}
+
+/* 64-bit integers: AVX2 has no multiplication nor division of them, those are left to the scalar loop.
+A sum overflows when its sign differs from the sign of both operands, a difference when the operands
+have different signs and the result hasn't the sign of the first one. */
+__attribute__((target("avx2")))
+static int int_avx2(Kernel kernel, int64_t *out, const int64_t *l, const int64_t *r, int n, uint64_t *exact)
+{
+    if (kernel == K_MUL || kernel == K_DIV) return 0;
+
+    __m256i one = _mm256_set1_epi64x(1);
+    int i = 0;
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)&l[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i *)&r[i]);
+        __m256i res;
+        __m256i overflow = _mm256_setzero_si256();
+
+        switch (kernel)
+        {
+        case K_ADD:
+            res = _mm256_add_epi64(a, b);
+            overflow = _mm256_and_si256(_mm256_xor_si256(a, res), _mm256_xor_si256(b, res));
+            break;
+        case K_SUB:
+            res = _mm256_sub_epi64(a, b);
+            overflow = _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, res));
+            break;
+        case K_LT: res = _mm256_and_si256(_mm256_cmpgt_epi64(b, a), one); break;
+        case K_GT: res = _mm256_and_si256(_mm256_cmpgt_epi64(a, b), one); break;
+        case K_LE: res = _mm256_andnot_si256(_mm256_cmpgt_epi64(a, b), one); break;
+        case K_GE: res = _mm256_andnot_si256(_mm256_cmpgt_epi64(b, a), one); break;
+        case K_EQ: res = _mm256_and_si256(_mm256_cmpeq_epi64(a, b), one); break;
+        case K_NE: res = _mm256_andnot_si256(_mm256_cmpeq_epi64(a, b), one); break;
+        default:
+            assert("Unreachable" && false);
+            return i;
+        }
+
+        _mm256_storeu_si256((__m256i *)&out[i], res);
+        int overflowed = _mm256_movemask_pd(_mm256_castsi256_pd(overflow));
+        *exact |= (uint64_t)(~overflowed & 0xF) << i;
+    }
+
+    return i;
+}
+
+#define SSE2_LOAD(p, num, at) ((num) ? _mm_set1_pd((p)[0]) : _mm_loadu_pd(&(p)[at]))
+
+#define SSE2_LOOP(EXPR) \
+    for (; i + 2 <= n; i += 2) { \
+        __m128d a = SSE2_LOAD(l, l_num, i), b = SSE2_LOAD(r, r_num, i); \
+        _mm_storeu_pd(&out[i], (EXPR)); \
+    } \
+    break;
+
+#define SSE2_CMP(CMP) SSE2_LOOP(_mm_and_pd(CMP(a, b), one))
+
+__attribute__((target("sse2")))
+static int binary_sse2(Kernel kernel, double *out, const double *l, const double *r, int n, bool l_num, bool r_num)
+{
+    __m128d one = _mm_set1_pd(1.0);
+    int i = 0;
+
+    switch (kernel)
+    {
+    case K_ADD: SSE2_LOOP(_mm_add_pd(a, b))
+    case K_SUB: SSE2_LOOP(_mm_sub_pd(a, b))
+    case K_MUL: SSE2_LOOP(_mm_mul_pd(a, b))
+    case K_DIV: SSE2_LOOP(_mm_div_pd(a, b))
+    case K_LT:  SSE2_CMP(_mm_cmplt_pd)
+    case K_GT:  SSE2_CMP(_mm_cmpgt_pd)
+    case K_LE:  SSE2_CMP(_mm_cmple_pd)
+    case K_GE:  SSE2_CMP(_mm_cmpge_pd)
+    case K_EQ:  SSE2_CMP(_mm_cmpeq_pd)
+    case K_NE:  SSE2_CMP(_mm_cmpneq_pd)
+    }
+
+    return i;
+}
+
+// The 4 lanes are kept in two registers
+__attribute__((target("sse2")))
+static int reduce_sse2(Reduction reduction, const double *data, int i, int n, double *lanes)
+{
+    __m128d lo = _mm_loadu_pd(&lanes[0]);
+    __m128d hi = _mm_loadu_pd(&lanes[2]);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128d x_lo = _mm_loadu_pd(&data[i]);
+        __m128d x_hi = _mm_loadu_pd(&data[i + 2]);
+        switch (reduction)
+        {
+        case R_SUM:
+            lo = _mm_add_pd(lo, x_lo);
+            hi = _mm_add_pd(hi, x_hi);
+            break;
+        case R_MIN:
+            lo = _mm_min_pd(x_lo, lo);
+            hi = _mm_min_pd(x_hi, hi);
+            break;
+        case R_MAX:
+            lo = _mm_max_pd(x_lo, lo);
+            hi = _mm_max_pd(x_hi, hi);
+            break;
+        }
+    }
+
+    _mm_storeu_pd(&lanes[0], lo);
+    _mm_storeu_pd(&lanes[2], hi);
+    return i;
+}
+
+#endif // X86_SIMD
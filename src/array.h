@@ -0,0 +1,25 @@
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include "tokenizer.h"
+
+/* Whole-array operations. An operand may be a number, which is used for every element.
+The operands are consumed and the result is a new reference: when an operand array isn't shared,
+its storage is reused for the result. So 'a = a * 2 + 1;' allocates once: 'a * 2' can't reuse 'a', which
+the variable still holds, but '+ 1' reuses the result of 'a * 2'.
+Arrays of different length are reported by the parser, before getting here. */
+
+Value array_arithmetic(TokType tok_type, Value l_val, Value r_val);
+Value array_comparison(TokType tok_type, Value l_val, Value r_val);
+
+double array_sum(Array *arr);
+double array_min(Array *arr); // arr isn't empty
+double array_max(Array *arr); // arr isn't empty
+
+/* The same kernels on plain arrays of numbers, for the lanes of a batch (see batch.h).
+A comparison gives 1 or 0. int_lanes() takes n <= 64 and returns a mask of the results
+that are exact, the others have to be computed again on doubles. */
+void double_lanes(TokType tok_type, double *out, const double *l, const double *r, int n);
+uint64_t int_lanes(TokType tok_type, int64_t *out, const int64_t *l, const int64_t *r, int n);
+
+#endif // ARRAY_H
@@ -0,0 +1,907 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime()
+
+#include "batch.h"
+#include "array.h"
+
+#include <inttypes.h>
+#include <limits.h>
+#include <setjmp.h>
+
+/*
+ *
+ *  Compiled program
+ */
+
+/* The tokens are compiled into a tree of statements, whose expressions are postfix code.
+The code of a '&&' or '||' is surrounded by I_SHORT_BEGIN and I_SHORT_END:
+the lanes whose left-hand side already decides the result don't evaluate the right-hand side,
+as parse_expression() skips it. */
+
+typedef uint64_t Mask; // bit i is lane i
+
+typedef enum InstrKind {
+    I_NUMBER,
+    I_VAR,
+    I_ARITHMETIC,
+    I_COMPARISON,
+    I_LOGICAL,
+    I_SHORT_BEGIN,
+    I_SHORT_END,
+} InstrKind;
+
+typedef struct Instr {
+    InstrKind kind;
+    TokType tok_type; // operator
+    int name;         // variable
+    int line;
+    Value value;      // number
+} Instr;
+
+typedef enum StmtKind {
+    S_ASSIGN,
+    S_PRINT,
+    S_IF,
+    S_WHILE,
+    S_EXEC,
+    S_TASK,
+} StmtKind;
+
+typedef struct Stmt {
+    StmtKind kind;
+    int name;       // assigned variable, executed or declared task
+    int line;       // where its error is reported
+    bool local;     // an assignment in a block, where a variable can't be declared
+    bool tail;      // an 'exec' ending its task, which takes the place of the task
+    int expr_first; // the code of its expression or condition: [expr_first, expr_last)
+    int expr_last;
+    int body;       // block of 'if', 'while' and task declaration
+    int else_body;  // -1 if none
+} Stmt;
+
+typedef struct Block {
+    int first; // statements of the block: items[first, first + count)
+    int count;
+} Block;
+
+DECLARE_ARR(InstrArr, Instr)
+DECLARE_ARR(StmtArr, Stmt)
+DECLARE_ARR(BlockArr, Block)
+DECLARE_ARR(IntArr, int)
+
+struct Batch {
+    Program *program;
+    InstrArr instrs;
+    StmtArr stmts;
+    BlockArr blocks;
+    IntArr items;
+    int top;        // block of the top-level statements
+    int max_stack;  // of an expression
+    int max_shorts; // short-circuits nested in an expression
+};
+
+typedef struct PendingOp {
+    Op op;
+    bool short_circuit;
+    int depth; // of the stack when the operator is pushed
+} PendingOp;
+
+DECLARE_ARR(PendingOpArr, PendingOp)
+
+typedef struct Compiler {
+    Batch *batch;
+    Token *tokens;
+    int size;
+    int cursor;
+    IntArr pending;     // statements of the blocks being compiled
+    PendingOpArr ops;
+    int shorts;         // short-circuits open in the expression
+    jmp_buf on_reject;
+    const char *reason;
+} Compiler;
+
+typedef struct Edge {
+    int from;
+    int to;
+    bool tail;
+} Edge;
+
+DECLARE_ARR(EdgeArr, Edge)
+
+static void reject(const char *reason);
+static bool at(TokType type);
+static void expect(TokType type);
+static int compile_block(int scope, bool top);
+static Stmt compile_statement(int scope, bool top);
+static void compile_expression(TokType end, Stmt *stmt);
+static void emit(Instr instr, int depth);
+static void emit_operator(PendingOp pending, int *depth);
+static void mark_tail(int block);
+static void check_recursion(void);
+static void collect_execs(int block, int from, EdgeArr *edges);
+static bool reaches(EdgeArr *edges, int from, int to, bool *visited);
+
+static _Thread_local Compiler compiler;
+
+Batch *compile_batch(Program *program, const char **reason)
+{
+    if (numeric_model != NUM_TAGGED) {
+        *reason = "--float doesn't run in lockstep";
+        return NULL;
+    }
+    if (program->tokens.size > INT_MAX) {
+        *reason = "the program is too large to run in lockstep";
+        return NULL;
+    }
+    Batch *batch = reallocate(NULL, sizeof(Batch));
+    *batch = (Batch){ .program = program };
+    compiler = (Compiler){ .batch = batch, .tokens = program->tokens.data, .size = program->tokens.size };
+
+    if (setjmp(compiler.on_reject) != 0) {
+        *reason = compiler.reason;
+        ARR_FREE(&compiler.pending);
+        ARR_FREE(&compiler.ops);
+        free_batch(batch);
+        return NULL;
+    }
+
+    batch->top = compile_block(0, true);
+    check_recursion();
+
+    ARR_FREE(&compiler.pending);
+    ARR_FREE(&compiler.ops);
+    return batch;
+}
+
+void free_batch(Batch *batch)
+{
+    ARR_FREE(&batch->instrs);
+    ARR_FREE(&batch->stmts);
+    ARR_FREE(&batch->blocks);
+    ARR_FREE(&batch->items);
+    reallocate(batch, 0);
+}
+
+static void reject(const char *reason)
+{
+    compiler.reason = reason;
+    longjmp(compiler.on_reject, 1);
+}
+
+static bool at(TokType type)
+{
+    return compiler.cursor < compiler.size && compiler.tokens[compiler.cursor].type == type;
+}
+
+static void expect(TokType type)
+{
+    if (!at(type)) reject("the program has errors");
+    compiler.cursor++;
+}
+
+/* The statements up to the '}' that closes the block, or up to the end of the program.
+scope is the one the parser has when executing them, which is 0 in the body of a task. */
+static int compile_block(int scope, bool top)
+{
+    Batch *batch = compiler.batch;
+    int mark = compiler.pending.size;
+
+    while (1)
+    {
+        if (compiler.cursor >= compiler.size) {
+            if (!top) reject("the program has errors");
+            break;
+        }
+        if (!top && at(TOK_CBRACE)) {
+            compiler.cursor++;
+            break;
+        }
+
+        Stmt stmt = compile_statement(scope, top);
+        ARR_PUSH(&batch->stmts, stmt, Stmt);
+        ARR_PUSH(&compiler.pending, batch->stmts.size - 1, int);
+    }
+
+    Block block = { batch->items.size, compiler.pending.size - mark };
+    for (int i = mark; i < compiler.pending.size; i++) {
+        ARR_PUSH(&batch->items, compiler.pending.data[i], int);
+    }
+    compiler.pending.size = mark;
+
+    ARR_PUSH(&batch->blocks, block, Block);
+    return batch->blocks.size - 1;
+}
+
+static Stmt compile_statement(int scope, bool top)
+{
+    Token token = compiler.tokens[compiler.cursor];
+    Stmt stmt = { .line = token.line, .name = token.name, .body = -1, .else_body = -1 };
+    compiler.cursor++;
+
+    switch (token.type)
+    {
+    case TOK_TASK:
+        if (!top) reject("the program has errors");
+        stmt.kind = S_TASK;
+        expect(TOK_OBRACE);
+        stmt.body = compile_block(0, false);
+        mark_tail(stmt.body);
+        break;
+    case TOK_IF:
+        stmt.kind = S_IF;
+        compile_expression(TOK_OBRACE, &stmt);
+        stmt.body = compile_block(scope + 1, false);
+        if (at(TOK_ELSE)) {
+            compiler.cursor++;
+            expect(TOK_OBRACE);
+            stmt.else_body = compile_block(scope + 1, false);
+        }
+        break;
+    case TOK_WHILE:
+        // A step is taken on the first token of the condition
+        stmt.kind = S_WHILE;
+        if (compiler.cursor < compiler.size) stmt.line = compiler.tokens[compiler.cursor].line;
+        compile_expression(TOK_OBRACE, &stmt);
+        stmt.body = compile_block(scope + 1, false);
+        break;
+    case TOK_EXEC_TASK:
+        if (!at(TOK_TASK)) reject("the program has errors");
+        stmt.kind = S_EXEC;
+        stmt.name = compiler.tokens[compiler.cursor].name;
+        stmt.line = compiler.tokens[compiler.cursor].line;
+        compiler.cursor++;
+        expect(TOK_SEMICOLON);
+        break;
+    case TOK_VAR:
+        if (at(TOK_OBRACKET)) reject("the program stores array elements");
+        // The error of a declaration in a block is reported on the token after the name
+        stmt.kind = S_ASSIGN;
+        stmt.local = scope > 0;
+        if (compiler.cursor < compiler.size) stmt.line = compiler.tokens[compiler.cursor].line;
+        expect(TOK_ASSIGN);
+        compile_expression(TOK_SEMICOLON, &stmt);
+        break;
+    case TOK_PRINT:
+        stmt.kind = S_PRINT;
+        compile_expression(TOK_SEMICOLON, &stmt);
+        break;
+    case TOK_SPAWN:
+    case TOK_WAIT:
+        reject("the program uses 'spawn' and 'wait'");
+        break;
+    default:
+        reject("the program has errors");
+        break;
+    }
+
+    return stmt;
+}
+
+// The same precedence parsing as parse_expression(), into postfix code
+static void compile_expression(TokType end, Stmt *stmt)
+{
+    Batch *batch = compiler.batch;
+    PendingOpArr *ops = &compiler.ops;
+    ops->size = 0;
+    int depth = 0;
+    int prec_lvl = 0;
+
+    stmt->expr_first = batch->instrs.size;
+
+    while (1)
+    {
+        if (compiler.cursor >= compiler.size) reject("the program has errors");
+        Token token = compiler.tokens[compiler.cursor];
+        if (token.type == end) {
+            compiler.cursor++;
+            break;
+        }
+
+        if (token.type == TOK_NUMBER) {
+            emit((Instr){ .kind = I_NUMBER, .line = token.line, .value = token.value }, ++depth);
+            compiler.cursor++;
+            continue;
+        }
+        if (token.type == TOK_VAR) {
+            emit((Instr){ .kind = I_VAR, .line = token.line, .name = token.name }, ++depth);
+            compiler.cursor++;
+            if (at(TOK_OBRACKET)) reject("the program uses arrays");
+            continue;
+        }
+        if (token.type == TOK_OBRACKET || (token.type >= TOK_SUM && token.type <= TOK_FILL)) {
+            reject("the program uses arrays");
+        }
+
+        Op new_op = get_op_from_OpTable(token.type);
+        if (new_op.prec == 0) reject("the program has errors");
+        compiler.cursor++;
+
+        if (new_op.tok_type == TOK_OPAREN) {
+            prec_lvl++;
+            continue;
+        }
+        if (new_op.tok_type == TOK_CPAREN) {
+            if (--prec_lvl < 0) reject("the program has unbalanced parenthesis");
+            continue;
+        }
+
+        new_op.prec += MAX_PREC * prec_lvl;
+        while (ops->size > 0 && ops->data[ops->size - 1].op.prec >= new_op.prec) {
+            emit_operator(ops->data[--ops->size], &depth);
+        }
+
+        PendingOp pending = { new_op, false, depth };
+        if (new_op.family == LOGICAL && depth > 0) {
+            pending.short_circuit = true;
+            emit((Instr){ .kind = I_SHORT_BEGIN, .tok_type = new_op.tok_type, .line = token.line }, depth);
+        }
+        ARR_PUSH(ops, pending, PendingOp);
+    }
+
+    if (prec_lvl != 0) reject("the program has unbalanced parenthesis");
+    while (ops->size > 0) {
+        emit_operator(ops->data[--ops->size], &depth);
+    }
+
+    // An empty expression is 0
+    if (depth > 1) reject("the program has errors");
+    if (depth == 0) emit((Instr){ .kind = I_NUMBER, .value = INT_VALUE(0) }, 1);
+
+    stmt->expr_last = batch->instrs.size;
+}
+
+static void emit(Instr instr, int depth)
+{
+    Batch *batch = compiler.batch;
+    if (depth > batch->max_stack) batch->max_stack = depth;
+    if (instr.kind == I_SHORT_BEGIN && ++compiler.shorts > batch->max_shorts) batch->max_shorts = compiler.shorts;
+    if (instr.kind == I_SHORT_END) compiler.shorts--;
+    ARR_PUSH(&batch->instrs, instr, Instr);
+}
+
+static void emit_operator(PendingOp pending, int *depth)
+{
+    if (*depth < 2) reject("the program has errors");
+    // The right-hand side of a short-circuit has to be exactly what parse_expression() would skip
+    if (pending.short_circuit && *depth != pending.depth + 1) reject("the program has errors");
+
+    InstrKind kind = pending.op.family == ARITHMETIC ? I_ARITHMETIC
+                   : pending.op.family == COMPARISON ? I_COMPARISON : I_LOGICAL;
+    (*depth)--;
+    emit((Instr){ .kind = kind, .tok_type = pending.op.tok_type }, *depth);
+
+    if (pending.short_circuit) {
+        emit((Instr){ .kind = I_SHORT_END, .tok_type = pending.op.tok_type }, *depth);
+    }
+}
+
+// The 'exec's that end a task, as in_tail_position() finds them
+static void mark_tail(int block)
+{
+    Batch *batch = compiler.batch;
+    Block b = batch->blocks.data[block];
+    if (b.count == 0) return;
+
+    Stmt *last = &batch->stmts.data[batch->items.data[b.first + b.count - 1]];
+    if (last->kind == S_EXEC) {
+        last->tail = true;
+    } else if (last->kind == S_IF) {
+        mark_tail(last->body);
+        if (last->else_body != -1) mark_tail(last->else_body);
+    }
+}
+
+/* An 'exec' that doesn't end its task runs nested, on the C stack: a task that can get back to itself that way
+would be as deep as its input wants, so it's left to the parser, which doesn't use the C stack. */
+static void check_recursion(void)
+{
+    Batch *batch = compiler.batch;
+    int names = batch->program->names.size;
+
+    EdgeArr edges;
+    ARR_INIT(&edges);
+    for (int i = 0; i < batch->stmts.size; i++) {
+        Stmt *stmt = &batch->stmts.data[i];
+        if (stmt->kind == S_TASK) collect_execs(stmt->body, stmt->name, &edges);
+    }
+
+    bool *visited = GROW_ARRAY(bool, NULL, names + 1);
+    bool recursive = false;
+    for (int i = 0; i < edges.size && !recursive; i++)
+    {
+        if (edges.data[i].tail) continue;
+        memset(visited, 0, sizeof(bool) * (names + 1));
+        recursive = reaches(&edges, edges.data[i].to, edges.data[i].from, visited);
+    }
+
+    FREE_ARRAY(visited);
+    ARR_FREE(&edges);
+    if (recursive) reject("a task can execute itself again before ending");
+}
+
+static void collect_execs(int block, int from, EdgeArr *edges)
+{
+    Batch *batch = compiler.batch;
+    Block b = batch->blocks.data[block];
+
+    for (int i = b.first; i < b.first + b.count; i++)
+    {
+        Stmt *stmt = &batch->stmts.data[batch->items.data[i]];
+        if (stmt->kind == S_EXEC) {
+            Edge edge = { from, stmt->name, stmt->tail };
+            ARR_PUSH(edges, edge, Edge);
+        }
+        if (stmt->body != -1) collect_execs(stmt->body, from, edges);
+        if (stmt->else_body != -1) collect_execs(stmt->else_body, from, edges);
+    }
+}
+
+static bool reaches(EdgeArr *edges, int from, int to, bool *visited)
+{
+    if (from == to) return true;
+    if (visited[from]) return false;
+    visited[from] = true;
+
+    for (int i = 0; i < edges->size; i++) {
+        if (edges->data[i].from == from && reaches(edges, edges->data[i].to, to, visited)) return true;
+    }
+    return false;
+}
+
+/*
+ *
+ *  Lockstep execution
+ */
+
+// Lane i holds an integer in i[i] if the bit i of ints is set, a double in d[i] otherwise
+typedef struct Lanes {
+    int64_t i[BATCH_LANES];
+    double d[BATCH_LANES];
+    Mask ints;
+} Lanes;
+
+// The 'exec's ending a task, waiting to run in its place
+typedef struct Invocation {
+    Mask *pending; // lanes, by task
+    IntArr queue;  // tasks with pending lanes
+} Invocation;
+
+typedef struct BatchRun {
+    Batch *batch;
+    FILE **outs;
+    RunResult *results;
+    Mask alive;      // the lanes without an error
+    Lanes *vars;
+    Mask *declared;
+    int *tasks;      // body of the task declared with each name, -1 if none
+    int depth;       // of the nested 'exec's
+    Lanes *stack;
+    Mask *shorts;
+    int64_t steps[BATCH_LANES];
+    int64_t max_steps;
+    ExecBudget budget; // for its deadline
+    int until_clock;   // steps before looking at the clock again
+    bool out_of_time;
+} BatchRun;
+
+#define FOR_EACH_LANE(k, mask) \
+    for (Mask m_ = (mask), k = 0; m_ != 0 && ((k = __builtin_ctzll(m_)), 1); m_ &= m_ - 1)
+
+static Mask run_block(BatchRun *run, int block, Mask mask, Invocation *inv);
+static Mask run_statement(BatchRun *run, Stmt *stmt, Mask mask, Invocation *inv);
+static Mask run_condition(BatchRun *run, Stmt *stmt, Mask mask, Mask *false_lanes);
+static Mask invoke(BatchRun *run, int task, Mask mask);
+static Mask evaluate(BatchRun *run, int first, int last, Mask mask);
+static Mask take_step(BatchRun *run, Mask mask, int line);
+static void fail_lanes(BatchRun *run, Mask mask, int line, const char *err_msg, RunResult result);
+static void broadcast(Lanes *v, Value value);
+static void store(Lanes *dst, const Lanes *src, Mask mask);
+static void set_bools(Lanes *v, Mask mask, Mask values);
+static Mask truthy(const Lanes *v, Mask mask);
+static void to_doubles(const Lanes *v, double *out);
+static void arithmetic(Lanes *l, const Lanes *r, TokType tok_type, Mask mask);
+static void comparison(Lanes *l, const Lanes *r, TokType tok_type, Mask mask);
+static void logical(Lanes *l, const Lanes *r, TokType tok_type, Mask mask);
+
+#define CLOCK_STEPS 1024
+#define LANE_NAME(run, name) (run)->batch->program->names.data[name].len, \
+    &(run)->batch->program->text[(run)->batch->program->names.data[name].start]
+
+void run_batch(Batch *batch, const Define *defines, int cols, int lanes, FILE **outs, RunResult *results, ExecLimits limits)
+{
+    int names = batch->program->names.size;
+
+    BatchRun run = { .batch = batch, .outs = outs, .results = results, .max_steps = limits.max_steps };
+    run.alive = lanes == BATCH_LANES ? ~(Mask)0 : ((Mask)1 << lanes) - 1;
+    run.vars = GROW_ARRAY(Lanes, NULL, names + 1);
+    run.declared = GROW_ARRAY(Mask, NULL, names + 1);
+    run.tasks = GROW_ARRAY(int, NULL, names + 1);
+    run.stack = GROW_ARRAY(Lanes, NULL, batch->max_stack + 1);
+    run.shorts = GROW_ARRAY(Mask, NULL, batch->max_shorts + 1);
+    memset(run.vars, 0, sizeof(Lanes) * (names + 1));
+    memset(run.declared, 0, sizeof(Mask) * (names + 1));
+    for (int i = 0; i <= names; i++) run.tasks[i] = -1;
+
+    for (int k = 0; k < lanes; k++)
+    {
+        results[k] = RUN_OK;
+        for (int j = 0; j < cols; j++)
+        {
+            Define define = defines[k * cols + j];
+            Lanes *var = &run.vars[define.name];
+            Value value = value_result(define.value);
+            if (value.type == VAL_INT) {
+                var->i[k] = value.i;
+                var->ints |= (Mask)1 << k;
+            } else {
+                var->d[k] = value.d;
+                var->ints &= ~((Mask)1 << k);
+            }
+            run.declared[define.name] |= (Mask)1 << k;
+        }
+    }
+
+    init_exec_budget(&run.budget, limits);
+    run.until_clock = CLOCK_STEPS;
+
+    run_block(&run, batch->top, run.alive, NULL);
+
+    FREE_ARRAY(run.vars);
+    FREE_ARRAY(run.declared);
+    FREE_ARRAY(run.tasks);
+    FREE_ARRAY(run.stack);
+    FREE_ARRAY(run.shorts);
+}
+
+// Returns the lanes that get to the end of the block, without an error or an 'exec' ending their task
+static Mask run_block(BatchRun *run, int block, Mask mask, Invocation *inv)
+{
+    Batch *batch = run->batch;
+    Block b = batch->blocks.data[block];
+
+    for (int i = b.first; i < b.first + b.count && mask != 0; i++) {
+        mask = run_statement(run, &batch->stmts.data[batch->items.data[i]], mask, inv);
+    }
+    return mask;
+}
+
+static Mask run_statement(BatchRun *run, Stmt *stmt, Mask mask, Invocation *inv)
+{
+    char err_buffer[ERR_MSG_SIZE];
+
+    switch (stmt->kind)
+    {
+    case S_ASSIGN:
+    {
+        Mask fresh = mask & ~run->declared[stmt->name];
+        if (stmt->local && fresh != 0) {
+            snprintf(err_buffer, ERR_MSG_SIZE, "variable '%.*s' declared in local scope", LANE_NAME(run, stmt->name));
+            fail_lanes(run, fresh, stmt->line, err_buffer, RUN_ERROR);
+            mask &= ~fresh;
+        }
+        mask = evaluate(run, stmt->expr_first, stmt->expr_last, mask);
+        store(&run->vars[stmt->name], &run->stack[0], mask);
+        run->declared[stmt->name] |= mask;
+        return mask;
+    }
+
+    case S_PRINT:
+    {
+        mask = evaluate(run, stmt->expr_first, stmt->expr_last, mask);
+        Lanes *v = &run->stack[0];
+        FOR_EACH_LANE(k, mask) {
+            Value value = (v->ints >> k & 1) ? INT_VALUE(v->i[k]) : DOUBLE_VALUE(v->d[k]);
+            print_value(run->outs[k], value);
+        }
+        return mask;
+    }
+
+    case S_IF:
+    {
+        Mask else_lanes;
+        Mask then_lanes = run_condition(run, stmt, mask, &else_lanes);
+        Mask out = run_block(run, stmt->body, then_lanes, inv);
+        if (stmt->else_body != -1) out |= run_block(run, stmt->else_body, else_lanes, inv);
+        else out |= else_lanes;
+        return out & run->alive;
+    }
+
+    case S_WHILE:
+    {
+        // A lane leaves the loop when its condition is false, the loop ends when all of them have
+        Mask done;
+        Mask active = run_condition(run, stmt, mask, &done);
+        while (active != 0)
+        {
+            active = run_block(run, stmt->body, active, inv);
+            active = take_step(run, active, stmt->line);
+            Mask exited;
+            active = run_condition(run, stmt, active, &exited);
+            done |= exited;
+        }
+        return done & run->alive;
+    }
+
+    case S_EXEC:
+    {
+        if (run->tasks[stmt->name] == -1) {
+            snprintf(err_buffer, ERR_MSG_SIZE, "task '%.*s' doesn't exists", LANE_NAME(run, stmt->name));
+            fail_lanes(run, mask, stmt->line, err_buffer, RUN_ERROR);
+            return 0;
+        }
+
+        mask = take_step(run, mask, stmt->line);
+        if (mask == 0) return 0;
+
+        if (stmt->tail) {
+            int names = run->batch->program->names.size;
+            if (inv->pending == NULL) {
+                inv->pending = GROW_ARRAY(Mask, NULL, names + 1);
+                memset(inv->pending, 0, sizeof(Mask) * (names + 1));
+            }
+            if (inv->pending[stmt->name] == 0) ARR_PUSH(&inv->queue, stmt->name, int);
+            inv->pending[stmt->name] |= mask;
+            return 0;
+        }
+
+        if (run->depth == max_task_depth) {
+            snprintf(err_buffer, ERR_MSG_SIZE, "too many nested 'exec' (the limit is %d)", max_task_depth);
+            fail_lanes(run, mask, stmt->line, err_buffer, RUN_ERROR);
+            return 0;
+        }
+        return invoke(run, stmt->name, mask);
+    }
+
+    case S_TASK:
+        // Declared at the top level, so in every lane
+        run->tasks[stmt->name] = stmt->body;
+        return mask;
+    }
+
+    return mask;
+}
+
+static Mask run_condition(BatchRun *run, Stmt *stmt, Mask mask, Mask *false_lanes)
+{
+    mask = evaluate(run, stmt->expr_first, stmt->expr_last, mask);
+    Mask true_lanes = truthy(&run->stack[0], mask);
+    *false_lanes = mask & ~true_lanes;
+    return true_lanes;
+}
+
+// The lanes of a tail 'exec' run the task they go to, until none of them is left
+static Mask invoke(BatchRun *run, int task, Mask mask)
+{
+    Invocation inv = { .pending = NULL };
+    ARR_INIT(&inv.queue);
+
+    run->depth++;
+    Mask done = run_block(run, run->tasks[task], mask, &inv);
+
+    while (inv.queue.size > 0)
+    {
+        int next = inv.queue.data[--inv.queue.size];
+        Mask lanes = inv.pending[next] & run->alive;
+        inv.pending[next] = 0;
+        done |= run_block(run, run->tasks[next], lanes, &inv);
+    }
+    run->depth--;
+
+    FREE_ARRAY(inv.pending);
+    ARR_FREE(&inv.queue);
+    return done & run->alive;
+}
+
+// The value is left in stack[0]. Returns the lanes that evaluated it, without an error.
+static Mask evaluate(BatchRun *run, int first, int last, Mask mask)
+{
+    Instr *instrs = run->batch->instrs.data;
+    Lanes *stack = run->stack;
+    int top = 0;
+    int shorts = 0;
+
+    for (int pc = first; pc < last; pc++)
+    {
+        Instr *instr = &instrs[pc];
+        switch (instr->kind)
+        {
+        case I_NUMBER:
+            broadcast(&stack[top++], instr->value);
+            break;
+        case I_VAR:
+        {
+            Mask missing = mask & ~run->declared[instr->name];
+            if (missing != 0) {
+                char err_buffer[ERR_MSG_SIZE];
+                snprintf(err_buffer, ERR_MSG_SIZE, "variable '%.*s' not declared", LANE_NAME(run, instr->name));
+                fail_lanes(run, missing, instr->line, err_buffer, RUN_ERROR);
+                mask &= ~missing;
+            }
+            stack[top++] = run->vars[instr->name];
+            break;
+        }
+        case I_ARITHMETIC:
+            top--;
+            arithmetic(&stack[top - 1], &stack[top], instr->tok_type, mask);
+            break;
+        case I_COMPARISON:
+            top--;
+            comparison(&stack[top - 1], &stack[top], instr->tok_type, mask);
+            break;
+        case I_LOGICAL:
+            top--;
+            logical(&stack[top - 1], &stack[top], instr->tok_type, mask);
+            break;
+        case I_SHORT_BEGIN:
+        {
+            // The lanes decided by the left-hand side get its result now, and sit out the right-hand side
+            Mask lhs = truthy(&stack[top - 1], mask);
+            Mask decided = instr->tok_type == TOK_AND ? mask & ~lhs : mask & lhs;
+            set_bools(&stack[top - 1], decided, instr->tok_type == TOK_AND ? 0 : decided);
+            run->shorts[shorts++] = mask;
+            mask &= ~decided;
+            break;
+        }
+        case I_SHORT_END:
+            mask = run->shorts[--shorts] & run->alive;
+            break;
+        }
+    }
+
+    return mask;
+}
+
+// Each lane has its own step count, the deadline is the same for all of them
+static Mask take_step(BatchRun *run, Mask mask, int line)
+{
+    if (run->budget.has_deadline && (run->out_of_time || --run->until_clock < 0))
+    {
+        run->until_clock = CLOCK_STEPS;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > run->budget.deadline.tv_sec
+            || (now.tv_sec == run->budget.deadline.tv_sec && now.tv_nsec >= run->budget.deadline.tv_nsec))
+        {
+            run->out_of_time = true;
+        }
+
+        if (run->out_of_time) {
+            FOR_EACH_LANE(k, mask) {
+                char err_buffer[ERR_MSG_SIZE];
+                snprintf(err_buffer, ERR_MSG_SIZE, "time limit exceeded, after %" PRId64 " steps", run->steps[k]);
+                fail_lanes(run, (Mask)1 << k, line, err_buffer, RUN_OUT_OF_BUDGET);
+            }
+            return 0;
+        }
+    }
+
+    if (run->max_steps == 0 && !run->budget.has_deadline) return mask;
+
+    Mask over = 0;
+    FOR_EACH_LANE(k, mask) {
+        if (++run->steps[k] > run->max_steps && run->max_steps > 0) over |= (Mask)1 << k;
+    }
+    if (over != 0) {
+        char err_buffer[ERR_MSG_SIZE];
+        snprintf(err_buffer, ERR_MSG_SIZE, "step limit exceeded, after %" PRId64 " steps", run->max_steps);
+        fail_lanes(run, over, line, err_buffer, RUN_OUT_OF_BUDGET);
+    }
+    return mask & ~over;
+}
+
+static void fail_lanes(BatchRun *run, Mask mask, int line, const char *err_msg, RunResult result)
+{
+    FOR_EACH_LANE(k, mask) {
+        fprintf(run->outs[k], "Line %d: %s.\n", line, err_msg);
+        run->results[k] = result;
+    }
+    run->alive &= ~mask;
+}
+
+/*
+ *
+ *  Operations on lanes: every lane is computed, only the ones in the mask are used
+ */
+
+static void broadcast(Lanes *v, Value value)
+{
+    if (value.type == VAL_INT) {
+        for (int k = 0; k < BATCH_LANES; k++) v->i[k] = value.i;
+        v->ints = ~(Mask)0;
+    } else {
+        for (int k = 0; k < BATCH_LANES; k++) v->d[k] = value.d;
+        v->ints = 0;
+    }
+}
+
+static void store(Lanes *dst, const Lanes *src, Mask mask)
+{
+    FOR_EACH_LANE(k, mask) {
+        dst->i[k] = src->i[k];
+        dst->d[k] = src->d[k];
+    }
+    dst->ints = (dst->ints & ~mask) | (src->ints & mask);
+}
+
+// Like value_from_bool()
+static void set_bools(Lanes *v, Mask mask, Mask values)
+{
+    FOR_EACH_LANE(k, mask) {
+        v->i[k] = values >> k & 1;
+    }
+    v->ints |= mask;
+}
+
+// Like value_is_true()
+static Mask truthy(const Lanes *v, Mask mask)
+{
+    Mask res = 0;
+    FOR_EACH_LANE(k, mask) {
+        bool is_true = (v->ints >> k & 1) ? v->i[k] != 0 : v->d[k] != 0;
+        res |= (Mask)is_true << k;
+    }
+    return res;
+}
+
+static void to_doubles(const Lanes *v, double *out)
+{
+    for (int k = 0; k < BATCH_LANES; k++) {
+        out[k] = (v->ints >> k & 1) ? (double)v->i[k] : v->d[k];
+    }
+}
+
+// As perform_arithmetic_op(): integers stay integers, unless the result overflows or isn't whole
+static void arithmetic(Lanes *l, const Lanes *r, TokType tok_type, Mask mask)
+{
+    Mask ints = l->ints & r->ints & mask;
+    Mask exact = 0;
+    int64_t i_res[BATCH_LANES];
+    if (ints != 0) {
+        exact = int_lanes(tok_type, i_res, l->i, r->i, BATCH_LANES) & ints;
+    }
+
+    if ((mask & ~exact) != 0) {
+        double a[BATCH_LANES], b[BATCH_LANES];
+        to_doubles(l, a);
+        to_doubles(r, b);
+        double_lanes(tok_type, l->d, a, b, BATCH_LANES);
+    }
+
+    if (exact != 0) memcpy(l->i, i_res, sizeof(i_res));
+    l->ints = (l->ints & ~mask) | exact;
+}
+
+// As perform_comparison_op(): two integers are compared exactly, the rest as doubles
+static void comparison(Lanes *l, const Lanes *r, TokType tok_type, Mask mask)
+{
+    Mask ints = l->ints & r->ints & mask;
+    Mask res = 0;
+
+    if (ints != 0) {
+        int64_t i_res[BATCH_LANES];
+        int_lanes(tok_type, i_res, l->i, r->i, BATCH_LANES);
+        FOR_EACH_LANE(k, ints) {
+            res |= (Mask)(i_res[k] != 0) << k;
+        }
+    }
+
+    Mask others = mask & ~ints;
+    if (others != 0) {
+        double a[BATCH_LANES], b[BATCH_LANES], d_res[BATCH_LANES];
+        to_doubles(l, a);
+        to_doubles(r, b);
+        double_lanes(tok_type, d_res, a, b, BATCH_LANES);
+        FOR_EACH_LANE(k, others) {
+            res |= (Mask)(d_res[k] != 0) << k;
+        }
+    }
+
+    set_bools(l, mask, res);
+}
+
+// Only the lanes in the mask are written: the others may hold the result of a short-circuit
+static void logical(Lanes *l, const Lanes *r, TokType tok_type, Mask mask)
+{
+    Mask l_true = truthy(l, mask);
+    Mask r_true = truthy(r, mask);
+    set_bools(l, mask, tok_type == TOK_AND ? l_true & r_true : l_true | r_true);
+}
@@ -0,0 +1,24 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "parser.h"
+
+/* Lockstep execution of one program over a batch of inputs, like ISPC: each variable holds a vector of lanes,
+one for each input, and every operation works on all the lanes at once, with the SIMD kernels of the arrays.
+'if' and 'while' run their blocks under a mask of the lanes whose condition is true,
+so a loop goes on until it's false in every lane, and an error stops only the lanes it happens in.
+The output of each lane is the same as running its input alone.
+
+A program is compiled for it once, if it can be: it must be verified (see verifier.h), and use only numbers
+(no arrays, builtins, 'spawn' or 'wait') and tasks that don't 'exec' themselves again before ending,
+apart from an 'exec' that ends the task. Only the default numeric model runs in lockstep. */
+
+#define BATCH_LANES 64
+
+typedef struct Batch Batch;
+
+Batch *compile_batch(Program *program, const char **reason); // NULL, and why, if it can't run in lockstep
+void run_batch(Batch *batch, const Define *defines, int cols, int lanes, FILE **outs, RunResult *results, ExecLimits limits);
+void free_batch(Batch *batch);
+
+#endif // BATCH_H
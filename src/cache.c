@@ -0,0 +1,217 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "cache.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC "JISC"
+#define CACHE_VERSION 5
+#define CACHE_PATH_SIZE 4096
+
+// Sections start at multiples of 8, so the mapped tokens are aligned
+#define ALIGN8(n) (((n) + 7) & ~(uint64_t)7)
+
+typedef struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_hash;
+    uint64_t source_len;
+    uint32_t opt_level;
+    uint32_t numeric_model; // literals are converted by the tokenizer
+    uint32_t token_size; // a .jisc of a build with a different Token is rejected
+    uint64_t tokens_offset;
+    uint64_t tokens_count;
+    uint64_t names_offset;
+    uint64_t names_count;
+    uint64_t text_offset;
+    uint64_t text_len;
+} CacheHeader;
+
+static bool get_cache_path(char *path, uint64_t source_hash, char *buffer);
+static bool write_section(FILE *file, uint64_t *offset, const void *data, uint64_t size);
+static bool fits(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t size);
+static bool valid_program(Program *program);
+
+bool load_cached_program(char *path, char *source_code, size_t source_len, int opt_level, Program *program)
+{
+    uint64_t source_hash = hash_bytes(source_code, source_len);
+
+    char cache_path[CACHE_PATH_SIZE];
+    if (!get_cache_path(path, source_hash, cache_path)) return false;
+
+    int fd = open(cache_path, O_RDONLY);
+    if (fd == -1) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    char *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return false;
+
+    CacheHeader *header = (CacheHeader *)base;
+    bool valid = memcmp(header->magic, CACHE_MAGIC, 4) == 0 &&
+        header->version == CACHE_VERSION &&
+        header->source_hash == source_hash &&
+        header->source_len == source_len &&
+        header->opt_level == (uint32_t)opt_level &&
+        header->numeric_model == (uint32_t)numeric_model &&
+        header->token_size == sizeof(Token) &&
+        fits(header->tokens_offset, header->tokens_count, sizeof(Token), size) &&
+        fits(header->names_offset, header->names_count, sizeof(Name), size) &&
+        fits(header->text_offset, header->text_len, 1, size) &&
+        header->names_count <= INT_MAX &&
+        header->source_len < header->text_len &&
+        // The hash only finds the file: two sources of the same hash and length must not share it
+        memcmp(base + header->text_offset, source_code, source_len) == 0;
+
+    if (!valid) {
+        munmap(base, size);
+        return false;
+    }
+
+    program->text = base + header->text_offset;
+    program->text_len = header->text_len;
+    program->source_len = header->source_len;
+    program->tokens.data = (Token *)(base + header->tokens_offset);
+    program->tokens.size = program->tokens.cap = header->tokens_count;
+    program->names.data = (Name *)(base + header->names_offset);
+    program->names.size = program->names.cap = header->names_count;
+    program->name_slots = NULL;
+    program->name_slots_cap = 0;
+    program->mapping = base;
+    program->mapping_len = size;
+
+    // A damaged or crafted file is tokenized again, as if it wasn't there
+    if (!valid_program(program)) {
+        unmap_cached_program(program);
+        *program = (Program){0};
+        return false;
+    }
+
+    return true;
+}
+
+// The offsets come from the file: checked without overflowing
+static bool fits(uint64_t offset, uint64_t count, uint64_t item_size, uint64_t size)
+{
+    return offset <= size && count <= (size - offset) / item_size;
+}
+
+/* Everything the interpreter trusts without checking: the text of each token and name is inside the program text,
+the names are in the name array, and a number is a number, never a pointer. */
+static bool valid_program(Program *program)
+{
+    size_t text_len = program->text_len;
+    int names_count = program->names.size;
+    if (program->text[program->source_len] != '\0') return false;
+
+    for (int64_t i = 0; i < program->names.size; i++) {
+        Name name = program->names.data[i];
+        if (name.len < 0 || name.start > text_len || (size_t)name.len > text_len - name.start) return false;
+    }
+
+    for (int64_t i = 0; i < program->tokens.size; i++) {
+        Token token = program->tokens.data[i];
+        if (token.type < TOK_OPAREN || token.type > TOK_TASK) return false;
+        if (token.len < 0 || token.start > text_len || (size_t)token.len > text_len - token.start) return false;
+        if (token.name < -1 || token.name >= names_count) return false;
+        if ((token.type == TOK_VAR || token.type == TOK_TASK) && token.name == -1) return false;
+        if (token.type == TOK_NUMBER && token.value.type != VAL_INT && token.value.type != VAL_DOUBLE) return false;
+    }
+
+    return true;
+}
+
+void unmap_cached_program(Program *program)
+{
+    munmap(program->mapping, program->mapping_len);
+    program->mapping = NULL;
+    program->mapping_len = 0;
+}
+
+/* The file is written next to the final one and renamed,
+so a concurrent run never maps a half-written cache. Failures are ignored: the cache is optional. */
+void save_cached_program(char *path, char *source_code, size_t source_len, int opt_level, Program *program)
+{
+    CacheHeader header = {0};
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.source_hash = hash_bytes(source_code, source_len);
+    header.source_len = source_len;
+    header.opt_level = opt_level;
+    header.numeric_model = numeric_model;
+    header.token_size = sizeof(Token);
+    header.tokens_count = program->tokens.size;
+    header.names_count = program->names.size;
+    header.text_len = program->text_len;
+
+    char cache_path[CACHE_PATH_SIZE];
+    char tmp_path[CACHE_PATH_SIZE + 32];
+    if (!get_cache_path(path, header.source_hash, cache_path)) return;
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", cache_path, (long)getpid());
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (file == NULL) return;
+
+    // Header first, with the offsets filled in afterwards
+    uint64_t offset = ALIGN8(sizeof(CacheHeader));
+    header.tokens_offset = offset;
+    offset = ALIGN8(offset + header.tokens_count * sizeof(Token));
+    header.names_offset = offset;
+    offset = ALIGN8(offset + header.names_count * sizeof(Name));
+    header.text_offset = offset;
+
+    offset = 0;
+    bool ok = write_section(file, &offset, &header, sizeof(header)) &&
+        write_section(file, &offset, program->tokens.data, header.tokens_count * sizeof(Token)) &&
+        write_section(file, &offset, program->names.data, header.names_count * sizeof(Name)) &&
+        write_section(file, &offset, program->text, header.text_len);
+
+    ok = fclose(file) == 0 && ok;
+
+    if (!ok || rename(tmp_path, cache_path) != 0) {
+        remove(tmp_path);
+    }
+}
+
+// Writes data at the next multiple of 8
+static bool write_section(FILE *file, uint64_t *offset, const void *data, uint64_t size)
+{
+    static const char padding[8] = {0};
+
+    uint64_t aligned = ALIGN8(*offset);
+    if (aligned != *offset && fwrite(padding, 1, aligned - *offset, file) != aligned - *offset) {
+        return false;
+    }
+
+    if (size > 0 && fwrite(data, 1, size, file) != size) return false;
+
+    *offset = aligned + size;
+    return true;
+}
+
+static bool get_cache_path(char *path, uint64_t source_hash, char *buffer)
+{
+    char *cache_dir = getenv("JIS_CACHE_DIR");
+    int len;
+
+    if (cache_dir != NULL && cache_dir[0] != '\0') {
+        len = snprintf(buffer, CACHE_PATH_SIZE, "%s/%016llx.jisc", cache_dir, (unsigned long long)source_hash);
+    } else {
+        size_t path_len = strlen(path);
+        bool is_jis = path_len > 4 && strcmp(&path[path_len - 4], ".jis") == 0;
+        len = snprintf(buffer, CACHE_PATH_SIZE, is_jis ? "%sc" : "%s.jisc", path);
+    }
+
+    return len > 0 && len < CACHE_PATH_SIZE;
+}
@@ -0,0 +1,17 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "tokenizer.h"
+
+/* A compiled program is cached in a .jisc file: next to the script (prog.jis -> prog.jisc),
+or in $JIS_CACHE_DIR if set. The file holds the tokens (literal values included),
+the interned names and the text they refer to. Tokens and names store offsets, not pointers,
+so the file is mapped in memory and executed as it is, without being deserialized.
+The cache is valid only for the same source code (compared byte by byte, the hash only names the file),
+optimization level, numeric model and build. */
+
+bool load_cached_program(char *path, char *source_code, size_t source_len, int opt_level, Program *program);
+void save_cached_program(char *path, char *source_code, size_t source_len, int opt_level, Program *program);
+void unmap_cached_program(Program *program);
+
+#endif // CACHE_H
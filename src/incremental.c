@@ -0,0 +1,144 @@
+#include "incremental.h"
+#include "parser.h"
+
+static void check_statements(Session *session, int64_t cursor, int64_t edit_end, StartArr *tail, int64_t resume);
+
+void open_session(Session *session, char *source_code, size_t source_len)
+{
+    *session = (Session){0};
+    session->program.text = source_code;
+    session->program.text_len = source_len + 1;
+    session->program.source_len = source_len;
+
+    bool error = false;
+    init_tokenizer(source_code);
+    record_lex_errors(&session->lex_errors);
+    collect_tokens(&session->program, &error);
+    record_lex_errors(NULL);
+
+    StartArr tail;
+    ARR_INIT(&tail);
+    check_statements(session, 0, 0, &tail, -1);
+}
+
+bool edit_session(Session *session, size_t start, size_t end, const char *text, size_t len)
+{
+    Program *program = &session->program;
+    int64_t old_size = program->tokens.size;
+
+    bool error = false;
+    OffsetArr lex_errors;
+    ARR_INIT(&lex_errors);
+    record_lex_errors(&lex_errors);
+    TokenEdit edit = edit_program(program, start, end, text, len, &error);
+    record_lex_errors(NULL);
+
+    // The errors of the lines lexed again are replaced, the ones after them are moved
+    size_t old_lexed_to = edit.lexed_to - edit.delta;
+    int kept = 0;
+    for (int i = 0; i < session->lex_errors.size; i++)
+    {
+        size_t offset = session->lex_errors.data[i];
+        if (offset >= edit.lexed_from && offset < old_lexed_to) continue;
+        if (offset >= old_lexed_to) offset += edit.delta;
+        session->lex_errors.data[kept++] = offset;
+    }
+    session->lex_errors.size = kept;
+    for (int i = 0; i < lex_errors.size; i++) {
+        ARR_PUSH(&session->lex_errors, lex_errors.data[i], size_t);
+    }
+    ARR_FREE(&lex_errors);
+
+    int64_t old_end = edit.first + edit.removed;
+    int64_t shift = edit.added - edit.removed;
+
+    // Checking starts from the statement containing the first edited token,
+    // or from the one with an error, if it comes before
+    int64_t k = 0;
+    if (edit.first >= session->checked_to) {
+        k = session->starts.size;
+    } else {
+        while (k + 1 < session->starts.size && session->starts.data[k + 1] <= edit.first) k++;
+        // An 'if' looks at the token after it, for an 'else'
+        if (k > 0 && session->starts.data[k] == edit.first) k--;
+    }
+    int64_t cursor = k < session->starts.size ? session->starts.data[k] : session->checked_to;
+
+    // The statements after the edited tokens are unchanged, they are kept if checking gets back to them
+    StartArr tail;
+    ARR_INIT(&tail);
+    for (int64_t i = k + 1; i < session->starts.size; i++) {
+        if (session->starts.data[i] >= old_end) {
+            ARR_PUSH(&tail, session->starts.data[i] + shift, int64_t);
+        }
+    }
+
+    int64_t resume = -1;
+    if (session->checked_to < old_size) {
+        resume = session->checked_to >= old_end ? session->checked_to + shift : cursor;
+    }
+
+    session->starts.size = k;
+    check_statements(session, cursor, edit.first + edit.added, &tail, resume);
+
+    return session->valid;
+}
+
+void close_session(Session *session)
+{
+    free_program(&session->program);
+    free(session->program.text);
+    ARR_FREE(&session->starts);
+    ARR_FREE(&session->lex_errors);
+}
+
+/* Checks the statements from the token 'cursor'. After the token 'edit_end',
+reaching the start of a statement of 'tail' means that it and the ones after it are still valid:
+they are kept, and checking resumes from 'resume', where it stopped the last time (-1 if it reached the end).
+Frees tail. */
+static void check_statements(Session *session, int64_t cursor, int64_t edit_end, StartArr *tail, int64_t resume)
+{
+    Program *program = &session->program;
+    int64_t t = 0;
+
+    init_parser(program);
+
+    while (1)
+    {
+        if (cursor >= program->tokens.size) {
+            session->checked_to = program->tokens.size;
+            break;
+        }
+
+        if (cursor >= edit_end) {
+            while (t < tail->size && tail->data[t] < cursor) t++;
+            if (t < tail->size && tail->data[t] == cursor)
+            {
+                for (; t < tail->size; t++) {
+                    ARR_PUSH(&session->starts, tail->data[t], int64_t);
+                }
+                if (resume == -1) {
+                    session->checked_to = program->tokens.size;
+                    break;
+                }
+                cursor = resume;
+                tail->size = 0;
+                continue;
+            }
+        }
+
+        int64_t next = check_statement(cursor);
+        if (next == -1) {
+            session->checked_to = cursor;
+            break;
+        }
+
+        ARR_PUSH(&session->starts, cursor, int64_t);
+        cursor = next;
+    }
+
+    free_parser();
+    ARR_FREE(tail);
+
+    session->valid = session->checked_to == program->tokens.size && session->lex_errors.size == 0;
+}
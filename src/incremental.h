@@ -0,0 +1,24 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "tokenizer.h"
+
+DECLARE_ARR(StartArr, int64_t)
+
+/* A session keeps a program across edits of its source code (an editor buffer, or a watched file).
+An edit lexes again only the lines it touches, and checks again only the top-level statements it touches:
+checking goes on from the first of them until it gets back to the start of a statement
+that was already checked, after the edited tokens. */
+typedef struct Session {
+    Program program;
+    StartArr starts;          // first token of each checked top-level statement
+    int64_t checked_to;       // the statements are checked up to this token: the end, or the one with an error
+    OffsetArr lex_errors;     // where lexing failed
+    bool valid;
+} Session;
+
+void open_session(Session *session, char *source_code, size_t source_len); // takes the ownership of source_code
+bool edit_session(Session *session, size_t start, size_t end, const char *text, size_t len);
+void close_session(Session *session);
+
+#endif // INCREMENTAL_H
@@ -1,31 +1,174 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "utils.h"
 #include "tokenizer.h"
 #include "parser.h"
+#include "memo.h"
+#include "tier.h"
+#include "parallel.h"
+#include "optimizer.h"
+#include "cache.h"
+#include "incremental.h"
+#include "scheduler.h"
+#include "server.h"
+#include "sweep.h"
+#include "snapshot.h"
+#include "verifier.h"
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+static int interpret(char *path, char *source_code, size_t source_len, int opt_level, bool use_cache);
+static int run_program(Program *program);
+static int check_program(char *source_code, size_t source_len);
+static void watch(char *path, int opt_level);
+static void run_session(Session *session, int opt_level);
+
+static ExecLimits limits = {0};
+static SweepSpec sweep_spec = {0};
 
-static void interpret(char *source_code);
-static char *read_program_file(char *path);
+// --snapshot-after and --restore, of the program at 'program_path'
+static int snapshot_line = 0;
+static char *snapshot_path = NULL;
+static char *restore_path = NULL;
+static char *program_path = NULL;
+static int program_opt_level = 1;
+static char *read_program_file(char *path, size_t *len);
 
 int main(int argc, char **argv)
 {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: jis <path>\n");
+    int opt_level = 1;
+    bool use_cache = true;
+    bool watching = false;
+    bool checking = false;
+    char *serve_path = NULL;
+    char *connect_path = NULL;
+    int workers = 0;
+    int64_t max_memory = 256;
+    char *path = NULL;
+    bool usage_err = false;
+    sweep_spec.ranges = malloc(sizeof(char *) * argc);
+
+    for (int i = 1; i < argc; i++) {
+        bool has_arg = i + 1 < argc;
+        if (strcmp(argv[i], "-O0") == 0) opt_level = 0;
+        else if (strcmp(argv[i], "-O1") == 0) opt_level = 1;
+        else if (strcmp(argv[i], "--no-cache") == 0) use_cache = false;
+        else if (strcmp(argv[i], "--float") == 0) numeric_model = NUM_FLOAT;
+        else if (strcmp(argv[i], "--no-memo") == 0) memoize_tasks = false;
+        else if (strcmp(argv[i], "--memo-stats") == 0) count_memo_hits = true;
+        else if (strcmp(argv[i], "--tier-threshold") == 0 && has_arg) tier_threshold = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tier-stats") == 0) count_tier_stats = true;
+        else if (strcmp(argv[i], "--cost") == 0) count_cost = true;
+        else if (strcmp(argv[i], "--parallel") == 0) run_parallel = true;
+        else if (strcmp(argv[i], "--watch") == 0) watching = true;
+        else if (strcmp(argv[i], "--check") == 0) checking = strict_parens = true;
+        else if (strcmp(argv[i], "--serve") == 0 && has_arg) serve_path = argv[++i];
+        else if (strcmp(argv[i], "--connect") == 0 && has_arg) connect_path = argv[++i];
+        else if (strcmp(argv[i], "--workers") == 0 && has_arg) workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-memory") == 0 && has_arg) max_memory = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--max-depth") == 0 && has_arg) max_task_depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-steps") == 0 && has_arg) limits.max_steps = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--timeout") == 0 && has_arg) limits.max_millis = atoll(argv[++i]);
+        else if (strcmp(argv[i], "--sweep") == 0 && has_arg) sweep_spec.ranges[sweep_spec.range_count++] = argv[++i];
+        else if (strcmp(argv[i], "--sweep-csv") == 0 && has_arg) sweep_spec.csv_path = argv[++i];
+        else if (strcmp(argv[i], "--batch") == 0) sweep_spec.batch = true;
+        else if (strcmp(argv[i], "--snapshot-after") == 0 && i + 2 < argc) {
+            snapshot_line = atoi(argv[++i]);
+            snapshot_path = argv[++i];
+            usage_err |= snapshot_line < 1;
+        }
+        else if (strcmp(argv[i], "--restore") == 0 && has_arg) restore_path = argv[++i];
+        else if (path == NULL) path = argv[i];
+        else usage_err = true;
+    }
+
+    bool sweeping = sweep_spec.range_count > 0 || sweep_spec.csv_path != NULL;
+    if (sweeping && (sweep_spec.range_count > 0) == (sweep_spec.csv_path != NULL)) usage_err = true;
+    if (sweep_spec.batch && !sweeping) usage_err = true;
+    if (sweeping && (watching || serve_path != NULL || connect_path != NULL)) usage_err = true;
+    if (count_memo_hits && (watching || serve_path != NULL || connect_path != NULL)) usage_err = true;
+    if (count_tier_stats && (watching || serve_path != NULL || connect_path != NULL)) usage_err = true;
+    if (count_cost && (watching || serve_path != NULL || connect_path != NULL || sweep_spec.batch)) usage_err = true;
+    if ((snapshot_path != NULL || restore_path != NULL) && (sweeping || watching || serve_path != NULL || connect_path != NULL)) {
+        usage_err = true;
+    }
+    if (checking && (sweeping || watching || serve_path != NULL || connect_path != NULL || snapshot_path != NULL || restore_path != NULL)) {
+        usage_err = true;
+    }
+
+    // The snapshot tells the program, and how it was compiled
+    SnapshotInfo snapshot = {0};
+    if (restore_path != NULL && !usage_err) {
+        if (!read_snapshot_info(restore_path, &snapshot)) exit(EXIT_FAILURE);
+        if (path == NULL) path = snapshot.source_path;
+        opt_level = snapshot.opt_level;
+        numeric_model = snapshot.numeric_model;
+    }
+
+    if ((path == NULL) == (serve_path == NULL) || max_memory < 1 || max_task_depth < 1 || tier_threshold < 0
+        || limits.max_steps < 0 || limits.max_millis < 0 || usage_err)
+    {
+        fprintf(stderr, "Usage: jis [-O0|-O1] [--no-cache] [--float] [<limits>] [<memo>] [<tier>] [--cost] [--parallel] [--watch] <path>\n"
+                        "       jis [-O0|-O1] [--no-cache] [--float] [<limits>] [<memo>] [<tier>] [--cost] [--parallel] <sweep> <path>\n"
+                        "       jis [-O0|-O1] [--no-cache] [--float] [<limits>] [<memo>] [<tier>] [--cost] --snapshot-after <line> <out.snap> <path>\n"
+                        "       jis [--no-cache] [<limits>] [<memo>] [<tier>] [--cost] [--snapshot-after <line> <out.snap>] --restore <snap> [<path>]\n"
+                        "       jis [-O0|-O1] [--float] [<limits>] [--no-memo] [--tier-threshold <n>] [--parallel] [--workers <n>] [--max-memory <MiB>] --serve <socket>\n"
+                        "       jis --connect <socket> <path>\n"
+                        "       jis --check <path>\n"
+                        "Limits: [--max-depth <n>] [--max-steps <n>] [--timeout <ms>]\n"
+                        "Memo: [--no-memo] [--memo-stats]\n"
+                        "Tier: [--tier-threshold <n>] [--tier-stats]\n"
+                        "Sweep: (--sweep <name>=<start>:<end>[:<step>]... | --sweep-csv <path>) [--batch]\n");
         exit(EXIT_FAILURE);
     }
 
-    char *source_code = read_program_file(argv[1]);
-    interpret(source_code);
-    
-	free(source_code);
+    // Only a run of the program sweeps: the other modes return before it
+    if (!sweeping) {
+        free(sweep_spec.ranges);
+        sweep_spec.ranges = NULL;
+    }
+
+    if (serve_path != NULL) {
+        return serve(serve_path, opt_level, workers, max_memory * 1024 * 1024, limits);
+    }
 
-    return 0;
+    if (watching) {
+        watch(path, opt_level);
+        return 0;
+    }
+
+    size_t source_len;
+    char *source_code = read_program_file(path, &source_len);
+    if (source_code == NULL) exit(EXIT_FAILURE);
+
+    if (connect_path != NULL) {
+        int status = submit(connect_path, source_code, source_len);
+        free(source_code);
+        return status;
+    }
+
+    if (checking) {
+        return check_program(source_code, source_len);
+    }
+
+    program_path = path;
+    program_opt_level = opt_level;
+    int status = interpret(path, source_code, source_len, opt_level, use_cache);
+    free(snapshot.source_path);
+    free(sweep_spec.ranges);
+    return status;
 }
 
-static char *read_program_file(char *path) 
+// NULL if the file can't be read
+static char *read_program_file(char *path, size_t *len) 
 {
 	FILE *file = fopen(path, "rb");
 	if (file == NULL) {
 		fprintf(stderr, "Unable to open file '%s'.\n", path);
-		exit(EXIT_FAILURE);
+		return NULL;
 	}
 
 	fseek(file, 0L, SEEK_END);
@@ -35,47 +178,198 @@ static char *read_program_file(char *path)
 	char *buffer = (char *)malloc(f_size + 1);
 	if (buffer == NULL) {
 		fprintf(stderr, "Not enough memory to read '%s'.\n", path);
-		exit(EXIT_FAILURE);
+		fclose(file);
+		return NULL;
 	}
 	
 	size_t bytes = fread(buffer, sizeof(char), f_size, file);
 	if (bytes < f_size) {
 		fprintf(stderr, "Unable to read file '%s'.\n", path);
-		exit(EXIT_FAILURE);
+		free(buffer);
+		fclose(file);
+		return NULL;
 	}
 	
 	buffer[bytes] = '\0';
 	fclose(file);
 
+	*len = bytes;
 	return buffer;
 }
 
-static void interpret(char *source_code)
+// Takes the ownership of source_code. Returns the exit status.
+static int interpret(char *path, char *source_code, size_t source_len, int opt_level, bool use_cache)
 {
-	// 1 - Tokenization Phase
-	init_tokenizer(source_code);
-    
-	TokenArr ta;
-	ARR_INIT(&ta);
-
+	Program program = {0};
 	bool tokenization_err = false;
-	collect_tokens(&ta, &tokenization_err);
+
+	// 1 - A valid cache skips tokenization and optimization
+	bool from_cache = use_cache && load_cached_program(path, source_code, source_len, opt_level, &program);
+
+	if (!from_cache)
+	{
+		// 2 - Tokenization Phase
+		program.text = source_code;
+		program.text_len = source_len + 1;
+		program.source_len = source_len;
+		init_tokenizer(program.text);
+
+		collect_tokens(&program, &tokenization_err);
+
+		// 3 - Optimization phase
+		if (!tokenization_err && opt_level > 0) {
+			optimize_program(&program);
+		}
+
+		// The optimizer appends to the text, but it still starts with the source code
+		if (!tokenization_err && use_cache) {
+			save_cached_program(path, program.text, source_len, opt_level, &program);
+		}
+	}
 
 #ifdef TDEBUG
     printf("TOKENS:\n");
-    for (int i = 0; i < ta.size; i++)
+    for (int64_t i = 0; i < program.tokens.size; i++)
     {
-        print_token(ta.data[i]);
+        print_token(&program, program.tokens.data[i]);
         printf("\n");
     }
 #endif // TDEBUG
 
-	// 2 - Parsing and interpretation phase
+	// 4 - Parsing and interpretation phase
+	int status = EXIT_SUCCESS;
 	if (!tokenization_err) {
-		init_parser(ta);
-		parse_tokens();
+		status = sweep_spec.range_count > 0 || sweep_spec.csv_path != NULL
+			? sweep(&program, sweep_spec, limits)
+			: run_program(&program);
+		stop_scheduler();
+		if (count_memo_hits) print_memo_stats(&program, stderr);
+		if (count_tier_stats) print_tier_stats(&program, stderr);
+		if (count_cost) print_cost(stderr);
+	}
+
+	if (from_cache) {
+		unmap_cached_program(&program);
+		free(source_code);
+	} else {
+		free_program(&program);
+		free(program.text);
+	}
+
+	return status;
+}
+
+// Returns the exit status
+static int run_program(Program *program)
+{
+	ExecBudget budget;
+	init_exec_budget(&budget, limits);
+
+	init_parser(program);
+	set_exec_budget(&budget);
+	if (restore_path != NULL && !restore_snapshot(program, restore_path)) {
+		free_parser();
+		return EXIT_FAILURE;
+	}
+	if (snapshot_path != NULL) {
+		arm_snapshot(program, snapshot_line, snapshot_path, program_path, program_opt_level);
 	}
+	RunResult result = parse_tokens();
+	free_parser();
 
-	ARR_FREE(&ta);
+	if (result == RUN_OUT_OF_BUDGET) return EXIT_OUT_OF_BUDGET;
+	return result == RUN_OK ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
+/* jis --check: the source is only tokenized and verified, the errors printed like a run prints them.
+Takes the ownership of source_code. */
+static int check_program(char *source_code, size_t source_len)
+{
+	Program program = {0};
+	program.text = source_code;
+	program.text_len = source_len + 1;
+	program.source_len = source_len;
+	init_tokenizer(program.text);
+
+	bool tokenization_err = false;
+	collect_tokens(&program, &tokenization_err);
+	bool ok = !tokenization_err && verify_program(&program, NULL, stdout);
+
+	free_program(&program);
+	free(program.text);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Runs the program again every time the file changes. The file is polled:
+an edit is the part of the text between what is unchanged at its start and at its end,
+and only that is tokenized and checked again. The program runs only if it's valid,
+in a child process, so that nothing of a run is left for the next one. */
+static void watch(char *path, int opt_level)
+{
+	size_t source_len;
+	char *source_code = read_program_file(path, &source_len);
+	if (source_code == NULL) exit(EXIT_FAILURE);
+
+	Session session;
+	fprintf(stderr, "--- %s ---\n", path);
+	open_session(&session, source_code, source_len);
+	run_session(&session, opt_level);
+
+	struct stat last = {0};
+	stat(path, &last);
+
+	while (1)
+	{
+		nanosleep(&(struct timespec){ .tv_nsec = 100 * 1000 * 1000 }, NULL);
+
+		struct stat now;
+		if (stat(path, &now) != 0) continue;
+		if (now.st_mtim.tv_sec == last.st_mtim.tv_sec && now.st_mtim.tv_nsec == last.st_mtim.tv_nsec
+			&& now.st_size == last.st_size) continue;
+		last = now;
+
+		size_t new_len;
+		char *new_code = read_program_file(path, &new_len);
+		if (new_code == NULL) continue;
+
+		const char *old_code = session.program.text;
+		size_t old_len = session.program.source_len;
+		size_t prefix = 0;
+		while (prefix < old_len && prefix < new_len && old_code[prefix] == new_code[prefix]) prefix++;
+		size_t suffix = 0;
+		while (suffix < old_len - prefix && suffix < new_len - prefix
+			&& old_code[old_len - 1 - suffix] == new_code[new_len - 1 - suffix]) suffix++;
+
+		if (prefix == old_len && prefix == new_len) {
+			free(new_code);
+			continue;
+		}
+
+		fprintf(stderr, "--- %s ---\n", path);
+		edit_session(&session, prefix, old_len - suffix, new_code + prefix, new_len - suffix - prefix);
+		free(new_code);
+		run_session(&session, opt_level);
+	}
+}
+
+// The errors found checking the program are already printed
+static void run_session(Session *session, int opt_level)
+{
+	fflush(stdout);
+	if (!session->valid) return;
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		Program *program = &session->program;
+		if (opt_level > 0) {
+			optimize_program(program);
+		}
+		int status = run_program(program);
+		fflush(stdout);
+		_exit(status);
+	}
+	if (pid > 0) {
+		waitpid(pid, NULL, 0);
+	}
+}
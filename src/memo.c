@@ -0,0 +1,356 @@
+#include "memo.h"
+#include "runtime.h"
+#include "utils.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+
+/* A pure task is a function of a few variables, its inputs: they are all it reads, and what it writes,
+its outputs, depends only on them. So an 'exec' of it on inputs seen before only stores the outputs it stored then.
+A task is pure if it has no 'print', 'spawn', 'wait', arrays or builtins, and the tasks it executes are pure too
+(and not itself, even through others). Its inputs are the variables it may read before writing them,
+and the outputs that a path through it may leave unwritten. Each task has a cache of MEMO_SLOTS entries,
+the inputs hashed to a slot, and it is dropped for the rest of the run if it doesn't pay off. */
+
+#define MEMO_SLOTS 256
+#define MEMO_MAX_NAMES 32   // inputs, or outputs, of a task that is cached
+#define MEMO_TRIAL 256      // misses before checking the hits
+#define MEMO_MIN_HIT_RATE 8 // a task with less than one hit in this many calls isn't cached anymore
+
+typedef enum ScanState {
+    SCAN_PENDING,
+    SCAN_RUNNING, // found again by an 'exec' inside it: it's recursive
+    SCAN_DONE,
+} ScanState;
+
+struct PureTask {
+    int64_t proc_start;
+    bool redeclared; // 'exec' of it may run either body
+    ScanState state;
+    bool pure;
+    int inputs[MEMO_MAX_NAMES];
+    int input_count;
+    int outputs[MEMO_MAX_NAMES];
+    int output_count;
+    int written[MEMO_MAX_NAMES]; // outputs written on every path, so far while scanning
+    int written_count;
+    int depth;        // of the tasks executed inside it
+    Value *entries;   // MEMO_SLOTS entries of its inputs and then its outputs, allocated at the first miss
+    bool *valid;      // an entry whose outputs are set
+    bool gave_up;
+    int64_t hits;
+    int64_t misses;
+};
+
+// The hits and misses of the runs so far, by task name, if count_memo_hits
+typedef struct MemoCount {
+    int64_t hits;
+    int64_t misses;
+} MemoCount;
+
+static MemoCount *memo_counts;
+static int memo_counts_size;
+static pthread_mutex_t memo_counts_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void scan_task(PureTaskPtr *memo, PureTask *task);
+static int64_t scan_block(PureTaskPtr *memo, PureTask *task, int64_t cursor, bool top);
+static int64_t scan_expression(PureTask *task, int64_t cursor, TokType end);
+static bool add_name(int *names, int *count, int name);
+static bool has_name(const int *names, int count, int name);
+
+bool memoize_tasks = true;
+bool count_memo_hits = false;
+
+/* NULL if no task is pure, or memoization is off: with a step limit, a task must take the steps it would,
+so it always runs */
+PureTaskPtr *find_pure_tasks(void)
+{
+    if (!memoize_tasks || (parser.budget != NULL && parser.budget->max_steps > 0)) return NULL;
+
+    int64_t size = parser.token_arr.size;
+    Token *t = parser.token_arr.data;
+    int names = parser.program->names.size;
+    PureTaskPtr *memo = GROW_ARRAY(PureTaskPtr, NULL, names + 1);
+    memset(memo, 0, sizeof(PureTaskPtr) * (names + 1));
+
+    // The declarations, not the 'exec's and the 'spawn's of the tasks
+    for (int64_t i = 0; i + 1 < size; i++)
+    {
+        if (t[i].type != TOK_TASK || t[i + 1].type != TOK_OBRACE) continue;
+        if (i > 0 && (t[i - 1].type == TOK_EXEC_TASK || t[i - 1].type == TOK_SPAWN)) continue;
+
+        PureTask *task = memo[t[i].name];
+        if (task != NULL) {
+            task->redeclared = true;
+            continue;
+        }
+        task = reallocate(NULL, sizeof(PureTask));
+        *task = (PureTask){ .proc_start = i + 2 };
+        memo[t[i].name] = task;
+    }
+
+    for (int i = 0; i < names; i++) {
+        if (memo[i] != NULL) scan_task(memo, memo[i]);
+    }
+
+    bool any = false;
+    for (int i = 0; i < names; i++)
+    {
+        if (memo[i] != NULL && !memo[i]->pure) {
+            reallocate(memo[i], 0);
+            memo[i] = NULL;
+        }
+        any |= memo[i] != NULL;
+    }
+    if (!any) {
+        FREE_ARRAY(memo);
+        return NULL;
+    }
+    return memo;
+}
+
+static void scan_task(PureTaskPtr *memo, PureTask *task)
+{
+    if (task->state != SCAN_PENDING) return;
+    task->state = SCAN_RUNNING;
+
+    task->pure = !task->redeclared && scan_block(memo, task, task->proc_start, true) != -1;
+
+    // An output left unwritten by a path keeps the value it had
+    for (int i = 0; i < task->output_count && task->pure; i++) {
+        int name = task->outputs[i];
+        if (!has_name(task->written, task->written_count, name) && !has_name(task->inputs, task->input_count, name)) {
+            task->pure = add_name(task->inputs, &task->input_count, name);
+        }
+    }
+
+    task->state = SCAN_DONE;
+}
+
+/* The statements up to the '}' that closes the block, whose inputs and outputs are added to the task.
+Returns the index of the token after the '}', or -1 if the task isn't pure. top: the block is its body. */
+static int64_t scan_block(PureTaskPtr *memo, PureTask *task, int64_t cursor, bool top)
+{
+    int64_t size = parser.token_arr.size;
+    Token *t = parser.token_arr.data;
+
+    while (cursor < size && t[cursor].type != TOK_CBRACE)
+    {
+        switch (t[cursor].type)
+        {
+        case TOK_VAR:
+        {
+            int name = t[cursor].name;
+            if (cursor + 1 >= size || t[cursor + 1].type != TOK_ASSIGN) return -1; // an element is stored
+            cursor = scan_expression(task, cursor + 2, TOK_SEMICOLON);
+            if (cursor == -1 || !add_name(task->outputs, &task->output_count, name)) return -1;
+            if (top && !add_name(task->written, &task->written_count, name)) return -1;
+            break;
+        }
+        case TOK_IF:
+        case TOK_WHILE:
+        {
+            bool is_if = t[cursor].type == TOK_IF;
+            cursor = scan_expression(task, cursor + 1, TOK_OBRACE);
+            if (cursor != -1) cursor = scan_block(memo, task, cursor, false);
+            if (cursor == -1) return -1;
+            if (is_if && cursor + 1 < size && t[cursor].type == TOK_ELSE && t[cursor + 1].type == TOK_OBRACE) {
+                cursor = scan_block(memo, task, cursor + 2, false);
+                if (cursor == -1) return -1;
+            }
+            break;
+        }
+        case TOK_EXEC_TASK:
+        {
+            if (cursor + 2 >= size || t[cursor + 1].type != TOK_TASK || t[cursor + 2].type != TOK_SEMICOLON) return -1;
+            PureTask *callee = memo[t[cursor + 1].name];
+            if (callee == NULL) return -1;
+            scan_task(memo, callee);
+            if (callee->state != SCAN_DONE || !callee->pure) return -1;
+
+            for (int i = 0; i < callee->input_count; i++) {
+                int name = callee->inputs[i];
+                if (!has_name(task->written, task->written_count, name) && !add_name(task->inputs, &task->input_count, name)) return -1;
+            }
+            for (int i = 0; i < callee->output_count; i++) {
+                if (!add_name(task->outputs, &task->output_count, callee->outputs[i])) return -1;
+            }
+            for (int i = 0; i < callee->written_count && top; i++) {
+                if (!add_name(task->written, &task->written_count, callee->written[i])) return -1;
+            }
+            if (callee->depth + 1 > task->depth) task->depth = callee->depth + 1;
+            cursor += 3;
+            break;
+        }
+        default:
+            return -1;
+        }
+    }
+
+    return cursor < size ? cursor + 1 : -1;
+}
+
+// Returns the index of the token after 'end', or -1 if the expression isn't made only of numbers
+static int64_t scan_expression(PureTask *task, int64_t cursor, TokType end)
+{
+    int64_t size = parser.token_arr.size;
+    Token *t = parser.token_arr.data;
+
+    for (; cursor < size && t[cursor].type != end; cursor++)
+    {
+        TokType type = t[cursor].type;
+        if (type == TOK_VAR) {
+            int name = t[cursor].name;
+            if (!has_name(task->written, task->written_count, name) && !add_name(task->inputs, &task->input_count, name)) return -1;
+        } else if (!(type == TOK_NUMBER || type == TOK_OPAREN || type == TOK_CPAREN
+                     || (type >= TOK_PLUS && type <= TOK_OR && type != TOK_ASSIGN))) {
+            return -1;
+        }
+    }
+
+    return cursor < size ? cursor + 1 : -1;
+}
+
+// false if there are already MEMO_MAX_NAMES
+static bool add_name(int *names, int *count, int name)
+{
+    if (has_name(names, *count, name)) return true;
+    if (*count == MEMO_MAX_NAMES) return false;
+    names[(*count)++] = name;
+    return true;
+}
+
+static bool has_name(const int *names, int count, int name)
+{
+    for (int i = 0; i < count; i++) {
+        if (names[i] == name) return true;
+    }
+    return false;
+}
+
+static uint64_t value_bits(Value val)
+{
+    if (val.type == VAL_INT) return (uint64_t)val.i;
+    uint64_t bits;
+    memcpy(&bits, &val.d, sizeof(bits));
+    return bits;
+}
+
+/* At an 'exec' of a pure task: true if the cache has the outputs of its inputs, which are then stored.
+Otherwise *slot is the entry to fill at its end, or -1 if this run of it isn't cached. */
+bool recall_task(PureTask *task, int *slot)
+{
+    *slot = -1;
+    if (task->gave_up || parser.task_depth + 1 + task->depth > max_task_depth) return false;
+
+    // FNV-1a, over the numbers (an array, or an undeclared variable, isn't cached)
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < task->input_count; i++)
+    {
+        Variable *var = &variables.data[task->inputs[i]];
+        if (!var->declared || var->value.type == VAL_ARRAY) return false;
+        hash = (hash ^ var->value.type) * 1099511628211ULL;
+        hash = (hash ^ value_bits(var->value)) * 1099511628211ULL;
+    }
+
+    int width = task->input_count + task->output_count;
+    if (task->entries == NULL) {
+        task->entries = GROW_ARRAY(Value, NULL, MEMO_SLOTS * width + 1);
+        task->valid = GROW_ARRAY(bool, NULL, MEMO_SLOTS);
+        memset(task->valid, 0, sizeof(bool) * MEMO_SLOTS);
+    }
+
+    int s = hash % MEMO_SLOTS;
+    Value *entry = &task->entries[s * width];
+    bool hit = task->valid[s];
+    for (int i = 0; i < task->input_count && hit; i++) {
+        Value val = variables.data[task->inputs[i]].value;
+        hit = entry[i].type == val.type && value_bits(entry[i]) == value_bits(val);
+    }
+
+    if (hit) {
+        task->hits++;
+        for (int i = 0; i < task->output_count; i++) {
+            Variable *var = &variables.data[task->outputs[i]];
+            release_value(var->value);
+            var->declared = true;
+            var->written = true;
+            var->value = entry[task->input_count + i];
+            COUNT(stores);
+        }
+        return true;
+    }
+
+    task->misses++;
+    if (task->misses % MEMO_TRIAL == 0 && task->hits * MEMO_MIN_HIT_RATE < task->hits + task->misses) {
+        task->gave_up = true;
+        return false;
+    }
+
+    for (int i = 0; i < task->input_count; i++) {
+        entry[i] = variables.data[task->inputs[i]].value;
+    }
+    task->valid[s] = false;
+    *slot = s;
+    return false;
+}
+
+// At the end of a pure task, its outputs go to the entry of its inputs, taken by recall_task()
+void remember_task(PureTask *task, int slot)
+{
+    int width = task->input_count + task->output_count;
+    Value *outputs = &task->entries[slot * width + task->input_count];
+
+    for (int i = 0; i < task->output_count; i++)
+    {
+        Variable *var = &variables.data[task->outputs[i]];
+        if (!var->declared || var->value.type == VAL_ARRAY) return;
+        outputs[i] = var->value;
+    }
+    task->valid[slot] = true;
+}
+
+void free_pure_tasks(PureTaskPtr *memo)
+{
+    if (memo == NULL) return;
+    int names = parser.program->names.size;
+
+    if (count_memo_hits) pthread_mutex_lock(&memo_counts_lock);
+    if (count_memo_hits && memo_counts_size < names) {
+        memo_counts = GROW_ARRAY(MemoCount, memo_counts, names);
+        memset(&memo_counts[memo_counts_size], 0, sizeof(MemoCount) * (names - memo_counts_size));
+        memo_counts_size = names;
+    }
+
+    for (int i = 0; i < names; i++)
+    {
+        PureTask *task = memo[i];
+        if (task == NULL) continue;
+        if (count_memo_hits) {
+            memo_counts[i].hits += task->hits;
+            memo_counts[i].misses += task->misses;
+        }
+        FREE_ARRAY(task->entries);
+        FREE_ARRAY(task->valid);
+        reallocate(task, 0);
+    }
+
+    if (count_memo_hits) pthread_mutex_unlock(&memo_counts_lock);
+    FREE_ARRAY(memo);
+}
+
+void print_memo_stats(Program *program, FILE *out)
+{
+    bool any = false;
+    for (int i = 0; i < memo_counts_size; i++)
+    {
+        int64_t calls = memo_counts[i].hits + memo_counts[i].misses;
+        if (calls == 0) continue;
+        Name name = program->names.data[i];
+        fprintf(out, "%.*s: %" PRId64 " hits, %" PRId64 " misses (%.1f%% hit rate)\n",
+                name.len, &program->text[name.start], memo_counts[i].hits, memo_counts[i].misses,
+                100.0 * memo_counts[i].hits / calls);
+        any = true;
+    }
+    if (!any) fprintf(out, "No task was memoized.\n");
+}
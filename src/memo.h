@@ -0,0 +1,23 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "tokenizer.h"
+
+/* An 'exec' of a pure task, on inputs it ran on before, stores what it stored then (see find_pure_tasks()).
+--no-memo turns it off, --memo-stats counts the hits of each task. */
+extern bool memoize_tasks;
+extern bool count_memo_hits;
+void print_memo_stats(Program *program, FILE *out);
+
+typedef struct PureTask PureTask;
+typedef PureTask *PureTaskPtr;
+
+// Of the program being run, by task name (NULL if the task isn't pure)
+PureTaskPtr *find_pure_tasks(void);
+/* Before running the body: true if it stored the outputs, so the body is skipped.
+Otherwise *slot is where remember_task() stores them at its end, -1 if they aren't cached. */
+bool recall_task(PureTask *task, int *slot);
+void remember_task(PureTask *task, int slot);
+void free_pure_tasks(PureTaskPtr *memo);
+
+#endif // MEMO_H
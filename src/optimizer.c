@@ -0,0 +1,1455 @@
+#include "optimizer.h"
+#include "parser.h"
+#include "utils.h"
+
+#include <limits.h>
+
+/*
+ *
+ *  Intermediate representation
+ */
+
+/* The token array is lifted into a tree of statements and expressions,
+the passes work on the tree and the tree is lowered back into tokens.
+Everything the optimizer doesn't understand (a program that would fail at runtime)
+makes it give up and leave the tokens untouched, so errors are reported as usual. */
+
+typedef enum ExprKind {
+    EXPR_NUM,
+    EXPR_VAR,
+    EXPR_BINOP,
+} ExprKind;
+
+typedef struct Expr {
+    ExprKind kind;
+    Token token; // literal, variable or operator
+    int prec;    // precedence of the operator, without the parenthesis level
+    int name;    // interned name of a variable
+    int lhs;
+    int rhs;
+} Expr;
+
+typedef enum StmtKind {
+    STMT_ASSIGN,
+    STMT_PRINT,
+    STMT_EXEC,
+    STMT_IF,
+    STMT_WHILE,
+    STMT_TASK,
+} StmtKind;
+
+DECLARE_ARR(IntArr, int)
+
+typedef struct Stmt {
+    StmtKind kind;
+    Token head;     // variable name, 'print', 'exec', 'if', 'while' or task name
+    Token second;   // '=' of an assignment, task name of an exec
+    int name;       // assigned variable, executed or declared task
+    int top_pos;    // position of the enclosing top-level statement
+    int expr;       // root of the expression tree, -1 if the expression is empty
+    int expr_first; // original tokens of the expression: [expr_first, expr_last)
+    int expr_last;
+    bool rewritten; // the expression must be lowered from the tree
+    bool removed;
+    Token term;     // ';' or '{'
+    IntArr body;
+    Token body_close;
+    bool has_else;
+    Token else_head;
+    Token else_open;
+    IntArr else_body;
+    Token else_close;
+} Stmt;
+
+// What the optimizer knows about each name of the program
+typedef struct NameInfo {
+    bool is_temp;
+    int task; // index in task_infos, -1 if no task has this name
+} NameInfo;
+
+/* One bit per (non temporary) name. */
+typedef unsigned char *VarSet;
+
+typedef struct TaskInfo {
+    VarSet reads;
+    VarSet writes;
+    VarSet calls; // tasks it may execute, directly or not
+    int decl;     // the statement declaring it, -1 if declared more than once
+} TaskInfo;
+
+typedef struct Candidate {
+    int rep;      // first occurrence of the subexpression
+    int temp;     // name of the temporary holding it, -1 if none yet
+    int assign;   // statement storing the temporary, -1 if none
+    int pos;      // position, in the block, of the statement of the first occurrence
+    int count;
+    IntArr nodes; // occurrences
+    IntArr owners; // statements of the occurrences
+} Candidate;
+
+DECLARE_ARR(ExprArr, Expr)
+DECLARE_ARR(StmtArr, Stmt)
+DECLARE_ARR(NameInfoArr, NameInfo)
+DECLARE_ARR(TaskInfoArr, TaskInfo)
+DECLARE_ARR(CandidateArr, Candidate)
+#define TEMP_NAME_SIZE 16
+
+static bool lift_program(void);
+static int lift_stmt(int top_pos, bool nested);
+static void lift_body(IntArr *body, Token *close, int top_pos);
+static void lift_expr(Stmt *stmt, TokType terminator);
+static void reduce(IntArr *operands, IntArr *operators);
+static int new_temp(void);
+static size_t append_text(const char *text);
+static int new_expr(Expr expr);
+
+static VarSet set_new(void);
+static bool set_has(VarSet set, int name);
+static void set_add(VarSet set, int name);
+static void set_del(VarSet set, int name);
+static void set_union(VarSet dst, VarSet src);
+
+static void collect_expr_reads(int expr, VarSet set);
+static void collect_reads(Stmt *stmt, VarSet set);
+static void collect_writes(Stmt *stmt, VarSet set);
+static void collect_calls(Stmt *stmt, VarSet set);
+static void analyze_tasks(void);
+static void find_execs(IntArr *block, IntArr *execs);
+static void find_task_groups(IntArr *execs, int *execs_of, IntArr *order, IntArr *groups);
+static void compute_declarations(void);
+static bool is_declared(int name, Stmt *stmt);
+static bool expr_is_declared(int expr, Stmt *stmt);
+static bool expr_equal(int a, int b);
+
+static void inline_tasks(IntArr *block, bool is_scope0);
+static bool can_inline(Stmt *exec, bool is_scope0);
+static int count_tokens(IntArr *block);
+static bool has_loop(IntArr *block);
+static int clone_stmt(int stmt, int top_pos);
+static int clone_expr(int expr);
+static void number_positions(IntArr *block, int top_pos);
+
+static void eliminate_dead_stores(IntArr *block, bool is_program, bool is_scope0);
+static void hoist_loop_invariants(IntArr *block);
+static void hoist_from_stmt(int loop, int stmt, VarSet written, CandidateArr *hoisted, IntArr *out);
+static void hoist_from_expr(int loop, int stmt, int expr, VarSet written, CandidateArr *hoisted, IntArr *out);
+static bool is_invariant(int loop, int expr, VarSet written);
+static void eliminate_common_subexprs(IntArr *block);
+static void visit_subexprs(int expr, int stmt, int pos, CandidateArr *cands, IntArr *live);
+static bool expr_reads_any(int expr, VarSet set, int name);
+static int assign_temp(int expr, Stmt *at);
+
+static void lower_program(TokenArr *out);
+static void lower_block(TokenArr *out, IntArr *block);
+static void lower_stmt(TokenArr *out, Stmt *stmt);
+static void lower_expr(TokenArr *out, int expr, int parent_prec, bool is_rhs, int line);
+
+static void free_ir(void);
+
+static _Thread_local Program *prog;
+static _Thread_local TokenArr in; // the tokens being lifted
+static _Thread_local int cur;
+static _Thread_local bool failed;
+
+static _Thread_local ExprArr exprs;
+static _Thread_local StmtArr stmts;
+static _Thread_local NameInfoArr names; // indexed as prog->names
+static _Thread_local IntArr program;
+static _Thread_local TaskInfoArr task_infos;
+
+static _Thread_local int set_names; // names covered by a VarSet, temporaries come after them
+static _Thread_local int *first_decl; // top-level position of the first store of each variable
+static _Thread_local int temps;
+static _Thread_local int64_t punct_text; // offset of "()=;0", the text of the tokens made by the optimizer
+
+/* Past it, a program runs as it is written. Common subexpressions are looked for across every statement of a block,
+which grows with the square of the block: below it, that's a few hundred milliseconds at worst.
+It's also well below INT_MAX / 4, since the trees are indexed by ints with room for the tokens it adds. */
+#define OPTIMIZE_MAX_TOKENS (1 << 15)
+
+void optimize_program(Program *target)
+{
+    if (target->tokens.size > OPTIMIZE_MAX_TOKENS) return;
+
+    prog = target;
+    in = target->tokens;
+    cur = 0;
+    failed = false;
+
+    ARR_INIT(&exprs);
+    ARR_INIT(&stmts);
+    ARR_INIT(&names);
+    ARR_INIT(&program);
+    ARR_INIT(&task_infos);
+    first_decl = NULL;
+    temps = 0;
+    punct_text = -1;
+
+    for (int i = 0; i < target->names.size; i++) {
+        NameInfo info = {false, -1};
+        ARR_PUSH(&names, info, NameInfo);
+    }
+
+    if (!lift_program()) {
+        free_ir();
+        return;
+    }
+
+    set_names = names.size;
+    analyze_tasks();
+
+    compute_declarations();
+    inline_tasks(&program, true);
+    number_positions(&program, -1);
+
+    compute_declarations();
+    eliminate_dead_stores(&program, true, true);
+
+    // Stores may be gone, declarations may have moved
+    compute_declarations();
+    hoist_loop_invariants(&program);
+    eliminate_common_subexprs(&program);
+
+    TokenArr out;
+    ARR_INIT(&out);
+    lower_program(&out);
+
+    ARR_FREE(&target->tokens);
+    target->tokens = out;
+
+    free_ir();
+}
+
+/*
+ *
+ *  Lifting
+ */
+
+static bool at(TokType type) {
+    return cur < in.size && in.data[cur].type == type;
+}
+
+static bool lift_program(void)
+{
+    while (cur < in.size && !failed) {
+        int stmt = lift_stmt(program.size, false);
+        if (!failed) ARR_PUSH(&program, stmt, int);
+    }
+    return !failed;
+}
+
+static int lift_stmt(int top_pos, bool nested)
+{
+    Stmt stmt = {0};
+    stmt.expr = -1;
+    stmt.top_pos = top_pos;
+    stmt.head = in.data[cur];
+
+    switch (stmt.head.type)
+    {
+    case TOK_VAR:
+        stmt.kind = STMT_ASSIGN;
+        stmt.name = stmt.head.name;
+        cur++;
+        if (!at(TOK_ASSIGN)) {
+            failed = true;
+            break;
+        }
+        stmt.second = in.data[cur++];
+        lift_expr(&stmt, TOK_SEMICOLON);
+        break;
+    case TOK_PRINT:
+        stmt.kind = STMT_PRINT;
+        cur++;
+        lift_expr(&stmt, TOK_SEMICOLON);
+        break;
+    case TOK_EXEC_TASK:
+        stmt.kind = STMT_EXEC;
+        cur++;
+        if (cur >= in.size) {
+            failed = true;
+            break;
+        }
+        stmt.second = in.data[cur++];
+        stmt.name = stmt.second.name;
+        if (!at(TOK_SEMICOLON)) {
+            failed = true;
+            break;
+        }
+        stmt.term = in.data[cur++];
+        break;
+    case TOK_IF:
+        stmt.kind = STMT_IF;
+        cur++;
+        lift_expr(&stmt, TOK_OBRACE);
+        lift_body(&stmt.body, &stmt.body_close, top_pos);
+        if (!failed && at(TOK_ELSE)) {
+            stmt.has_else = true;
+            stmt.else_head = in.data[cur++];
+            if (!at(TOK_OBRACE)) {
+                failed = true;
+                break;
+            }
+            stmt.else_open = in.data[cur++];
+            lift_body(&stmt.else_body, &stmt.else_close, top_pos);
+        }
+        break;
+    case TOK_WHILE:
+        stmt.kind = STMT_WHILE;
+        cur++;
+        lift_expr(&stmt, TOK_OBRACE);
+        lift_body(&stmt.body, &stmt.body_close, top_pos);
+        break;
+    case TOK_TASK:
+        // Tasks in a local scope are an error
+        if (nested) {
+            failed = true;
+            break;
+        }
+        stmt.kind = STMT_TASK;
+        stmt.name = stmt.head.name;
+        cur++;
+        if (!at(TOK_OBRACE)) {
+            failed = true;
+            break;
+        }
+        stmt.term = in.data[cur++];
+        lift_body(&stmt.body, &stmt.body_close, top_pos);
+        break;
+    default:
+        failed = true;
+        break;
+    }
+
+    ARR_PUSH(&stmts, stmt, Stmt);
+    return stmts.size - 1;
+}
+
+static void lift_body(IntArr *body, Token *close, int top_pos)
+{
+    while (!failed && !at(TOK_CBRACE))
+    {
+        if (cur >= in.size) {
+            failed = true;
+            return;
+        }
+        int stmt = lift_stmt(top_pos, true);
+        ARR_PUSH(body, stmt, int);
+    }
+
+    if (!failed) *close = in.data[cur++];
+}
+
+/* Same stack-based precedence parsing of parse_expression(),
+but operators build nodes instead of computing numbers. */
+static void lift_expr(Stmt *stmt, TokType terminator)
+{
+    if (failed) return;
+
+    IntArr operands;
+    ARR_INIT(&operands);
+    IntArr operators; // token indices
+    ARR_INIT(&operators);
+    IntArr precs;
+    ARR_INIT(&precs);
+
+    stmt->expr_first = cur;
+    int prec_lvl = 0;
+
+    while (!failed && cur < in.size && in.data[cur].type != terminator)
+    {
+        Token token = in.data[cur];
+
+        if (token.type == TOK_NUMBER || token.type == TOK_VAR) {
+            Expr leaf = {0};
+            leaf.kind = token.type == TOK_NUMBER ? EXPR_NUM : EXPR_VAR;
+            leaf.token = token;
+            leaf.name = token.name;
+            leaf.lhs = leaf.rhs = -1;
+            ARR_PUSH(&operands, new_expr(leaf), int);
+            cur++;
+            continue;
+        }
+
+        Op op = get_op_from_OpTable(token.type);
+        if (op.prec == 0) {
+            failed = true;
+            break;
+        }
+
+        if (op.tok_type == TOK_OPAREN || op.tok_type == TOK_CPAREN) {
+            prec_lvl += op.tok_type == TOK_OPAREN ? 1 : -1;
+            if (prec_lvl < 0) failed = true;
+            cur++;
+            continue;
+        }
+
+        int prec = op.prec + MAX_PREC * prec_lvl;
+        while (!failed && !ARR_IS_EMPTY(&precs) && ARR_TOP(&precs) >= prec) {
+            reduce(&operands, &operators);
+            ARR_POP(&precs);
+        }
+
+        ARR_PUSH(&operators, cur, int);
+        ARR_PUSH(&precs, prec, int);
+        cur++;
+    }
+
+    // The parens left open are an error of the program, left to the verifier
+    if (cur >= in.size || prec_lvl != 0) failed = true;
+
+    while (!failed && !ARR_IS_EMPTY(&operators)) {
+        reduce(&operands, &operators);
+    }
+
+    // An empty expression evaluates to 0 and is kept as it is
+    if (operands.size > 1) failed = true;
+
+    if (!failed) {
+        stmt->expr = operands.size == 1 ? operands.data[0] : -1;
+        stmt->expr_last = cur;
+        stmt->term = in.data[cur++];
+    }
+
+    ARR_FREE(&operands);
+    ARR_FREE(&operators);
+    ARR_FREE(&precs);
+}
+
+static void reduce(IntArr *operands, IntArr *operators)
+{
+    if (operands->size < 2) {
+        failed = true;
+        return;
+    }
+
+    Expr node = {0};
+    node.kind = EXPR_BINOP;
+    node.token = in.data[ARR_TOP(operators)];
+    node.prec = get_op_from_OpTable(node.token.type).prec;
+    node.name = -1;
+    node.rhs = ARR_TOP(operands);
+    ARR_POP(operands);
+    node.lhs = ARR_TOP(operands);
+    ARR_POP(operands);
+    ARR_POP(operators);
+
+    ARR_PUSH(operands, new_expr(node), int);
+}
+
+static int new_temp(void)
+{
+    char text[TEMP_NAME_SIZE];
+    snprintf(text, TEMP_NAME_SIZE, "$t%d", temps++);
+    size_t start = append_text(text);
+    int name = intern_name(prog, start, strlen(text));
+
+    NameInfo info = {true, -1};
+    ARR_PUSH(&names, info, NameInfo);
+    return name;
+}
+
+// The optimized tokens refer to text that isn't in the source code, it's appended to it
+static size_t append_text(const char *text)
+{
+    size_t len = strlen(text);
+    prog->text = GROW_ARRAY(char, prog->text, prog->text_len + len + 1);
+    memcpy(&prog->text[prog->text_len], text, len + 1);
+    prog->text_len += len + 1;
+    return prog->text_len - len - 1;
+}
+
+static int new_expr(Expr expr)
+{
+    ARR_PUSH(&exprs, expr, Expr);
+    return exprs.size - 1;
+}
+
+static Token temp_token(int temp, int line)
+{
+    Name name = prog->names.data[temp];
+    return (Token){ .type = TOK_VAR, .start = name.start, .len = name.len, .line = line, .name = temp, .value = INT_VALUE(0) };
+}
+
+static Token punct_token(TokType type, int line)
+{
+    if (punct_text == -1) punct_text = append_text("()=;0");
+
+    int offset = 0;
+    switch (type)
+    {
+    case TOK_OPAREN:    offset = 0; break;
+    case TOK_CPAREN:    offset = 1; break;
+    case TOK_ASSIGN:    offset = 2; break;
+    case TOK_SEMICOLON: offset = 3; break;
+    case TOK_NUMBER:    offset = 4; break;
+    default:
+        assert("Unreachable" && false);
+        break;
+    }
+
+    return (Token){ .type = type, .start = punct_text + offset, .len = 1, .line = line, .name = -1, .value = INT_VALUE(0) };
+}
+
+/*
+ *
+ *  Analysis
+ */
+
+static VarSet set_new(void)
+{
+    VarSet set = calloc(set_names / 8 + 1, 1);
+    if (set == NULL) exit(1);
+    return set;
+}
+
+static _Thread_local bool set_changed; // set by set_add() and set_union() when a bit flips
+
+static bool set_has(VarSet set, int name) {
+    return name < set_names && (set[name / 8] >> (name % 8)) & 1;
+}
+
+static void set_add(VarSet set, int name)
+{
+    if (name < set_names && !set_has(set, name)) {
+        set[name / 8] |= 1 << (name % 8);
+        set_changed = true;
+    }
+}
+
+static void set_del(VarSet set, int name)
+{
+    if (name < set_names) set[name / 8] &= ~(1 << (name % 8));
+}
+
+static void set_union(VarSet dst, VarSet src)
+{
+    for (int i = 0; i < set_names / 8 + 1; i++) {
+        if ((dst[i] | src[i]) != dst[i]) {
+            dst[i] |= src[i];
+            set_changed = true;
+        }
+    }
+}
+
+static void collect_expr_reads(int expr, VarSet set)
+{
+    if (expr == -1) return;
+
+    Expr *e = &exprs.data[expr];
+    if (e->kind == EXPR_VAR) set_add(set, e->name);
+    if (e->kind == EXPR_BINOP) {
+        collect_expr_reads(e->lhs, set);
+        collect_expr_reads(e->rhs, set);
+    }
+}
+
+static void collect_block(IntArr *block, VarSet set, void (*collect)(Stmt *, VarSet))
+{
+    for (int i = 0; i < block->size; i++) {
+        Stmt *stmt = &stmts.data[block->data[i]];
+        if (!stmt->removed) collect(stmt, set);
+    }
+}
+
+// Variables that may be read when the statement is executed
+static void collect_reads(Stmt *stmt, VarSet set)
+{
+    switch (stmt->kind)
+    {
+    case STMT_ASSIGN:
+    case STMT_PRINT:
+        collect_expr_reads(stmt->expr, set);
+        break;
+    case STMT_IF:
+    case STMT_WHILE:
+        collect_expr_reads(stmt->expr, set);
+        collect_block(&stmt->body, set, collect_reads);
+        collect_block(&stmt->else_body, set, collect_reads);
+        break;
+    case STMT_EXEC:
+        if (names.data[stmt->name].task != -1) {
+            set_union(set, task_infos.data[names.data[stmt->name].task].reads);
+        }
+        break;
+    case STMT_TASK:
+        // The declaration doesn't execute the procedure
+        break;
+    }
+}
+
+// Variables that may be written when the statement is executed
+static void collect_writes(Stmt *stmt, VarSet set)
+{
+    switch (stmt->kind)
+    {
+    case STMT_ASSIGN:
+        set_add(set, stmt->name);
+        break;
+    case STMT_IF:
+    case STMT_WHILE:
+        collect_block(&stmt->body, set, collect_writes);
+        collect_block(&stmt->else_body, set, collect_writes);
+        break;
+    case STMT_EXEC:
+        if (names.data[stmt->name].task != -1) {
+            set_union(set, task_infos.data[names.data[stmt->name].task].writes);
+        }
+        break;
+    case STMT_PRINT:
+    case STMT_TASK:
+        break;
+    }
+}
+
+// Tasks that may be executed when the statement is executed
+static void collect_calls(Stmt *stmt, VarSet set)
+{
+    switch (stmt->kind)
+    {
+    case STMT_IF:
+    case STMT_WHILE:
+        collect_block(&stmt->body, set, collect_calls);
+        collect_block(&stmt->else_body, set, collect_calls);
+        break;
+    case STMT_EXEC:
+        set_add(set, stmt->name);
+        if (names.data[stmt->name].task != -1) {
+            set_union(set, task_infos.data[names.data[stmt->name].task].calls);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* A task may be declared more than once, what it reads and writes is the union of all its bodies.
+The tasks are summarized from those executed to those executing them, so the summaries of the tasks a body executes
+are complete when it's collected: only the tasks executing each other are collected again, until nothing changes. */
+static void analyze_tasks(void)
+{
+    for (int i = 0; i < program.size; i++) {
+        Stmt *stmt = &stmts.data[program.data[i]];
+        if (stmt->kind != STMT_TASK) continue;
+
+        if (names.data[stmt->name].task == -1) {
+            TaskInfo info = {set_new(), set_new(), set_new(), program.data[i]};
+            ARR_PUSH(&task_infos, info, TaskInfo);
+            names.data[stmt->name].task = task_infos.size - 1;
+        } else {
+            task_infos.data[names.data[stmt->name].task].decl = -1;
+        }
+    }
+
+    // The bodies of each task, and the tasks they execute directly, from bodies_of[task] and execs_of[task]
+    int count = task_infos.size;
+    IntArr bodies, execs;
+    ARR_INIT(&bodies);
+    ARR_INIT(&execs);
+    int *bodies_of = calloc(count + 2, sizeof(int));
+    int *execs_of = malloc(sizeof(int) * (count + 1));
+    if (bodies_of == NULL || execs_of == NULL) exit(1);
+
+    // Counted first, then placed, each after the bodies of the tasks before it
+    for (int i = 0; i < program.size; i++) {
+        Stmt *stmt = &stmts.data[program.data[i]];
+        if (stmt->kind != STMT_TASK) continue;
+        bodies_of[names.data[stmt->name].task + 2]++;
+        ARR_PUSH(&bodies, -1, int);
+    }
+    for (int task = 0; task < count; task++) bodies_of[task + 2] += bodies_of[task + 1];
+    for (int i = 0; i < program.size; i++) {
+        Stmt *stmt = &stmts.data[program.data[i]];
+        if (stmt->kind == STMT_TASK) bodies.data[bodies_of[names.data[stmt->name].task + 1]++] = program.data[i];
+    }
+
+    for (int task = 0; task < count; task++) {
+        execs_of[task] = execs.size;
+        for (int b = bodies_of[task]; b < bodies_of[task + 1]; b++) {
+            find_execs(&stmts.data[bodies.data[b]].body, &execs);
+        }
+    }
+    execs_of[count] = execs.size;
+
+    IntArr order, groups;
+    find_task_groups(&execs, execs_of, &order, &groups);
+
+    for (int g = 0; g + 1 < groups.size; g++)
+    {
+        int first = groups.data[g], last = groups.data[g + 1];
+        bool recursive = last - first > 1;
+        for (int i = execs_of[order.data[first]]; i < execs_of[order.data[first] + 1] && !recursive; i++) {
+            recursive = execs.data[i] == order.data[first];
+        }
+
+        do {
+            set_changed = false;
+            for (int i = first; i < last; i++) {
+                TaskInfo info = task_infos.data[order.data[i]];
+                for (int b = bodies_of[order.data[i]]; b < bodies_of[order.data[i] + 1]; b++) {
+                    Stmt *stmt = &stmts.data[bodies.data[b]];
+                    collect_block(&stmt->body, info.reads, collect_reads);
+                    collect_block(&stmt->body, info.writes, collect_writes);
+                    collect_block(&stmt->body, info.calls, collect_calls);
+                }
+            }
+        } while (recursive && set_changed);
+    }
+
+    ARR_FREE(&bodies);
+    ARR_FREE(&execs);
+    ARR_FREE(&order);
+    ARR_FREE(&groups);
+    free(bodies_of);
+    free(execs_of);
+}
+
+// The tasks executed directly in the block, by their index in task_infos
+static void find_execs(IntArr *block, IntArr *execs)
+{
+    for (int i = 0; i < block->size; i++) {
+        Stmt *stmt = &stmts.data[block->data[i]];
+        if (stmt->kind == STMT_EXEC && names.data[stmt->name].task != -1) {
+            ARR_PUSH(execs, names.data[stmt->name].task, int);
+        }
+        find_execs(&stmt->body, execs);
+        find_execs(&stmt->else_body, execs);
+    }
+}
+
+/* The strongly connected components of the tasks executing each other (Tarjan's algorithm, with a stack of its own
+since the chains of tasks can be long), in order: a group comes after all the groups it executes.
+The tasks of group g are order[groups[g]] up to order[groups[g + 1]]. */
+static void find_task_groups(IntArr *execs, int *execs_of, IntArr *order, IntArr *groups)
+{
+    int count = task_infos.size;
+    int *index = malloc(sizeof(int) * (count + 1));
+    int *low = malloc(sizeof(int) * (count + 1));
+    int *next_exec = malloc(sizeof(int) * (count + 1));
+    bool *done = calloc(count + 1, sizeof(bool));
+    if (index == NULL || low == NULL || next_exec == NULL || done == NULL) exit(1);
+    IntArr stack, path;
+    ARR_INIT(&stack);
+    ARR_INIT(&path);
+    ARR_INIT(order);
+    ARR_INIT(groups);
+
+    for (int i = 0; i < count; i++) index[i] = -1;
+    int visited = 0;
+
+    for (int root = 0; root < count; root++)
+    {
+        if (index[root] != -1) continue;
+
+        index[root] = low[root] = visited++;
+        next_exec[root] = execs_of[root];
+        ARR_PUSH(&stack, root, int);
+        ARR_PUSH(&path, root, int);
+
+        while (path.size > 0)
+        {
+            int task = path.data[path.size - 1];
+            if (next_exec[task] < execs_of[task + 1])
+            {
+                int callee = execs->data[next_exec[task]++];
+                if (index[callee] == -1) {
+                    index[callee] = low[callee] = visited++;
+                    next_exec[callee] = execs_of[callee];
+                    ARR_PUSH(&stack, callee, int);
+                    ARR_PUSH(&path, callee, int);
+                } else if (!done[callee] && index[callee] < low[task]) {
+                    low[task] = index[callee]; // still on the stack
+                }
+                continue;
+            }
+
+            ARR_POP(&path);
+            if (path.size > 0) {
+                int caller = path.data[path.size - 1];
+                if (low[task] < low[caller]) low[caller] = low[task];
+            }
+            if (low[task] != index[task]) continue;
+
+            // 'task' is the root of a group: the tasks above it on the stack
+            ARR_PUSH(groups, order->size, int);
+            int member;
+            do {
+                member = stack.data[--stack.size];
+                done[member] = true;
+                ARR_PUSH(order, member, int);
+            } while (member != task);
+        }
+    }
+    ARR_PUSH(groups, order->size, int);
+
+    free(index);
+    free(low);
+    free(next_exec);
+    free(done);
+    ARR_FREE(&stack);
+    ARR_FREE(&path);
+}
+
+/* A variable is surely declared by the time a statement runs if a top-level statement
+that comes before it stores it. Task bodies run after their declaration, so this holds for them too. */
+static void compute_declarations(void)
+{
+    free(first_decl);
+    first_decl = malloc(sizeof(int) * (set_names + 1));
+    if (first_decl == NULL) exit(1);
+
+    for (int i = 0; i < set_names; i++) {
+        first_decl[i] = INT_MAX;
+    }
+
+    for (int i = program.size - 1; i >= 0; i--) {
+        Stmt *stmt = &stmts.data[program.data[i]];
+        if (stmt->kind == STMT_ASSIGN && !stmt->removed) {
+            first_decl[stmt->name] = i;
+        }
+    }
+}
+
+static bool is_declared(int name, Stmt *stmt)
+{
+    if (names.data[name].is_temp) return true;
+    return first_decl[name] < stmt->top_pos;
+}
+
+static bool expr_is_declared(int expr, Stmt *stmt)
+{
+    if (expr == -1) return true;
+
+    Expr *e = &exprs.data[expr];
+    if (e->kind == EXPR_VAR) return is_declared(e->name, stmt);
+    if (e->kind == EXPR_BINOP) {
+        return expr_is_declared(e->lhs, stmt) && expr_is_declared(e->rhs, stmt);
+    }
+    return true;
+}
+
+static bool expr_equal(int a, int b)
+{
+    Expr *ea = &exprs.data[a];
+    Expr *eb = &exprs.data[b];
+
+    if (ea->kind != eb->kind) return false;
+
+    switch (ea->kind)
+    {
+    case EXPR_NUM:
+        return value_equals(ea->token.value, eb->token.value);
+    case EXPR_VAR:
+        return ea->name == eb->name;
+    case EXPR_BINOP:
+        return ea->token.type == eb->token.type &&
+            expr_equal(ea->lhs, eb->lhs) && expr_equal(ea->rhs, eb->rhs);
+    }
+
+    return false;
+}
+
+/*
+ *
+ *  Inlining
+ */
+
+/* The body of a small task replaces the 'exec' of it, so the jump to the procedure and back is gone.
+Tasks have no parameters and work on globals, so the body means the same thing at the call site.
+The inlined statements keep their tokens, so errors still report the lines of the task body.
+The program is visited in order, so the tasks inlined in a body have already been expanded. */
+
+#define INLINE_MAX_TOKENS 64
+
+static void inline_tasks(IntArr *block, bool is_scope0)
+{
+    IntArr out;
+    ARR_INIT(&out);
+
+    for (int i = 0; i < block->size; i++)
+    {
+        int stmt = block->data[i];
+        Stmt *s = &stmts.data[stmt];
+
+        if (s->kind == STMT_EXEC && can_inline(s, is_scope0))
+        {
+            int top_pos = s->top_pos;
+            int decl = task_infos.data[names.data[s->name].task].decl;
+            for (int j = 0; j < stmts.data[decl].body.size; j++) {
+                int copy = clone_stmt(stmts.data[decl].body.data[j], top_pos);
+                ARR_PUSH(&out, copy, int);
+            }
+            continue;
+        }
+
+        ARR_PUSH(&out, stmt, int);
+
+        // Inlining adds statements, which can move stmts.data
+        IntArr body = stmts.data[stmt].body, else_body = stmts.data[stmt].else_body;
+        inline_tasks(&body, stmts.data[stmt].kind == STMT_TASK);
+        inline_tasks(&else_body, false);
+        stmts.data[stmt].body = body;
+        stmts.data[stmt].else_body = else_body;
+    }
+
+    ARR_FREE(block);
+    *block = out;
+}
+
+static bool can_inline(Stmt *exec, bool is_scope0)
+{
+    int task = names.data[exec->name].task;
+    if (task == -1) return false;
+
+    TaskInfo info = task_infos.data[task];
+    if (info.decl == -1) return false;
+
+    Stmt *decl = &stmts.data[info.decl];
+
+    // Recursion: the body would have to be inlined into itself
+    if (set_has(info.calls, exec->name)) return false;
+
+    // The task must exist when the exec runs, i.e. be declared by a previous top-level statement
+    if (decl->top_pos >= exec->top_pos) return false;
+
+    if (count_tokens(&decl->body) > INLINE_MAX_TOKENS) return false;
+
+    /* A loop takes longer than the jump to it, and an 'exec' left as it is
+    may be memoized when running (see find_pure_tasks() in memo.c) */
+    if (has_loop(&decl->body)) return false;
+
+    /* The body of a task is executed at global scope.
+    Out of it, a store to a new variable would be a declaration in local scope. */
+    if (!is_scope0) {
+        for (int i = 0; i < decl->body.size; i++) {
+            Stmt *stmt = &stmts.data[decl->body.data[i]];
+            if (stmt->kind == STMT_ASSIGN && !is_declared(stmt->name, exec)) return false;
+        }
+    }
+
+    return true;
+}
+
+static bool has_loop(IntArr *block)
+{
+    for (int i = 0; i < block->size; i++)
+    {
+        Stmt *stmt = &stmts.data[block->data[i]];
+        if (stmt->kind == STMT_WHILE || has_loop(&stmt->body) || has_loop(&stmt->else_body)) return true;
+    }
+    return false;
+}
+
+static int count_tokens(IntArr *block)
+{
+    int count = 0;
+    for (int i = 0; i < block->size; i++)
+    {
+        Stmt *stmt = &stmts.data[block->data[i]];
+        switch (stmt->kind)
+        {
+        case STMT_ASSIGN:
+            count += 3 + stmt->expr_last - stmt->expr_first;
+            break;
+        case STMT_PRINT:
+            count += 2 + stmt->expr_last - stmt->expr_first;
+            break;
+        case STMT_EXEC:
+            count += 3;
+            break;
+        case STMT_IF:
+        case STMT_WHILE:
+            count += 3 + stmt->expr_last - stmt->expr_first + count_tokens(&stmt->body);
+            if (stmt->has_else) count += 3 + count_tokens(&stmt->else_body);
+            break;
+        case STMT_TASK:
+            count += 3 + count_tokens(&stmt->body);
+            break;
+        }
+    }
+    return count;
+}
+
+// The passes modify the trees in place, so a copy shares nothing with the original
+static int clone_stmt(int stmt, int top_pos)
+{
+    Stmt copy = stmts.data[stmt];
+    copy.top_pos = top_pos;
+    copy.expr = clone_expr(copy.expr);
+
+    ARR_INIT(&copy.body);
+    for (int i = 0; i < stmts.data[stmt].body.size; i++) {
+        int child = clone_stmt(stmts.data[stmt].body.data[i], top_pos);
+        ARR_PUSH(&copy.body, child, int);
+    }
+
+    ARR_INIT(&copy.else_body);
+    for (int i = 0; i < stmts.data[stmt].else_body.size; i++) {
+        int child = clone_stmt(stmts.data[stmt].else_body.data[i], top_pos);
+        ARR_PUSH(&copy.else_body, child, int);
+    }
+
+    ARR_PUSH(&stmts, copy, Stmt);
+    return stmts.size - 1;
+}
+
+static int clone_expr(int expr)
+{
+    if (expr == -1) return -1;
+
+    Expr copy = exprs.data[expr];
+    if (copy.kind == EXPR_BINOP) {
+        copy.lhs = clone_expr(copy.lhs);
+        copy.rhs = clone_expr(copy.rhs);
+    }
+    return new_expr(copy);
+}
+
+// Inlining moves statements to the top level, so the positions are assigned again
+static void number_positions(IntArr *block, int top_pos)
+{
+    for (int i = 0; i < block->size; i++) {
+        Stmt *stmt = &stmts.data[block->data[i]];
+        stmt->top_pos = top_pos == -1 ? i : top_pos;
+        number_positions(&stmt->body, stmt->top_pos);
+        number_positions(&stmt->else_body, stmt->top_pos);
+    }
+}
+
+/*
+ *
+ *  Dead-store elimination
+ */
+
+/* Backward liveness over a block. A store is dead if its variable isn't live after it.
+Outside of the program block everything is live at the end of the block.
+A conditional store may need the variable to be already declared (otherwise it's declared
+in a local scope), so conditional stores count as uses too. */
+static void eliminate_dead_stores(IntArr *block, bool is_program, bool is_scope0)
+{
+    VarSet live = set_new();
+    if (!is_program) memset(live, 0xff, set_names / 8 + 1);
+
+    for (int i = block->size - 1; i >= 0; i--)
+    {
+        Stmt *stmt = &stmts.data[block->data[i]];
+
+        switch (stmt->kind)
+        {
+        case STMT_ASSIGN:
+            if (!set_has(live, stmt->name) &&
+                (is_scope0 || is_declared(stmt->name, stmt)) &&
+                expr_is_declared(stmt->expr, stmt))
+            {
+                stmt->removed = true;
+                break;
+            }
+            set_del(live, stmt->name);
+            collect_expr_reads(stmt->expr, live);
+            break;
+        case STMT_IF:
+        case STMT_WHILE:
+            eliminate_dead_stores(&stmt->body, false, false);
+            eliminate_dead_stores(&stmt->else_body, false, false);
+            collect_reads(stmt, live);
+            collect_writes(stmt, live);
+            break;
+        case STMT_TASK:
+            eliminate_dead_stores(&stmt->body, false, true);
+            break;
+        default:
+            collect_reads(stmt, live);
+            collect_writes(stmt, live);
+            break;
+        }
+    }
+
+    free(live);
+}
+
+/*
+ *
+ *  Loop-invariant code motion
+ */
+
+/* The outer loops are visited first, so an expression invariant in more loops
+is hoisted out of all of them at once. */
+static void hoist_loop_invariants(IntArr *block)
+{
+    IntArr out;
+    ARR_INIT(&out);
+
+    for (int i = 0; i < block->size; i++)
+    {
+        int stmt = block->data[i];
+
+        if (stmts.data[stmt].kind == STMT_WHILE && !stmts.data[stmt].removed)
+        {
+            VarSet written = set_new();
+            collect_writes(&stmts.data[stmt], written);
+
+            CandidateArr hoisted;
+            ARR_INIT(&hoisted);
+            hoist_from_stmt(stmt, stmt, written, &hoisted, &out);
+
+            for (int j = 0; j < hoisted.size; j++) {
+                ARR_FREE(&hoisted.data[j].nodes);
+                ARR_FREE(&hoisted.data[j].owners);
+            }
+            ARR_FREE(&hoisted);
+            free(written);
+        }
+
+        ARR_PUSH(&out, stmt, int);
+
+        // Hoisting adds statements, which can move stmts.data
+        IntArr body = stmts.data[stmt].body, else_body = stmts.data[stmt].else_body;
+        hoist_loop_invariants(&body);
+        hoist_loop_invariants(&else_body);
+        stmts.data[stmt].body = body;
+        stmts.data[stmt].else_body = else_body;
+    }
+
+    ARR_FREE(block);
+    *block = out;
+}
+
+static void hoist_from_stmt(int loop, int stmt, VarSet written, CandidateArr *hoisted, IntArr *out)
+{
+    Stmt *s = &stmts.data[stmt];
+    if (s->removed) return;
+
+    // A task can't be declared inside a loop, so there is no need to skip STMT_TASK
+    hoist_from_expr(loop, stmt, s->expr, written, hoisted, out);
+
+    for (int i = 0; i < stmts.data[stmt].body.size; i++) {
+        hoist_from_stmt(loop, stmts.data[stmt].body.data[i], written, hoisted, out);
+    }
+    for (int i = 0; i < stmts.data[stmt].else_body.size; i++) {
+        hoist_from_stmt(loop, stmts.data[stmt].else_body.data[i], written, hoisted, out);
+    }
+}
+
+static void hoist_from_expr(int loop, int stmt, int expr, VarSet written, CandidateArr *hoisted, IntArr *out)
+{
+    if (expr == -1 || exprs.data[expr].kind != EXPR_BINOP) return;
+
+    if (!is_invariant(loop, expr, written)) {
+        hoist_from_expr(loop, stmt, exprs.data[expr].lhs, written, hoisted, out);
+        hoist_from_expr(loop, stmt, exprs.data[expr].rhs, written, hoisted, out);
+        return;
+    }
+
+    int temp = -1;
+    for (int i = 0; i < hoisted->size; i++) {
+        if (expr_equal(hoisted->data[i].rep, expr)) {
+            temp = hoisted->data[i].temp;
+            break;
+        }
+    }
+
+    if (temp == -1) {
+        Candidate cand = {0};
+        cand.rep = expr;
+        cand.temp = temp = assign_temp(expr, &stmts.data[loop]);
+        ARR_PUSH(out, stmts.size - 1, int);
+        ARR_PUSH(hoisted, cand, Candidate);
+    }
+
+    Expr *e = &exprs.data[expr];
+    e->kind = EXPR_VAR;
+    e->name = temp;
+    e->token = temp_token(temp, e->token.line);
+    stmts.data[stmt].rewritten = true;
+}
+
+// Evaluating it before the loop gives the same value it has in each iteration, and can't fail
+static bool is_invariant(int loop, int expr, VarSet written)
+{
+    Expr *e = &exprs.data[expr];
+    switch (e->kind)
+    {
+    case EXPR_NUM:
+        return true;
+    case EXPR_VAR:
+        return !set_has(written, e->name) && is_declared(e->name, &stmts.data[loop]);
+    case EXPR_BINOP:
+        return is_invariant(loop, e->lhs, written) && is_invariant(loop, e->rhs, written);
+    }
+    return false;
+}
+
+/* Creates the statement '$t<n> = <copy of expr>;' right before 'at',
+returns the name of the temporary. The caller places the statement. */
+static int assign_temp(int expr, Stmt *at)
+{
+    int line = at->head.line;
+    int top_pos = at->top_pos;
+    int temp = new_temp();
+
+    Stmt stmt = {0};
+    stmt.kind = STMT_ASSIGN;
+    stmt.head = temp_token(temp, line);
+    stmt.second = punct_token(TOK_ASSIGN, line);
+    stmt.name = temp;
+    stmt.top_pos = top_pos;
+    stmt.expr = new_expr(exprs.data[expr]);
+    stmt.rewritten = true;
+    stmt.term = punct_token(TOK_SEMICOLON, line);
+
+    ARR_PUSH(&stmts, stmt, Stmt);
+    return temp;
+}
+
+/*
+ *
+ *  Common-subexpression elimination
+ */
+
+/* Inside a block, the statements are executed one after the other.
+A subexpression found again before any of its variables is written is computed once.
+Occurrences in the right-hand side of '&&' and '||' are ignored, since they may not be evaluated.
+'while' conditions are evaluated once per iteration, so they are left to the loop-invariant pass. */
+static void eliminate_common_subexprs(IntArr *block)
+{
+    CandidateArr cands;
+    ARR_INIT(&cands);
+    IntArr live; // candidates none of whose variables has been written since the first occurrence
+    ARR_INIT(&live);
+
+    for (int i = 0; i < block->size; i++)
+    {
+        int stmt = block->data[i];
+        Stmt *s = &stmts.data[stmt];
+        if (s->removed) continue;
+
+        // The temporaries add statements, which can move stmts.data
+        IntArr body = s->body, else_body = s->else_body;
+        eliminate_common_subexprs(&body);
+        eliminate_common_subexprs(&else_body);
+
+        s = &stmts.data[stmt];
+        s->body = body;
+        s->else_body = else_body;
+        if (s->kind == STMT_ASSIGN || s->kind == STMT_PRINT || s->kind == STMT_IF) {
+            visit_subexprs(s->expr, stmt, i, &cands, &live);
+        }
+
+        // Kill the candidates whose variables are written by the statement
+        if (s->kind == STMT_PRINT || s->kind == STMT_TASK) continue;
+
+        VarSet written = NULL;
+        if (s->kind != STMT_ASSIGN) {
+            written = set_new();
+            collect_writes(s, written);
+        }
+
+        int kept = 0;
+        for (int j = 0; j < live.size; j++) {
+            int rep = cands.data[live.data[j]].rep;
+            bool killed = s->kind == STMT_ASSIGN ?
+                expr_reads_any(rep, NULL, s->name) : expr_reads_any(rep, written, -1);
+            if (!killed) live.data[kept++] = live.data[j];
+        }
+        live.size = kept;
+        free(written);
+    }
+    ARR_FREE(&live);
+
+    for (int i = 0; i < cands.size; i++)
+    {
+        Candidate *cand = &cands.data[i];
+        Stmt *at = &stmts.data[block->data[cand->pos]];
+        if (cand->count < 2 || !expr_is_declared(cand->rep, at)) continue;
+
+        int temp = cand->temp = assign_temp(cand->rep, at);
+        cand->assign = stmts.size - 1;
+
+        for (int j = 0; j < cand->nodes.size; j++) {
+            Expr *e = &exprs.data[cand->nodes.data[j]];
+            e->kind = EXPR_VAR;
+            e->name = temp;
+            e->token = temp_token(temp, e->token.line);
+            stmts.data[cand->owners.data[j]].rewritten = true;
+        }
+    }
+
+    /* Place the assignments before the statement of the first occurrence.
+    A candidate nested in another one, with the same first statement, was found later,
+    so the candidates of the same statement are placed in reverse order. */
+    IntArr out;
+    ARR_INIT(&out);
+    int next = 0;
+    for (int i = 0; i < block->size; i++)
+    {
+        int first = next;
+        while (next < cands.size && cands.data[next].pos == i) next++;
+        for (int j = next - 1; j >= first; j--) {
+            if (cands.data[j].assign != -1) ARR_PUSH(&out, cands.data[j].assign, int);
+        }
+        ARR_PUSH(&out, block->data[i], int);
+    }
+
+    for (int i = 0; i < cands.size; i++) {
+        ARR_FREE(&cands.data[i].nodes);
+        ARR_FREE(&cands.data[i].owners);
+    }
+    ARR_FREE(&cands);
+    ARR_FREE(block);
+    *block = out;
+}
+
+static void visit_subexprs(int expr, int stmt, int pos, CandidateArr *cands, IntArr *live)
+{
+    if (expr == -1 || exprs.data[expr].kind != EXPR_BINOP) return;
+
+    for (int i = 0; i < live->size; i++) {
+        Candidate *cand = &cands->data[live->data[i]];
+        if (expr_equal(cand->rep, expr)) {
+            cand->count++;
+            ARR_PUSH(&cand->nodes, expr, int);
+            ARR_PUSH(&cand->owners, stmt, int);
+            return;
+        }
+    }
+
+    Candidate cand = {0};
+    cand.rep = expr;
+    cand.temp = -1;
+    cand.assign = -1;
+    cand.pos = pos;
+    cand.count = 1;
+    ARR_PUSH(&cand.nodes, expr, int);
+    ARR_PUSH(&cand.owners, stmt, int);
+    ARR_PUSH(cands, cand, Candidate);
+    ARR_PUSH(live, cands->size - 1, int);
+
+    visit_subexprs(exprs.data[expr].lhs, stmt, pos, cands, live);
+
+    // The right-hand side of '&&' and '||' may be skipped, don't compute it upfront
+    TokType op = exprs.data[expr].token.type;
+    if (op != TOK_AND && op != TOK_OR) {
+        visit_subexprs(exprs.data[expr].rhs, stmt, pos, cands, live);
+    }
+}
+
+// Does expr read a variable of set, or the variable name?
+static bool expr_reads_any(int expr, VarSet set, int name)
+{
+    Expr *e = &exprs.data[expr];
+    if (e->kind == EXPR_VAR) return e->name == name || (set != NULL && set_has(set, e->name));
+    if (e->kind == EXPR_BINOP) {
+        return expr_reads_any(e->lhs, set, name) || expr_reads_any(e->rhs, set, name);
+    }
+    return false;
+}
+
+/*
+ *
+ *  Lowering
+ */
+
+static void lower_program(TokenArr *out)
+{
+    // The temporaries are declared upfront, because they may be first stored in a local scope
+    int line = in.size > 0 ? in.data[0].line : 1;
+    for (int i = 0; i < names.size; i++) {
+        if (!names.data[i].is_temp) continue;
+        Token decl[] = {
+            temp_token(i, line),
+            punct_token(TOK_ASSIGN, line),
+            punct_token(TOK_NUMBER, line),
+            punct_token(TOK_SEMICOLON, line),
+        };
+        for (size_t j = 0; j < sizeof(decl) / sizeof(decl[0]); j++) {
+            ARR_PUSH(out, decl[j], Token);
+        }
+    }
+
+    lower_block(out, &program);
+}
+
+static void lower_block(TokenArr *out, IntArr *block)
+{
+    for (int i = 0; i < block->size; i++) {
+        lower_stmt(out, &stmts.data[block->data[i]]);
+    }
+}
+
+static void lower_stmt(TokenArr *out, Stmt *stmt)
+{
+    if (stmt->removed) return;
+
+    ARR_PUSH(out, stmt->head, Token);
+
+    if (stmt->kind == STMT_ASSIGN || stmt->kind == STMT_EXEC) {
+        ARR_PUSH(out, stmt->second, Token);
+    }
+
+    if (stmt->kind != STMT_EXEC && stmt->kind != STMT_TASK) {
+        if (stmt->rewritten) {
+            lower_expr(out, stmt->expr, 0, false, stmt->head.line);
+        } else {
+            for (int i = stmt->expr_first; i < stmt->expr_last; i++) {
+                ARR_PUSH(out, in.data[i], Token);
+            }
+        }
+    }
+
+    ARR_PUSH(out, stmt->term, Token);
+
+    if (stmt->kind == STMT_IF || stmt->kind == STMT_WHILE || stmt->kind == STMT_TASK) {
+        lower_block(out, &stmt->body);
+        ARR_PUSH(out, stmt->body_close, Token);
+    }
+
+    if (stmt->has_else) {
+        ARR_PUSH(out, stmt->else_head, Token);
+        ARR_PUSH(out, stmt->else_open, Token);
+        lower_block(out, &stmt->else_body);
+        ARR_PUSH(out, stmt->else_close, Token);
+    }
+}
+
+/* Parenthesis raise the precedence of everything between them,
+so they are needed only where the tree goes against the precedence of the operators. */
+static void lower_expr(TokenArr *out, int expr, int parent_prec, bool is_rhs, int line)
+{
+    if (expr == -1) return;
+
+    Expr e = exprs.data[expr];
+    if (e.kind != EXPR_BINOP) {
+        ARR_PUSH(out, e.token, Token);
+        return;
+    }
+
+    bool paren = e.prec < parent_prec || (e.prec == parent_prec && is_rhs);
+    if (paren) ARR_PUSH(out, punct_token(TOK_OPAREN, line), Token);
+
+    lower_expr(out, e.lhs, e.prec, false, line);
+    ARR_PUSH(out, e.token, Token);
+    lower_expr(out, e.rhs, e.prec, true, line);
+
+    if (paren) ARR_PUSH(out, punct_token(TOK_CPAREN, line), Token);
+}
+
+static void free_ir(void)
+{
+    for (int i = 0; i < stmts.size; i++) {
+        ARR_FREE(&stmts.data[i].body);
+        ARR_FREE(&stmts.data[i].else_body);
+    }
+    for (int i = 0; i < task_infos.size; i++) {
+        free(task_infos.data[i].reads);
+        free(task_infos.data[i].writes);
+        free(task_infos.data[i].calls);
+    }
+    free(first_decl);
+    first_decl = NULL;
+
+    ARR_FREE(&exprs);
+    ARR_FREE(&stmts);
+    ARR_FREE(&names);
+    ARR_FREE(&program);
+    ARR_FREE(&task_infos);
+}
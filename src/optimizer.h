@@ -0,0 +1,14 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "tokenizer.h"
+
+/* The optimizer (-O1) rebuilds the token array the parser executes.
+It drops stores that are overwritten before being read, hoists loop-invariant
+subexpressions out of 'while' bodies and computes repeated subexpressions once.
+Hoisted and shared values live in global temporaries named '$t<n>',
+a name the tokenizer can't produce, so they never clash with user variables. */
+
+void optimize_program(Program *program);
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,276 @@
+#include "parallel.h"
+#include "runtime.h"
+#include "utils.h"
+#include "scheduler.h"
+
+/* With --parallel, a top-level statement that loops or executes a task runs on the scheduler, like a spawned task:
+on a copy of the variables taken when the main thread gets to it, with its output kept until it's joined, when its
+stores are copied back. The main thread goes on with the next statements meanwhile, and joins the statements it
+deferred always from the oldest, so the output and the stores come in the order of the program.
+A statement must see the stores of the statements before it: before running, or deferring, a statement, the main
+thread joins the deferred statements that may store a variable it reads. Run there, it joins also those that may store
+a variable it stores, which they'd overwrite when joined, and all of them if it prints, since its output would come first.
+A statement that spawns or waits joins them all, and so does an error, which comes after their output.
+What each statement may read and store is found once, before running, from the variables named in it
+and in the tasks it may execute, at any depth. It's the same whatever branch is taken, so it costs nothing at run time. */
+
+#define MAX_DEFERRED 64 // the oldest is joined before deferring another
+
+typedef struct TopStatement {
+    int64_t start;
+    int64_t end;    // the token after it
+    int64_t reads;  // in Parallel.names, read_count of them
+    int64_t writes;
+    int read_count;
+    int write_count;
+    bool prints;
+    bool barrier;   // spawns or waits
+    bool heavy;     // loops or executes a task, so it's worth a thread
+} TopStatement;
+
+DECLARE_ARR(TopStatementArr, TopStatement)
+DECLARE_ARR(IntArr, int)
+
+// The names and the tasks used by some statements, not their closure
+typedef struct Uses {
+    IntArr reads;
+    IntArr writes;
+    IntArr calls;
+    bool prints;
+    bool barrier;
+    bool heavy;
+} Uses;
+
+struct Parallel {
+    TopStatementArr statements;
+    IntArr names;
+    int64_t next;         // the first statement that isn't before the cursor
+    int64_t *deferred_by; // by name, the last statement deferred that may store it, counting from 1
+    int64_t deferred;     // statements deferred so far
+    int64_t joined;       // the first ones of them: the others are in parser.deferred
+};
+
+static int64_t statement_end(int64_t cursor);
+static void scan_uses(Uses *uses, int64_t cursor, int64_t end);
+static void add_closure(Parallel *par, TopStatement *stmt, Uses *uses, Uses *task_uses, int64_t *marks);
+static void free_uses(Uses *uses);
+
+bool run_parallel = false;
+
+/* NULL if --parallel isn't on, or with a step limit, since the steps must be taken in the order of the program,
+or with a snapshot, which is taken between two statements run one after the other */
+Parallel *find_parallel(void)
+{
+    if (!run_parallel || parser.snapshot_line > 0 || (parser.budget != NULL && parser.budget->max_steps > 0)) return NULL;
+
+    int64_t size = parser.token_arr.size;
+    Token *t = parser.token_arr.data;
+    int names = parser.program->names.size;
+
+    Parallel *par = reallocate(NULL, sizeof(Parallel));
+    *par = (Parallel){0};
+    Uses *task_uses = GROW_ARRAY(Uses, NULL, names + 1);
+    memset(task_uses, 0, sizeof(Uses) * (names + 1));
+
+    // A task declared again may run either body
+    for (int64_t cursor = 0; cursor < size; )
+    {
+        int64_t end = statement_end(cursor);
+        if (t[cursor].type == TOK_TASK) scan_uses(&task_uses[t[cursor].name], cursor + 2, end - 1);
+        TopStatement stmt = { .start = cursor, .end = end };
+        ARR_PUSH(&par->statements, stmt, TopStatement);
+        cursor = end;
+    }
+
+    // Where each task, read and store was found last, by name
+    int64_t *marks = GROW_ARRAY(int64_t, NULL, 3 * (names + 1));
+    memset(marks, 0, sizeof(int64_t) * 3 * (names + 1));
+
+    for (int64_t i = 0; i < par->statements.size; i++)
+    {
+        TopStatement *stmt = &par->statements.data[i];
+        if (t[stmt->start].type == TOK_TASK) continue; // only declares it
+
+        Uses uses = {0};
+        scan_uses(&uses, stmt->start, stmt->end);
+        stmt->heavy = uses.heavy;
+        add_closure(par, stmt, &uses, task_uses, marks);
+        free_uses(&uses);
+    }
+
+    for (int i = 0; i < names; i++) free_uses(&task_uses[i]);
+    FREE_ARRAY(task_uses);
+    FREE_ARRAY(marks);
+
+    par->deferred_by = GROW_ARRAY(int64_t, NULL, names + 1);
+    memset(par->deferred_by, 0, sizeof(int64_t) * (names + 1));
+    return par;
+}
+
+// The token after the top-level statement at 'cursor', the 'else' of an 'if' included; the program was verified
+static int64_t statement_end(int64_t cursor)
+{
+    int64_t size = parser.token_arr.size;
+    Token *t = parser.token_arr.data;
+    int depth = 0;
+
+    while (cursor < size)
+    {
+        TokType type = t[cursor++].type;
+        if (type == TOK_OBRACE) {
+            depth++;
+        } else if (type == TOK_CBRACE && --depth == 0) {
+            if (cursor < size && t[cursor].type == TOK_ELSE) continue;
+            return cursor;
+        } else if (type == TOK_SEMICOLON && depth == 0) {
+            return cursor;
+        }
+    }
+    return cursor;
+}
+
+static void scan_uses(Uses *uses, int64_t cursor, int64_t end)
+{
+    Token *t = parser.token_arr.data;
+
+    for (; cursor < end; cursor++)
+    {
+        switch (t[cursor].type)
+        {
+        case TOK_VAR:
+        {
+            TokType before = cursor > 0 ? t[cursor - 1].type : TOK_SEMICOLON;
+            bool at_statement = before == TOK_SEMICOLON || before == TOK_OBRACE || before == TOK_CBRACE;
+            if (at_statement) ARR_PUSH(&uses->writes, t[cursor].name, int);
+            // An element is stored in the array that's there
+            if (!at_statement || t[cursor + 1].type != TOK_ASSIGN) ARR_PUSH(&uses->reads, t[cursor].name, int);
+            break;
+        }
+        case TOK_EXEC_TASK:
+            uses->heavy = true;
+            ARR_PUSH(&uses->calls, t[cursor + 1].name, int);
+            cursor++;
+            break;
+        case TOK_WHILE:
+            uses->heavy = true;
+            break;
+        case TOK_PRINT:
+            uses->prints = true;
+            break;
+        case TOK_SPAWN:
+        case TOK_WAIT:
+            uses->barrier = true;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// The uses of the statement and of the tasks it may execute, at any depth, are added to it
+static void add_closure(Parallel *par, TopStatement *stmt, Uses *uses, Uses *task_uses, int64_t *marks)
+{
+    int names = parser.program->names.size;
+    int64_t *called = marks, *read = marks + names + 1, *written = marks + 2 * (names + 1);
+    int64_t mark = stmt->start + 1;
+
+    for (int64_t i = 0; i < uses->calls.size; i++)
+    {
+        int task = uses->calls.data[i];
+        if (called[task] == mark) continue;
+        called[task] = mark;
+
+        Uses *callee = &task_uses[task];
+        for (int64_t j = 0; j < callee->reads.size; j++) ARR_PUSH(&uses->reads, callee->reads.data[j], int);
+        for (int64_t j = 0; j < callee->writes.size; j++) ARR_PUSH(&uses->writes, callee->writes.data[j], int);
+        for (int64_t j = 0; j < callee->calls.size; j++) ARR_PUSH(&uses->calls, callee->calls.data[j], int);
+        uses->prints |= callee->prints;
+        uses->barrier |= callee->barrier;
+    }
+
+    stmt->prints = uses->prints;
+    stmt->barrier = uses->barrier;
+    stmt->reads = par->names.size;
+    for (int64_t i = 0; i < uses->reads.size; i++)
+    {
+        int name = uses->reads.data[i];
+        if (read[name] == mark) continue;
+        read[name] = mark;
+        ARR_PUSH(&par->names, name, int);
+        stmt->read_count++;
+    }
+    stmt->writes = par->names.size;
+    for (int64_t i = 0; i < uses->writes.size; i++)
+    {
+        int name = uses->writes.data[i];
+        if (written[name] == mark) continue;
+        written[name] = mark;
+        ARR_PUSH(&par->names, name, int);
+        stmt->write_count++;
+    }
+}
+
+static void free_uses(Uses *uses)
+{
+    ARR_FREE(&uses->reads);
+    ARR_FREE(&uses->writes);
+    ARR_FREE(&uses->calls);
+}
+
+/* On the main thread, at the top-level statement at the cursor: joins the statements it depends on,
+then defers it if it's heavy. Returns true if it's deferred, with the cursor after it. */
+bool defer_statement(void)
+{
+    Parallel *par = parser.parallel;
+    while (par->next < par->statements.size && par->statements.data[par->next].start < parser.cursor) par->next++;
+    if (par->next == par->statements.size || par->statements.data[par->next].start != parser.cursor) return false;
+
+    TopStatement *stmt = &par->statements.data[par->next];
+    int *names = par->names.data;
+    bool deferring = stmt->heavy && !stmt->barrier;
+
+    int64_t until = par->joined; // the statements joined, once it can run
+    if (stmt->barrier || (stmt->prints && !deferring)) {
+        until = par->deferred;
+    } else {
+        for (int i = 0; i < stmt->read_count; i++) {
+            if (par->deferred_by[names[stmt->reads + i]] > until) until = par->deferred_by[names[stmt->reads + i]];
+        }
+        for (int i = 0; i < stmt->write_count && !deferring; i++) {
+            if (par->deferred_by[names[stmt->writes + i]] > until) until = par->deferred_by[names[stmt->writes + i]];
+        }
+        if (deferring && par->deferred - until >= MAX_DEFERRED) until = par->deferred - MAX_DEFERRED + 1;
+    }
+    join_deferred(until - par->joined);
+    if (!deferring) return false;
+
+    Spawned *spawned = new_spawned(stmt->start, -1);
+    spawned->stop = stmt->end;
+    ARR_PUSH(&parser.deferred, spawned, SpawnedPtr);
+    par->deferred++;
+    for (int i = 0; i < stmt->write_count; i++) {
+        par->deferred_by[names[stmt->writes + i]] = par->deferred;
+    }
+    spawned->work = spawn_work(run_spawned, spawned);
+
+    // Its tokens are counted where it runs
+    parser.cursor = stmt->end;
+    parser.token = parser.cursor < parser.token_arr.size ? parser.token_arr.data[parser.cursor] : (Token){0};
+    return true;
+}
+
+void join_deferred(int64_t count)
+{
+    if (count <= 0) return;
+    parser.parallel->joined += count;
+    join_first(&parser.deferred, count);
+}
+
+void free_parallel(Parallel *par)
+{
+    if (par == NULL) return;
+    ARR_FREE(&par->statements);
+    ARR_FREE(&par->names);
+    FREE_ARRAY(par->deferred_by);
+    reallocate(par, 0);
+}
@@ -0,0 +1,17 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "tokenizer.h"
+
+/* --parallel runs the top-level statements that loop or execute a task on the scheduler, while the next ones go on,
+as long as these don't read what they store (see parallel.c). The output is the same. */
+extern bool run_parallel;
+
+typedef struct Parallel Parallel; // parser.parallel, the top-level statements and what they read and store
+
+Parallel *find_parallel(void); // NULL if the statements run one after the other
+bool defer_statement(void);
+void join_deferred(int64_t count); // the oldest count of parser.deferred
+void free_parallel(Parallel *par);
+
+#endif // PARALLEL_H
@@ -1,47 +1,39 @@
+#define _GNU_SOURCE // fopencookie()
+
 #include "parser.h"
+#include "runtime.h"
 #include "utils.h"
 #include "tokenizer.h"
+#include "array.h"
+#include "scheduler.h"
+#include "trace.h"
+#include "verifier.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+
+
+#define STEP_CHUNK 1024
 
-#define GLOBAL_SCOPE 0
-
-#define ERR_MSG_SIZE 256
-
-typedef struct Parser {
-    int cursor;
-    int scope;
-    Token token;
-    TokenArr token_arr;
-} Parser;
-
-typedef struct Variable {
-    char *name_addr;
-    int name_len;
-    float value;
-} Variable;
-
-typedef struct Task {
-    char *name_addr;
-    int name_len;
-    int proc_start;
-} Task;
-
-typedef enum OpFamily {
-    GROUPING,
-    ARITHMETIC,
-    COMPARISON,
-    LOGICAL,
-} OpFamily;
-
-typedef struct Op {
-    OpFamily family;
-    int prec;
-    TokType tok_type;
-} Op;
-
-/* There are 5 different precedence levels. 
-Don't confuse them with OpFamily! 
-Operators of the same family, might have a different precedence; e.g. '+' and '*'. */
-#define MAX_PREC 6
+#define NAME_TEXT(name) (&parser.program->text[parser.program->names.data[name].start])
+#define NAME_LEN(name) (parser.program->names.data[name].len)
+
+/* Superinstructions: statements and conditions of the most common shapes run without the expression parser.
+They are found once, before running, and run fused only on integers; on anything else they run as usual. */
+typedef enum Shape {
+    SHAPE_NONE,
+    SHAPE_INCREMENT, // 'v = v + 1;' or 'v = v - 1;', by an integer literal
+    SHAPE_COPY,      // 'v = w;'
+    SHAPE_COMPARE,   // 'while v < w {' or 'if v < 1 {', any comparison against a variable or an integer literal
+} Shape;
+
+// What ends an expression
+typedef enum ExprEnd {
+    END_STATEMENT, // ';'
+    END_CONDITION, // '{'
+    END_ELEMENT,   // ',' or ']', of an array or an index
+    END_ARGUMENT,  // ',' or ')', of a builtin
+} ExprEnd;
 
 Op OpTable[] = 
 {
@@ -62,52 +54,125 @@ Op OpTable[] =
     {0,          0,            0         }  // NULL (terminator)
 };
 
-DECLARE_ARR(VarArr, Variable)
-DECLARE_ARR(TaskArr, Task)
-
 DECLARE_ARR(OpStack, Op)
-DECLARE_ARR(NumStack, float)
+DECLARE_ARR(DoubleArr, double)
 
 static void advance(void);
 static void consume(TokType type, char *err_msg);
-static void jump(Token token, int cursor, int scope);
-static bool reached_eoe(bool is_condition);
+static bool reached_eoe(ExprEnd end, int prec_lvl);
+static bool at_eoe(ExprEnd end, int prec_lvl);
 static bool reached_eob(void);
 static bool reached_eof(void);
 static void report_error(char *err_msg);
-
+static void fail(void);
+static void report_over_budget(void);
+
+static void execute(void);
+static void take_snapshot(void);
+static void end_frame(Frame frame);
+static void push_frame(FrameKind kind, int64_t return_to, int scope, int task);
+static bool in_tail_position(void);
 static void parse_block(bool branched);
 static void parse_task(void);
 static void parse_if(bool branched);
+static void parse_else(bool branched);
 static void parse_while(bool branched);
 static void exec_task(bool branched);
 static void parse_variable(bool branched);
 static void parse_print(bool branched);
-
-static int parse_expression(bool branched, bool is_condition);
-static float lookup_variable(char *name_addr, int name_len);
-static Op get_op_from_OpTable(TokType tok_type);
-static void perform_arithmetic_op(NumStack *numbers, TokType tok_type);
-static void perform_comparison_op(NumStack *numbers, TokType tok_type);
+static void parse_element_store(Token name, bool branched);
+static bool parse_condition(bool branched);
+static uint8_t *find_shapes(void);
+static void skip_tokens(int n);
+static bool run_increment(void);
+static bool run_copy(void);
+static bool run_compare(bool *res);
+static void add_cost(void);
+static void parse_spawn(bool branched);
+static void parse_wait(bool branched);
+static bool verify_run(void);
+static RunResult run_tokens(void);
+static void join_spawned(void);
+static void discard_spawned(void);
+static void free_spawned(Spawned *spawned);
+static ssize_t write_spawned(void *cookie, const char *buffer, size_t size);
+
+static Value parse_expression(bool branched, ExprEnd end);
+static Value parse_operand(bool branched);
+static Value parse_array(bool branched);
+static Value parse_builtin(bool branched);
+static Value parse_index(Value val, bool branched);
+static int check_index(Value val, Value index);
+static void skip_operand(int op_prec, int *prec_lvl, ExprEnd end);
+static Value lookup_variable(Token token);
 static void perform_logical_op(NumStack *numbers, TokType tok_type);
 static Op OpStack_top(OpStack operators);
+static Value NumStack_pop(NumStack *numbers, char *err_msg);
+static void check_lengths(Value l_val, Value r_val);
+
+// Each thread runs its own tasks
+_Thread_local Parser parser;
 
-Parser parser;
+int max_task_depth = DEFAULT_MAX_TASK_DEPTH;
+bool count_cost = false;
+bool strict_parens = false;
 
-VarArr variables;
-TaskArr tasks;
+static Cost total_cost;
+static pthread_mutex_t total_cost_lock = PTHREAD_MUTEX_INITIALIZER;
 
-void init_parser(TokenArr token_arr)
+_Thread_local VarArr variables;
+_Thread_local TaskArr tasks;
+
+void init_parser(Program *program)
 {
     parser.cursor = -1;
     parser.scope = 0;
     parser.token = (Token){0};
-    parser.token_arr = token_arr;
+    parser.token_arr = program->tokens;
+    parser.program = program;
+    parser.out = stdout;
+    parser.on_error = NULL;
+    ARR_INIT(&parser.spawned);
+    ARR_INIT(&parser.deferred);
+    parser.running = NULL;
+    parser.parallel = NULL;
+    parser.stop = -1;
+    ARR_INIT(&parser.frames);
+    parser.task_depth = 0;
+    parser.budget = NULL;
+    parser.steps_left = INT64_MAX;
+    parser.shapes = NULL;
+    parser.memo = NULL;
+    parser.tier = NULL;
+    parser.snapshot_line = 0;
+    parser.cost = (Cost){0};
+
+    int names = program->names.size;
+    variables.data = GROW_ARRAY(Variable, NULL, names + 1);
+    variables.size = variables.cap = names;
+    memset(variables.data, 0, sizeof(Variable) * (names + 1));
+    tasks.data = GROW_ARRAY(Task, NULL, names + 1);
+    tasks.size = tasks.cap = names;
+    memset(tasks.data, 0, sizeof(Task) * (names + 1));
+
     advance();
 }
 
+void free_parser(void)
+{
+    ARR_FREE(&parser.spawned);
+    ARR_FREE(&parser.deferred);
+    ARR_FREE(&parser.frames);
+    for (int i = 0; i < variables.size; i++) {
+        release_value(variables.data[i].value);
+    }
+    ARR_FREE(&variables);
+    ARR_FREE(&tasks);
+}
+
 static void advance(void) 
 {
+    COUNT(tokens);
     parser.cursor++;
     if (parser.cursor < parser.token_arr.size) {
         parser.token = parser.token_arr.data[parser.cursor];
@@ -124,28 +189,49 @@ static void consume(TokType type, char *err_msg) {
     }
 }
 
-static void jump(Token token, int cursor, int scope) 
+void jump(int64_t cursor, int scope) 
 {
-    parser.token = token;
-    parser.cursor = cursor;
+    parser.cursor = cursor - 1;
+    advance();
     parser.scope = scope;
 }
 
 // eoe: end of expression
-static bool reached_eoe(bool is_condition) 
+static bool reached_eoe(ExprEnd end, int prec_lvl) 
 {
-    if (is_condition) {
-        if (parser.token.type == TOK_OBRACE || reached_eof()) {
-            consume(TOK_OBRACE, "expected '{'");
-            return true;
-        }
-    } else {
-        if (parser.token.type == TOK_SEMICOLON || reached_eof()) {
-            consume(TOK_SEMICOLON, "expected ';'");
-            return true;
-        }
-    } 
-    return false; 
+    if (!at_eoe(end, prec_lvl)) return false;
+
+    // e.g. '3 * (4 + 5) + (6 + 7;', which runs as if it were closed
+    if (prec_lvl > 0 && strict_parens) {
+        report_error("expected ')'");
+    }
+
+    // ',', ']' and ')' are consumed by who knows which one it expects
+    if (end == END_CONDITION) {
+        consume(TOK_OBRACE, "expected '{'");
+    } else if (end == END_STATEMENT) {
+        consume(TOK_SEMICOLON, "expected ';'");
+    }
+    return true;
+}
+
+static bool at_eoe(ExprEnd end, int prec_lvl)
+{
+    if (reached_eof()) return true;
+
+    switch (end)
+    {
+    case END_STATEMENT:
+        return parser.token.type == TOK_SEMICOLON;
+    case END_CONDITION:
+        return parser.token.type == TOK_OBRACE;
+    case END_ELEMENT:
+        return parser.token.type == TOK_COMMA || parser.token.type == TOK_CBRACKET;
+    case END_ARGUMENT:
+        // The parenthesis opened inside the argument are closed first
+        return parser.token.type == TOK_COMMA || (parser.token.type == TOK_CPAREN && prec_lvl == 0);
+    }
+    return false;
 }
 
 // eob: end of block
@@ -166,17 +252,285 @@ static bool reached_eof(void) {
 
 static void report_error(char *err_msg) 
 {    
-    printf("Line %d: %s.\n", parser.token.line, err_msg);
-    exit(EXIT_FAILURE);
+    // The statements deferred before it run before it, so their output comes first
+    if (parser.deferred.size > 0) join_deferred(parser.deferred.size);
+    fprintf(parser.out, "Line %d: %s.\n", parser.token.line, err_msg);
+    fail();
 }
 
-void parse_tokens(void)
+/* An error never exits the process, so that the server survives it.
+The error of a spawned task is reported by the 'wait' that joins it. */
+static void fail(void)
 {
-    ARR_INIT(&variables);
-    while (!reached_eof())
-    {        
-        parse_block(true);
+    assert(parser.on_error != NULL);
+    longjmp(*parser.on_error, 1);
+}
+
+static void report_over_budget(void)
+{
+    report_error("memory limit exceeded");
+}
+
+// The errors, or the budget running out, are printed to parser.out
+RunResult parse_tokens(void)
+{
+    if (!verify_run()) return RUN_ERROR;
+    return run_tokens();
+}
+
+/* The program is verified on a parser of its own, with what's declared so far:
+the variables set before the run, or those of a snapshot. */
+static bool verify_run(void)
+{
+    int names = parser.program->names.size;
+    bool *declared = GROW_ARRAY(bool, NULL, names + 1);
+    for (int i = 0; i < names; i++) {
+        declared[i] = variables.data[i].declared || tasks.data[i].declared;
+    }
+
+    Parser s_parser = parser;
+    VarArr s_variables = variables;
+    TaskArr s_tasks = tasks;
+
+    bool ok = verify_program(parser.program, declared, parser.out);
+
+    parser = s_parser;
+    variables = s_variables;
+    tasks = s_tasks;
+    FREE_ARRAY(declared);
+    return ok;
+}
+
+static RunResult run_tokens(void)
+{
+    jmp_buf on_error;
+    parser.on_error = &on_error;
+    void (*s_over_budget)(void) = over_budget;
+    over_budget = report_over_budget;
+    parser.shapes = find_shapes();
+    parser.memo = find_pure_tasks();
+    parser.parallel = find_parallel();
+
+    bool ok = setjmp(on_error) == 0;
+    if (ok) {
+        execute();
+        join_deferred(parser.deferred.size);
+        join_spawned();
+    } else {
+        discard_spawned();
+    }
+
+    parser.on_error = NULL;
+    over_budget = s_over_budget;
+    FREE_ARRAY(parser.shapes);
+    parser.shapes = NULL;
+    free_pure_tasks(parser.memo);
+    parser.memo = NULL;
+    free_tier(parser.tier);
+    parser.tier = NULL;
+    free_parallel(parser.parallel);
+    parser.parallel = NULL;
+    add_cost();
+
+    if (ok) return RUN_OK;
+    return parser.budget != NULL && parser.budget->exhausted ? RUN_OUT_OF_BUDGET : RUN_ERROR;
+}
+
+void set_parser_output(FILE *out)
+{
+    parser.out = out;
+}
+
+void init_exec_budget(ExecBudget *budget, ExecLimits limits)
+{
+    budget->steps_taken = 0;
+    budget->max_steps = limits.max_steps;
+    budget->exhausted = false;
+    budget->has_deadline = limits.max_millis > 0;
+    if (budget->has_deadline) {
+        clock_gettime(CLOCK_MONOTONIC, &budget->deadline);
+        budget->deadline.tv_sec += limits.max_millis / 1000;
+        budget->deadline.tv_nsec += (limits.max_millis % 1000) * 1000000;
+        if (budget->deadline.tv_nsec >= 1000000000) {
+            budget->deadline.tv_sec++;
+            budget->deadline.tv_nsec -= 1000000000;
+        }
+    }
+}
+
+void set_exec_budget(ExecBudget *budget)
+{
+    parser.budget = budget;
+    parser.steps_left = budget != NULL ? 0 : INT64_MAX;
+}
+
+/* Executes statements until the end of the program, or the end of the task of a frame with return_to -1.
+Statements that aren't executed are parsed by the functions parse_*(false), recursively,
+but that's only as deep as they are nested in the source code. */
+static void execute(void)
+{
+    while (1)
+    {
+        bool at_end = parser.token.type == TOK_CBRACE || reached_eof();
+        if (!at_end || parser.frames.size == 0)
+        {
+            if (parser.snapshot_line > 0 && parser.frames.size == 0 && (reached_eof() || parser.token.line > parser.snapshot_line)) {
+                take_snapshot();
+            }
+            if (reached_eof() || (parser.frames.size == 0 && parser.cursor == parser.stop)) return;
+            if (parser.parallel != NULL && parser.frames.size == 0 && defer_statement()) continue;
+            parse_block(true);
+            continue;
+        }
+
+        Frame frame = parser.frames.data[parser.frames.size - 1];
+        if (frame.kind == FRAME_TASK) {
+            TRACE3(task__exit, parser.token.line, NAME_TEXT(frame.task), NAME_LEN(frame.task));
+        }
+        reached_eob(); // consume '}'
+        end_frame(frame);
+        if (frame.kind == FRAME_TASK && frame.return_to == -1) return;
+    }
+}
+
+/* Between two top-level statements, the state of the run is the variables, the tasks and the cursor.
+The scope is always the global one, and the tasks spawned must have been waited for. */
+static void take_snapshot(void)
+{
+    parser.snapshot_line = 0;
+
+    if (parser.spawned.size > 0) {
+        report_error("a snapshot can't be taken before a 'wait' for the tasks spawned");
+    }
+    if (!parser.save_snapshot()) {
+        report_error("unable to write the snapshot");
+    }
+}
+
+void set_snapshot_line(int line, bool (*save)(void))
+{
+    parser.snapshot_line = line;
+    parser.save_snapshot = save;
+}
+
+static void end_frame(Frame frame)
+{
+    switch (frame.kind)
+    {
+    case FRAME_TASK:
+        ARR_POP(&parser.frames);
+        parser.task_depth--;
+        if (frame.memo_task != -1) remember_task(parser.memo[frame.memo_task], frame.memo_slot);
+        if (frame.return_to != -1) jump(frame.return_to, frame.scope);
+        break;
+    case FRAME_IF:
+        ARR_POP(&parser.frames);
+        parse_else(false);
+        break;
+    case FRAME_ELSE:
+        ARR_POP(&parser.frames);
+        break;
+    case FRAME_WHILE:
+    {
+        // Once hot, the loop goes on compiled, from this back edge
+        Region *region = count_region(frame.return_to - 1, REGION_LOOP);
+        if (region != NULL) {
+            ARR_POP(&parser.frames);
+            run_loop_region(region, true, frame.scope - 1);
+            break;
+        }
+
+        jump(frame.return_to, frame.scope);
+        take_step();
+        if (!parse_condition(true)) {
+            ARR_POP(&parser.frames);
+            while (!reached_eob()) {
+                parse_block(false);
+            }
+        } else {
+            COUNT(iterations);
+            TRACE1(while__iteration, parser.token_arr.data[frame.return_to].line);
+        }
+        break;
+    }
+    }
+}
+
+void take_steps(void)
+{
+    ExecBudget *budget = parser.budget;
+    char err_buffer[ERR_MSG_SIZE];
+
+    if (budget->has_deadline) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > budget->deadline.tv_sec
+            || (now.tv_sec == budget->deadline.tv_sec && now.tv_nsec >= budget->deadline.tv_nsec))
+        {
+            budget->exhausted = true;
+            snprintf(err_buffer, ERR_MSG_SIZE, "time limit exceeded, after %" PRId64 " steps",
+                     atomic_load(&budget->steps_taken));
+            report_error(err_buffer);
+        }
+    }
+
+    int64_t taken = atomic_fetch_add(&budget->steps_taken, STEP_CHUNK);
+    int64_t chunk = STEP_CHUNK;
+    if (budget->max_steps > 0 && taken + chunk > budget->max_steps) {
+        chunk = budget->max_steps - taken;
+        if (chunk <= 0) {
+            budget->exhausted = true;
+            snprintf(err_buffer, ERR_MSG_SIZE, "step limit exceeded, after %" PRId64 " steps", budget->max_steps);
+            report_error(err_buffer);
+        }
+    }
+    parser.steps_left = chunk - 1; // with this step
+}
+
+static void push_frame(FrameKind kind, int64_t return_to, int scope, int task)
+{
+    if (kind == FRAME_TASK) parser.task_depth++;
+
+    Frame frame = { kind, return_to, scope, task, -1, -1 };
+    ARR_PUSH(&parser.frames, frame, Frame);
+}
+
+/* After an 'exec', whether the task ends without doing anything else:
+only the ends of the 'if' and 'else' blocks inside it come before its '}'. */
+static bool in_tail_position(void)
+{
+    int64_t cursor = parser.cursor;
+    Token *tokens = parser.token_arr.data;
+
+    for (int i = parser.frames.size - 1; i >= 0; i--)
+    {
+        if (cursor >= parser.token_arr.size || tokens[cursor].type != TOK_CBRACE) return false;
+        cursor++;
+
+        switch (parser.frames.data[i].kind)
+        {
+        case FRAME_TASK:
+            return true;
+        case FRAME_WHILE:
+            return false;
+        case FRAME_ELSE:
+            break;
+        case FRAME_IF:
+            // Skip the 'else', its braces are balanced since the task was checked when declared
+            if (cursor < parser.token_arr.size && tokens[cursor].type == TOK_ELSE) {
+                int depth = 0;
+                cursor++;
+                do {
+                    if (tokens[cursor].type == TOK_OBRACE) depth++;
+                    else if (tokens[cursor].type == TOK_CBRACE) depth--;
+                    cursor++;
+                } while (depth > 0);
+            }
+            break;
+        }
     }
+
+    return false;
 }
 
 static void parse_block(bool branched)
@@ -201,8 +555,14 @@ static void parse_block(bool branched)
     case TOK_PRINT:
         parse_print(branched);
         break;
+    case TOK_SPAWN:
+        parse_spawn(branched);
+        break;
+    case TOK_WAIT:
+        parse_wait(branched);
+        break;
     default:
-        assert("Unreachable" && false);
+        report_error("expected a statement");
         break;
     }
 }
@@ -210,22 +570,20 @@ static void parse_block(bool branched)
 // This function is executed just at the first parsing of a task
 static void parse_task(void)
 {
-    Task task;
-    task.name_addr = parser.token.start;
-    task.name_len = parser.token.len;
+    Token name = parser.token;
     advance(); // consume the task name
 
     consume(TOK_OBRACE, "expected '{' after task name");
 
     if (parser.scope > GLOBAL_SCOPE) {
         char err_buffer[ERR_MSG_SIZE];
-        snprintf(err_buffer, ERR_MSG_SIZE, "task '%.*s' declared in local scope", task.name_len, task.name_addr);
+        snprintf(err_buffer, ERR_MSG_SIZE, "task '%.*s' declared in local scope", name.len, TOKEN_TEXT(parser.program, name));
         report_error(err_buffer);
     }
 
-    task.proc_start = parser.cursor;
-
-    ARR_PUSH(&tasks, task, Task);
+    // A task declared again replaces the previous one
+    tasks.data[name.name].declared = true;
+    tasks.data[name.name].proc_start = parser.cursor;
 
     // Parse the body in search of semantic errors.
     parser.scope++;
@@ -234,58 +592,74 @@ static void parse_task(void)
     }
 }
 
+// Executed, a block pushes its frame and leaves the rest to execute()
 static void parse_if(bool branched)
 {
     parser.scope++;
     advance();
 
-    float expr_res = parse_expression(branched, true);
+    bool expr_res = parse_condition(branched);
+
+    if (branched && expr_res) {
+        push_frame(FRAME_IF, -1, 0, -1);
+        return;
+    }
     
     while (!reached_eob())
     {
-        parse_block(branched && expr_res);
+        parse_block(false);
     }
 
-    // Optional else
-    if (match("else", parser.token.start, parser.token.len))
-    {
-        parser.scope++;
-        advance();
-        
-        consume(TOK_OBRACE, "expected '{' after 'else'");
-        while (!reached_eob())
-        {
-            parse_block(branched && !expr_res);
-        }
-    }
+    parse_else(branched);
 }
 
-static void parse_while(bool branched)
+// Optional else, executed if branched
+static void parse_else(bool branched)
 {
+    if (parser.token.type != TOK_ELSE) return;
+
     parser.scope++;
     advance();
+    
+    consume(TOK_OBRACE, "expected '{' after 'else'");
 
-    bool parsed_once = false;
+    if (branched) {
+        push_frame(FRAME_ELSE, -1, 0, -1);
+        return;
+    }
 
-    while (1)
+    while (!reached_eob())
     {
-        Token s_token = parser.token;
-        int s_cursor = parser.cursor;
-        int s_scope = parser.scope;
+        parse_block(false);
+    }
+}
 
-        float expr_res = parse_expression(branched, true);
+static void parse_while(bool branched)
+{
+    Region *region = branched ? hot_region(parser.cursor) : NULL;
+    if (region != NULL) {
+        run_loop_region(region, false, parser.scope);
+        return;
+    }
 
-        while (!reached_eob())
-        {
-            parse_block(branched && expr_res);
-        }
+    parser.scope++;
+    advance();
 
-        parsed_once = true;
+    int64_t s_cursor = parser.cursor;
+    int s_scope = parser.scope;
 
-        if (!branched) break;
-        
-        if (!expr_res && parsed_once) break;
-        else jump(s_token, s_cursor, s_scope);
+    bool expr_res = parse_condition(branched);
+
+    if (branched && expr_res) {
+        COUNT(iterations);
+        TRACE1(while__iteration, parser.token_arr.data[s_cursor].line);
+        push_frame(FRAME_WHILE, s_cursor, s_scope, -1);
+        return;
+    }
+
+    while (!reached_eob())
+    {
+        parse_block(false);
     }
 }
 
@@ -294,177 +668,693 @@ static void exec_task(bool branched)
     advance(); // consume 'exec'
 
     // Get the task name
-    char *task_name_addr = parser.token.start;
-    int task_name_len = parser.token.len;
-
-    // Once it is verified that the request is semantically correct (or, seen from another perspective,
-    // once it is verified that what the user meant is to execute a task),
-    // search for the requested task.
-    bool task_exists = false;
-    int task_idx = -1;
-
-    for (int i = 0; i < tasks.size; i++) {
-        if (task_name_len == tasks.data[i].name_len && 
-            strncmp(tasks.data[i].name_addr, task_name_addr, task_name_len) == 0
-        ) {
-            task_exists = true;
-            task_idx = i;
-        }
-    }
+    Token name = parser.token;
 
-    if (branched && !task_exists) {
-        char err_buffer[ERR_MSG_SIZE];
-        snprintf(err_buffer, ERR_MSG_SIZE, "task '%.*s' doesn't exists", task_name_len, task_name_addr);
-        report_error(err_buffer);
-    }
+    // The verifier checked that the task is declared wherever this runs
+    int task_idx = name.name;
 
+    int64_t name_cursor = parser.cursor;
+    if (branched) take_step();
     advance(); // consume proc name
     consume(TOK_SEMICOLON, "expected ';' after procedure name");
 
-    // Save the current state of execution
-    Token s_token = parser.token;
-    int s_cursor = parser.cursor;
-    int s_scope = parser.scope;
+    if (!branched) return;
+    COUNT(calls);
 
-    if (branched) 
-    {
-        parser.cursor = tasks.data[task_idx].proc_start;
-        parser.token = parser.token_arr.data[parser.cursor];
-        parser.scope = 0; // Because a task can be only at the global scope
+    // Once hot, the task runs compiled, without a frame: it executes no other task
+    Region *region = count_region(tasks.data[task_idx].proc_start - 1, REGION_TASK);
 
-        while (!reached_eob()) 
-        {
-            parse_block(branched);
+    // A tail call takes the place of the task it ends, so tail recursion runs in constant memory
+    if (in_tail_position()) {
+        if (region != NULL) {
+            run_task_region(region, name);
+            return;
+        }
+        while (parser.frames.data[parser.frames.size - 1].kind != FRAME_TASK) {
+            ARR_POP(&parser.frames);
+        }
+        Frame *frame = &parser.frames.data[parser.frames.size - 1];
+        TRACE3(task__exit, name.line, NAME_TEXT(frame->task), NAME_LEN(frame->task));
+        frame->task = task_idx;
+    } else if (parser.task_depth == max_task_depth) {
+        char err_buffer[ERR_MSG_SIZE];
+        snprintf(err_buffer, ERR_MSG_SIZE, "too many nested 'exec' (the limit is %d)", max_task_depth);
+        jump(name_cursor, parser.scope); // the error is on the line of the 'exec'
+        report_error(err_buffer);
+    } else {
+        // A pure task run before on the same inputs isn't run again
+        PureTask *pure = parser.memo != NULL ? parser.memo[task_idx] : NULL;
+        int slot = -1;
+        if (pure != NULL && recall_task(pure, &slot)) return;
+
+        if (region != NULL) {
+            run_task_region(region, name);
+            if (slot != -1) remember_task(pure, slot);
+            return;
+        }
+        push_frame(FRAME_TASK, parser.cursor, parser.scope, task_idx);
+        if (slot != -1) {
+            parser.frames.data[parser.frames.size - 1].memo_task = task_idx;
+            parser.frames.data[parser.frames.size - 1].memo_slot = slot;
         }
-
-        jump(s_token, s_cursor, s_scope);
     }
+    TRACE3(task__enter, name.line, TOKEN_TEXT(parser.program, name), name.len);
+
+    jump(tasks.data[task_idx].proc_start, 0); // Because a task can be only at the global scope
 }
 
 static void parse_variable(bool branched)
 {
-    // Create the var struct case
-    Variable var;
-    var.name_addr = parser.token.start;
-    var.name_len = parser.token.len;
-
-    bool is_new = true;
-    int var_index = -1;
-    for (int i = 0; i < variables.size; i++) {
-        if (var.name_len == variables.data[i].name_len &&
-            strncmp(variables.data[i].name_addr, var.name_addr, var.name_len) == 0) 
-        {
-            is_new = false;
-            var_index = i;   
-        }
+    if (branched && parser.shapes != NULL) {
+        if (parser.shapes[parser.cursor] == SHAPE_INCREMENT && run_increment()) return;
+        if (parser.shapes[parser.cursor] == SHAPE_COPY && run_copy()) return;
     }
 
+    Token name = parser.token;
+    Variable *var = &variables.data[name.name];
+
     advance(); // consume the variable name
-    
-    if (branched && is_new && parser.scope > GLOBAL_SCOPE) {
-        char err_buffer[ERR_MSG_SIZE];
-        snprintf(err_buffer, ERR_MSG_SIZE, "variable '%.*s' declared in local scope", var.name_len, var.name_addr);
-        report_error(err_buffer);
+
+    if (parser.token.type == TOK_OBRACKET) {
+        parse_element_store(name, branched);
+        return;
     }
 
+    // A new variable in a local scope was rejected by the verifier
+
     consume(TOK_ASSIGN, "expected '=' after variable name");
-    float expr_res = parse_expression(branched, false);
+    Value expr_res = parse_expression(branched, END_STATEMENT);
     
     // If the branch in which this variable is located, is executed, so assign the value to it.
+    // The temporaries of the optimizer hold a subexpression, so its value is kept as it is.
     if (branched) {
-        if (is_new) {
-            var.value = expr_res;
-            ARR_PUSH(&variables, var, Variable);
-        } else {
-            variables.data[var_index].value = expr_res;
-        }
+        COUNT(stores);
+        release_value(var->value);
+        var->declared = true;
+        var->written = true;
+        var->value = TOKEN_TEXT(parser.program, name)[0] == '$' ? expr_res : value_result(expr_res);
+        TRACE3(var__store, name.line, TOKEN_TEXT(parser.program, name), name.len);
     }
 }
 
 static void parse_print(bool branched)
 {
+    if (branched) TRACE1(print, parser.token.line);
     advance();
 
-    float expr_res = parse_expression(branched, false);
+    Value expr_res = parse_expression(branched, END_STATEMENT);
 
     if (branched) {
-        printf("%f\n", expr_res);
+        print_value(parser.out, value_result(expr_res));
+        release_value(expr_res);
+        check_output();
     }
 }
 
-/*
- *
- *  Parse expression
- */
-
-static int parse_expression(bool branched, bool is_condition)
+// 'name[index] = expr;' stores a single element
+static void parse_element_store(Token name, bool branched)
 {
-    OpStack operators;
-    ARR_INIT(&operators);
-    NumStack numbers;
-    ARR_INIT(&numbers);
+    advance(); // consume '['
+    Value index = parse_expression(branched, END_ELEMENT);
+    consume(TOK_CBRACKET, "expected ']' after the index");
 
-    float expr_res = 0;
-    int prec_lvl = 0;
+    // Checked before the value, so the error is reported on this line
+    Value *val = &variables.data[name.name].value;
+    int i = 0;
+    if (branched) {
+        i = check_index(*val, index);
+    }
 
-    while (!reached_eoe(is_condition))
-    {        
-        // Current token, syntactic sugar
-        Token token = parser.token;
+    consume(TOK_ASSIGN, "expected '=' after the array element");
+    Value expr_res = value_result(parse_expression(branched, END_STATEMENT));
 
-        if (token.type == TOK_NUMBER) 
-        {
-            char tok_literal[token.len+1];
-            snprintf(tok_literal, token.len+1, "%.*s", token.len, token.start);
-            ARR_PUSH(&numbers, atoi(tok_literal), float);
-            advance(); // TODO find solution to remove advance() from here
-            continue;
-        }
+    if (!branched) return;
 
-        if (token.type == TOK_VAR) 
-        {
-            float var_value = branched ? lookup_variable(token.start, token.len) : 0.0f;
-            ARR_PUSH(&numbers, var_value, float);
-            advance(); // TODO find solution to remove advance() from here
-            continue;
-        }
+    if (expr_res.type == VAL_ARRAY) {
+        report_error("an array element must be a number");
+    }
 
-        Op new_op = get_op_from_OpTable(token.type);
-        if (new_op.prec == 0) { // The NULL Op
-            char err_buffer[ERR_MSG_SIZE];
-            snprintf(err_buffer, ERR_MSG_SIZE, "expected an operator or terminating symbol '%c', but got '%.*s' instead", (is_condition ? '{' : ';'), token.len, token.start);
-            report_error(err_buffer);
-        }
+    // A shared array is copied, the other variables keep the old elements
+    if (val->arr->refs > 1) {
+        Array *copy = new_array(val->arr->len);
+        memcpy(copy->data, val->arr->data, sizeof(double) * val->arr->len);
+        release_value(*val);
+        *val = ARRAY_VALUE(copy);
+    }
+    val->arr->data[i] = value_as_double(expr_res);
+    variables.data[name.name].written = true;
+    COUNT(stores);
+    TRACE3(var__store, name.line, TOKEN_TEXT(parser.program, name), name.len);
+}
 
-        if (new_op.tok_type == TOK_OPAREN) {
-            prec_lvl++;
-            advance(); // TODO find solution to remove advance() from here
-            continue;
-        }
+static void parse_spawn(bool branched)
+{
+    advance(); // consume 'spawn'
 
-        if (new_op.tok_type == TOK_CPAREN) {
-            prec_lvl--;
-            advance(); // TODO find solution to remove advance() from here
-            continue;
-        }
-        
-        new_op.prec += MAX_PREC * prec_lvl;
+    Token name = parser.token;
+    int task_idx = name.name; // declared, as verified
 
-        Op top_op = OpStack_top(operators);
+    advance(); // consume the task name
+    consume(TOK_SEMICOLON, "expected ';' after task name");
 
-        // Explanation of the Stack-based precedence parsing [From 7:40]: 
-        // https://youtu.be/c2nR3Ua4CFI?si=G-YMsmXbP65WApAh&t=460
-        while (!ARR_IS_EMPTY(&operators) && top_op.prec >= new_op.prec)
-        {
-            switch (top_op.family)
-            {
-            case ARITHMETIC:
-                perform_arithmetic_op(&numbers, top_op.tok_type);
-                break;
+    if (!branched) return;
+    COUNT(calls);
+
+    Spawned *spawned = new_spawned(tasks.data[task_idx].proc_start, task_idx);
+    ARR_PUSH(&parser.spawned, spawned, SpawnedPtr);
+    spawned->work = spawn_work(run_spawned, spawned);
+}
+
+static void parse_wait(bool branched)
+{
+    advance(); // consume 'wait'
+    consume(TOK_SEMICOLON, "expected ';' after 'wait'");
+
+    if (branched) join_spawned();
+}
+
+// Runs from 'start' on a copy of the variables and the tasks, once spawn_work() is called on it
+Spawned *new_spawned(int64_t start, int task)
+{
+    Spawned *spawned = reallocate(NULL, sizeof(Spawned));
+    *spawned = (Spawned){0};
+    spawned->program = parser.program;
+    spawned->proc_start = start;
+    spawned->task = task;
+    spawned->stop = -1;
+    spawned->budget = mem_budget;
+    spawned->exec_budget = parser.budget;
+    spawned->shapes = parser.shapes;
+
+    int names = variables.size;
+    spawned->variables.data = GROW_ARRAY(Variable, NULL, names + 1);
+    spawned->variables.size = spawned->variables.cap = names;
+    memcpy(spawned->variables.data, variables.data, sizeof(Variable) * (names + 1));
+    for (int i = 0; i < names; i++) {
+        spawned->variables.data[i].written = false;
+        retain_value(spawned->variables.data[i].value);
+    }
+
+    spawned->tasks.data = GROW_ARRAY(Task, NULL, names + 1);
+    spawned->tasks.size = spawned->tasks.cap = names;
+    memcpy(spawned->tasks.data, tasks.data, sizeof(Task) * (names + 1));
+    return spawned;
+}
+
+// Runs on any thread of the scheduler, even one that is in the middle of another task, waiting
+void run_spawned(void *arg)
+{
+    Spawned *spawned = arg;
+
+    Parser s_parser = parser;
+    VarArr s_variables = variables;
+    TaskArr s_tasks = tasks;
+    MemBudget *s_mem_budget = mem_budget;
+    void (*s_over_budget)(void) = over_budget;
+
+    jmp_buf on_error;
+    parser.program = spawned->program;
+    parser.token_arr = spawned->program->tokens;
+    parser.cursor = spawned->proc_start;
+    parser.token = parser.token_arr.data[parser.cursor];
+    parser.scope = 0; // Because a task can be only at the global scope
+    parser.out = fopencookie(spawned, "w", (cookie_io_functions_t){ .write = write_spawned });
+    parser.on_error = &on_error;
+    ARR_INIT(&parser.spawned);
+    ARR_INIT(&parser.deferred);
+    parser.running = spawned;
+    parser.parallel = NULL;
+    parser.stop = spawned->stop;
+    ARR_INIT(&parser.frames);
+    parser.task_depth = 0;
+    set_exec_budget(spawned->exec_budget);
+    parser.shapes = spawned->shapes;
+    parser.memo = NULL; // the caches belong to the thread of the run
+    parser.tier = NULL;
+    parser.snapshot_line = 0;
+    parser.cost = (Cost){0};
+    variables = spawned->variables;
+    tasks = spawned->tasks;
+    mem_budget = spawned->budget;
+    over_budget = report_over_budget;
+
+    if (parser.out == NULL) {
+        // Its error can't be printed
+        spawned->failed = true;
+    } else if (setjmp(on_error) == 0) {
+        if (spawned->task != -1) {
+            push_frame(FRAME_TASK, -1, 0, spawned->task);
+            TRACE3(task__enter, parser.token.line, NAME_TEXT(spawned->task), NAME_LEN(spawned->task));
+        }
+        execute();
+        join_spawned();
+        fflush(parser.out);
+        check_output();
+    } else {
+        spawned->failed = true;
+        discard_spawned();
+    }
+
+    if (parser.out != NULL) fclose(parser.out);
+    ARR_FREE(&parser.spawned);
+    ARR_FREE(&parser.deferred);
+    ARR_FREE(&parser.frames);
+    free_tier(parser.tier);
+    add_cost();
+
+    parser = s_parser;
+    variables = s_variables;
+    tasks = s_tasks;
+    mem_budget = s_mem_budget;
+    over_budget = s_over_budget;
+}
+
+// 'wait': the spawned tasks are joined in the order they were spawned
+static void join_spawned(void)
+{
+    join_first(&parser.spawned, parser.spawned.size);
+}
+
+// Joins the first 'count' of the list, in order, and removes them from it
+void join_first(SpawnedArr *list, int64_t count)
+{
+    for (int64_t i = 0; i < count; i++)
+    {
+        Spawned *spawned = list->data[i];
+        wait_work(spawned->work);
+
+        fwrite(spawned->output, 1, spawned->output_len, parser.out);
+        check_output();
+
+        if (spawned->failed) {
+            // The tasks spawned after it are discarded by whoever handles the failure
+            free_spawned(spawned);
+            int64_t left = list->size - i - 1;
+            if (left > 0) memmove(list->data, &list->data[i + 1], sizeof(SpawnedPtr) * left);
+            list->size = left;
+            fail();
+        }
+
+        for (int j = 0; j < variables.size; j++) {
+            Variable *var = &spawned->variables.data[j];
+            if (!var->written) continue;
+            release_value(variables.data[j].value);
+            variables.data[j] = *var;
+            var->value = INT_VALUE(0); // moved
+        }
+
+        free_spawned(spawned);
+    }
+
+    // Nothing left: the list may have never been allocated, and memmove() doesn't take NULL
+    if (list->size > count) memmove(list->data, &list->data[count], sizeof(SpawnedPtr) * (list->size - count));
+    list->size -= count;
+}
+
+// Their output and their stores are dropped, and so are those of the statements deferred
+static void discard_spawned(void)
+{
+    for (int i = 0; i < parser.spawned.size; i++) {
+        wait_work(parser.spawned.data[i]->work);
+        free_spawned(parser.spawned.data[i]);
+    }
+    parser.spawned.size = 0;
+    for (int i = 0; i < parser.deferred.size; i++) {
+        wait_work(parser.deferred.data[i]->work);
+        free_spawned(parser.deferred.data[i]);
+    }
+    parser.deferred.size = 0;
+}
+
+static void free_spawned(Spawned *spawned)
+{
+    for (int i = 0; i < spawned->variables.size; i++) {
+        release_value(spawned->variables.data[i].value);
+    }
+    ARR_FREE(&spawned->variables);
+    ARR_FREE(&spawned->tasks);
+    if (spawned->budget != NULL) atomic_fetch_sub(&spawned->budget->used, spawned->output_cap);
+    free(spawned->output);
+    reallocate(spawned, 0);
+}
+
+/* Grows the output like reallocate(), but going over the budget can't jump out of stdio:
+the output is dropped instead, until check_output() reports it */
+static ssize_t write_spawned(void *cookie, const char *buffer, size_t size)
+{
+    Spawned *spawned = cookie;
+    if (spawned->output_state == OUTPUT_DROPPED) return size;
+
+    if (spawned->output_len + size > spawned->output_cap) {
+        size_t cap = GROW_CAPACITY(spawned->output_cap);
+        if (cap < spawned->output_len + size) cap = spawned->output_len + size;
+        int64_t grow = cap - spawned->output_cap;
+        MemBudget *budget = spawned->budget;
+        if (spawned->output_state == OUTPUT_KEPT && budget != NULL && atomic_load(&budget->used) + grow > budget->limit) {
+            spawned->output_state = OUTPUT_DROPPED;
+            return size;
+        }
+
+        char *output = realloc(spawned->output, cap);
+        if (output == NULL) return -1;
+        if (budget != NULL) atomic_fetch_add(&budget->used, grow);
+        spawned->output = output;
+        spawned->output_cap = cap;
+    }
+
+    memcpy(&spawned->output[spawned->output_len], buffer, size);
+    spawned->output_len += size;
+    return size;
+}
+
+void check_output(void)
+{
+    Spawned *spawned = parser.running;
+    if (spawned == NULL || spawned->output_state != OUTPUT_DROPPED) return;
+    spawned->output_len = 0;
+    spawned->output_state = OUTPUT_ERROR;
+    report_over_budget();
+}
+
+/* Runs the program from the start, with some variables already set, in a state of its own:
+it can run on any thread of the scheduler, even one in the middle of another run, like run_spawned().
+The program is only read, so the runs can share it. It isn't verified here, but once by the caller. */
+RunResult run_with_defines(Program *program, const Define *defines, int count, FILE *out, ExecBudget *budget)
+{
+    Parser s_parser = parser;
+    VarArr s_variables = variables;
+    TaskArr s_tasks = tasks;
+
+    init_parser(program);
+    set_parser_output(out);
+    set_exec_budget(budget);
+    for (int i = 0; i < count; i++) {
+        Variable *var = &variables.data[defines[i].name];
+        release_value(var->value);
+        var->declared = true;
+        var->value = value_result(defines[i].value);
+        retain_value(var->value);
+    }
+
+    RunResult result = run_tokens();
+    free_parser();
+
+    parser = s_parser;
+    variables = s_variables;
+    tasks = s_tasks;
+    return result;
+}
+
+/* Parses the top-level statement starting at the token 'cursor', without executing it.
+Returns the index of the token after it, or -1 if it has an error, which is printed.
+It's used to check again only the statements touched by an edit. */
+int64_t check_statement(int64_t cursor)
+{
+    jmp_buf on_error;
+    jmp_buf *s_on_error = parser.on_error;
+    parser.on_error = &on_error;
+
+    parser.cursor = cursor - 1;
+    parser.scope = GLOBAL_SCOPE;
+    advance();
+
+    int64_t next = -1;
+    if (setjmp(on_error) == 0) {
+        parse_block(false);
+        next = parser.cursor;
+    }
+
+    parser.on_error = s_on_error;
+    return next;
+}
+
+static bool parse_condition(bool branched)
+{
+    bool res;
+    if (branched && parser.shapes != NULL && parser.shapes[parser.cursor] == SHAPE_COMPARE && run_compare(&res)) {
+        return res;
+    }
+
+    Value expr_res = value_result(parse_expression(branched, END_CONDITION));
+    res = value_is_true(expr_res);
+    release_value(expr_res);
+    return res;
+}
+
+/*
+ *
+ *  Superinstructions
+ */
+
+// NULL if they are off: with --float every value is truncated, and $JIS_FUSE=0 compares them with the usual path
+static uint8_t *find_shapes(void)
+{
+    char *env = getenv("JIS_FUSE");
+    if (numeric_model != NUM_TAGGED || (env != NULL && strcmp(env, "0") == 0)) return NULL;
+
+    int64_t size = parser.token_arr.size;
+    Token *t = parser.token_arr.data;
+    uint8_t *shapes = GROW_ARRAY(uint8_t, NULL, size + 1);
+    memset(shapes, SHAPE_NONE, size + 1);
+
+    for (int64_t i = 0; i + 3 < size; i++)
+    {
+        if (t[i].type != TOK_VAR) continue;
+
+        bool at_statement = i == 0 || t[i - 1].type == TOK_SEMICOLON || t[i - 1].type == TOK_OBRACE || t[i - 1].type == TOK_CBRACE;
+        bool at_condition = i > 0 && (t[i - 1].type == TOK_WHILE || t[i - 1].type == TOK_IF);
+
+        if (at_statement && t[i + 1].type == TOK_ASSIGN)
+        {
+            if (i + 5 < size && t[i + 2].type == TOK_VAR && t[i + 2].name == t[i].name
+                && (t[i + 3].type == TOK_PLUS || t[i + 3].type == TOK_MINUS)
+                && t[i + 4].type == TOK_NUMBER && t[i + 4].value.type == VAL_INT
+                && t[i + 5].type == TOK_SEMICOLON)
+            {
+                shapes[i] = SHAPE_INCREMENT;
+            }
+            else if (t[i + 2].type == TOK_VAR && t[i + 3].type == TOK_SEMICOLON)
+            {
+                shapes[i] = SHAPE_COPY;
+            }
+        }
+        else if (at_condition && t[i + 1].type >= TOK_LT && t[i + 1].type <= TOK_NE
+                 && (t[i + 2].type == TOK_VAR || (t[i + 2].type == TOK_NUMBER && t[i + 2].value.type == VAL_INT))
+                 && t[i + 3].type == TOK_OBRACE)
+        {
+            shapes[i] = SHAPE_COMPARE;
+        }
+    }
+
+    return shapes;
+}
+
+static void skip_tokens(int n)
+{
+    parser.cursor += n - 1;
+    advance();
+}
+
+static bool run_increment(void)
+{
+    Token *t = &parser.token_arr.data[parser.cursor];
+    Variable *var = &variables.data[t[0].name];
+    if (var->value.type != VAL_INT) return false;
+
+    int64_t res;
+    bool overflow = t[3].type == TOK_PLUS
+        ? __builtin_add_overflow(var->value.i, t[4].value.i, &res)
+        : __builtin_sub_overflow(var->value.i, t[4].value.i, &res);
+    if (overflow) return false; // becomes a double
+
+    var->value.i = res;
+    var->written = true;
+    TRACE3(var__store, t[0].line, TOKEN_TEXT(parser.program, t[0]), t[0].len);
+    COUNT(expressions);
+    COUNT(loads);
+    COUNT(arithmetic);
+    COUNT(stores);
+    skip_tokens(6);
+    return true;
+}
+
+static bool run_copy(void)
+{
+    Token *t = &parser.token_arr.data[parser.cursor];
+    Variable *dst = &variables.data[t[0].name];
+    Variable *src = &variables.data[t[2].name];
+
+    // The verifier let a new one only at the top level
+    Value val = src->value;
+    retain_value(val);
+    release_value(dst->value);
+    dst->value = val;
+    dst->declared = true;
+    dst->written = true;
+    TRACE3(var__store, t[0].line, TOKEN_TEXT(parser.program, t[0]), t[0].len);
+    COUNT(expressions);
+    COUNT(loads);
+    COUNT(stores);
+    skip_tokens(4);
+    return true;
+}
+
+// Consumes the '{' too, like parse_condition()
+static bool run_compare(bool *res)
+{
+    Token *t = &parser.token_arr.data[parser.cursor];
+    Variable *var = &variables.data[t[0].name];
+    Value r_val = t[2].value;
+    if (t[2].type == TOK_VAR) r_val = variables.data[t[2].name].value;
+    if (var->value.type != VAL_INT || r_val.type != VAL_INT) return false;
+
+    int64_t l_num = var->value.i, r_num = r_val.i;
+    switch (t[1].type)
+    {
+    case TOK_LT: *res = l_num < r_num; break;
+    case TOK_GT: *res = l_num > r_num; break;
+    case TOK_LE: *res = l_num <= r_num; break;
+    case TOK_GE: *res = l_num >= r_num; break;
+    case TOK_EQ: *res = l_num == r_num; break;
+    case TOK_NE: *res = l_num != r_num; break;
+    default:
+        assert("Unreachable" && false);
+        break;
+    }
+
+    COUNT(expressions);
+    COUNT(loads);
+    if (t[2].type == TOK_VAR) COUNT(loads);
+    COUNT(comparison);
+    skip_tokens(4);
+    return true;
+}
+
+/*
+ *
+ *  Cost
+ */
+
+// The run or the spawned task ends: its counts are added to the total
+static void add_cost(void)
+{
+    if (!count_cost) return;
+
+    pthread_mutex_lock(&total_cost_lock);
+    total_cost.tokens += parser.cost.tokens;
+    total_cost.expressions += parser.cost.expressions;
+    total_cost.arithmetic += parser.cost.arithmetic;
+    total_cost.comparison += parser.cost.comparison;
+    total_cost.logical += parser.cost.logical;
+    total_cost.loads += parser.cost.loads;
+    total_cost.stores += parser.cost.stores;
+    total_cost.calls += parser.cost.calls;
+    total_cost.iterations += parser.cost.iterations;
+    pthread_mutex_unlock(&total_cost_lock);
+
+    parser.cost = (Cost){0};
+}
+
+void print_cost(FILE *out)
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"tokens\": %" PRId64 ",\n", total_cost.tokens);
+    fprintf(out, "  \"expressions\": %" PRId64 ",\n", total_cost.expressions);
+    fprintf(out, "  \"operators\": {\"arithmetic\": %" PRId64 ", \"comparison\": %" PRId64 ", \"logical\": %" PRId64 "},\n",
+            total_cost.arithmetic, total_cost.comparison, total_cost.logical);
+    fprintf(out, "  \"loads\": %" PRId64 ",\n", total_cost.loads);
+    fprintf(out, "  \"stores\": %" PRId64 ",\n", total_cost.stores);
+    fprintf(out, "  \"calls\": %" PRId64 ",\n", total_cost.calls);
+    fprintf(out, "  \"iterations\": %" PRId64 "\n", total_cost.iterations);
+    fprintf(out, "}\n");
+}
+
+/*
+ *
+ *  Parse expression
+ */
+
+static Value parse_expression(bool branched, ExprEnd end)
+{
+    OpStack operators;
+    ARR_INIT(&operators);
+    NumStack numbers;
+    ARR_INIT(&numbers);
+
+    Value expr_res = INT_VALUE(0);
+    int prec_lvl = 0;
+    bool after_operand = false;
+    if (branched) COUNT(expressions);
+
+    while (!reached_eoe(end, prec_lvl))
+    {        
+        // Current token, syntactic sugar
+        Token token = parser.token;
+
+        bool operand = token.type == TOK_NUMBER || token.type == TOK_VAR || token.type == TOK_OBRACKET || (token.type >= TOK_SUM && token.type <= TOK_FILL);
+        // Two operands in a row, e.g. 'a = b c;': reported on the second one, so that it's the line shown
+        if (operand && after_operand) {
+            report_error("expected an operator");
+        }
+        if (operand) after_operand = true;
+
+        if (token.type == TOK_NUMBER) 
+        {
+            ARR_PUSH(&numbers, token.value, Value);
+            advance(); // TODO find solution to remove advance() from here
+            continue;
+        }
+
+        if (operand) 
+        {
+            ARR_PUSH(&numbers, parse_operand(branched), Value);
+            continue;
+        }
+
+        Op new_op = get_op_from_OpTable(token.type);
+        if (new_op.prec == 0) { // The NULL Op
+            static const char terminators[] = {';', '{', ']', ')'};
+            char err_buffer[ERR_MSG_SIZE];
+            snprintf(err_buffer, ERR_MSG_SIZE, "expected an operator or terminating symbol '%c', but got '%.*s' instead", terminators[end], token.len, TOKEN_TEXT(parser.program, token));
+            report_error(err_buffer);
+        }
+
+        if (new_op.tok_type == TOK_OPAREN) {
+            prec_lvl++;
+            advance(); // TODO find solution to remove advance() from here
+            continue;
+        }
+
+        if (new_op.tok_type == TOK_CPAREN) {
+            if (prec_lvl == 0 && strict_parens) {
+                report_error("unexpected ')', no '(' to close");
+            }
+            after_operand = true; // ')' closes an operand
+            prec_lvl--;
+            advance(); // TODO find solution to remove advance() from here
+            continue;
+        }
+        
+        new_op.prec += MAX_PREC * prec_lvl;
+
+        Op top_op = OpStack_top(operators);
+
+        // Explanation of the Stack-based precedence parsing [From 7:40]: 
+        // https://youtu.be/c2nR3Ua4CFI?si=G-YMsmXbP65WApAh&t=460
+        while (!ARR_IS_EMPTY(&operators) && top_op.prec >= new_op.prec)
+        {
+            switch (top_op.family)
+            {
+            case ARITHMETIC:
+                if (branched) COUNT(arithmetic);
+                perform_arithmetic_op(&numbers, top_op.tok_type);
+                break;
             case COMPARISON:
+                if (branched) COUNT(comparison);
                 perform_comparison_op(&numbers, top_op.tok_type);
                 break;
             case LOGICAL:
+                if (branched) COUNT(logical);
                 perform_logical_op(&numbers, top_op.tok_type);
                 break;
             default:
@@ -476,14 +1366,34 @@ static int parse_expression(bool branched, bool is_condition)
             top_op = OpStack_top(operators);
         }
 
+        /* Short-circuit: the operators with an higher precedence have been performed,
+        so the top of the stack is the left-hand side of the logical operator.
+        If it already decides the result, the right-hand side isn't evaluated at all. */
+        if (branched && new_op.family == LOGICAL && !ARR_IS_EMPTY(&numbers))
+        {
+            bool lhs = value_is_true(numbers.data[numbers.size - 1]);
+            if ((new_op.tok_type == TOK_AND && !lhs) || (new_op.tok_type == TOK_OR && lhs))
+            {
+                // The result of a logical operation is either 0 or 1
+                COUNT(logical);
+                release_value(numbers.data[numbers.size - 1]);
+                ARR_POP(&numbers);
+                ARR_PUSH(&numbers, value_from_bool(lhs), Value);
+                advance(); // consume '&&' or '||'
+                skip_operand(new_op.prec, &prec_lvl, end);
+                after_operand = true;
+                continue;
+            }
+        }
+
         ARR_PUSH(&operators, new_op, Op);
+        after_operand = false;
 
         advance();
     } // while()
 
-    /* if prec_lvl != 0, therefore some open paren doesn't have the corresponding closing paren
-    e.g. '3 * (4 + 5) + (6 + 7', no error is reported, because for how the expression parsing works,
-    they are not needed. */
+    /* If prec_lvl != 0, some paren isn't closed, or was never opened, e.g. '3 * (4 + 5) + (6 + 7':
+    for how the expression parsing works, they are not needed, so only --check reports them (see strict_parens) */
 
     // Perform remaining operations in order of apparence
     while (!ARR_IS_EMPTY(&operators))
@@ -492,12 +1402,15 @@ static int parse_expression(bool branched, bool is_condition)
         switch (op.family)
         {
         case ARITHMETIC:
+            if (branched) COUNT(arithmetic);
             perform_arithmetic_op(&numbers, op.tok_type);
             break;
         case COMPARISON:
+            if (branched) COUNT(comparison);
             perform_comparison_op(&numbers, op.tok_type);
             break;
         case LOGICAL:
+            if (branched) COUNT(logical);
             perform_logical_op(&numbers, op.tok_type);
             break;
         default:
@@ -508,12 +1421,13 @@ static int parse_expression(bool branched, bool is_condition)
         ARR_POP(&operators);
     }
 
-    expr_res = ARR_TOP(&numbers);
-    ARR_POP(&numbers);
+    if (!ARR_IS_EMPTY(&numbers)) {
+        expr_res = numbers.data[numbers.size - 1];
+        ARR_POP(&numbers);
+    }
 
-    // Assert that the stacks are empty
-    assert(operators.size == 0);
     assert(numbers.size == 0);
+    assert(operators.size == 0);
     
     ARR_FREE(&operators);
     ARR_FREE(&numbers);
@@ -521,142 +1435,424 @@ static int parse_expression(bool branched, bool is_condition)
     return expr_res;
 }
 
-static Op get_op_from_OpTable(TokType tok_type)
+/* Skip the right-hand side of an operator with precedence op_prec:
+it ends at the first operator that would perform it (same or lower precedence), or at the end of the expression.
+Parenthesis are tracked, because they change the precedence of what follows them, even if unclosed.
+Arrays, indices and builtins are parsed without being executed. */
+static void skip_operand(int op_prec, int *prec_lvl, ExprEnd end)
 {
-    for (size_t i = 0; OpTable[i].prec != 0; i++) {
-        if (OpTable[i].tok_type == tok_type) {
-            return OpTable[i];
-        }
-    }
+    while (!at_eoe(end, *prec_lvl))
+    {
+        Token token = parser.token;
 
-    return (Op){0, 0, 0};
-}
+        if (token.type == TOK_NUMBER || token.type == TOK_VAR || token.type == TOK_OBRACKET || (token.type >= TOK_SUM && token.type <= TOK_FILL)) {
+            parse_operand(false);
+            continue;
+        }
 
-static void perform_arithmetic_op(NumStack *numbers, TokType tok_type)
-{
-    if (ARR_IS_EMPTY(numbers)) {
-        report_error("expected right-hand side number to perform arithmetic operation");
-    }
+        Op op = get_op_from_OpTable(token.type);
+        if (op.prec == 0) return; // The NULL Op, reported by parse_expression()
 
-    float r_num = ARR_TOP(numbers);
-    ARR_POP(numbers);
+        if (op.tok_type == TOK_OPAREN) (*prec_lvl)++;
+        else if (op.tok_type == TOK_CPAREN) (*prec_lvl)--;
+        else if (op.prec + MAX_PREC * *prec_lvl <= op_prec) return;
 
-    if (ARR_IS_EMPTY(numbers)) {
-        report_error("expected left-hand side number to perform arithmetic operation");
+        advance();
     }
+}
 
-    float l_num = ARR_TOP(numbers);
-    ARR_POP(numbers);
+/* An operand followed by any number of indices: a number, a variable, an array or a builtin.
+If branched is false, it's only parsed and 0 is returned. */
+static Value parse_operand(bool branched)
+{
+    Token token = parser.token;
+    Value val;
 
-    float res;
-    switch (tok_type)
+    switch (token.type)
     {
-    case TOK_PLUS: 
-        res = l_num + r_num; 
+    case TOK_NUMBER:
+        val = token.value;
+        advance();
         break;
-    case TOK_MINUS: 
-        res = l_num - r_num; 
+    case TOK_VAR:
+        val = branched ? lookup_variable(token) : INT_VALUE(0);
+        advance();
         break;
-    case TOK_STAR: 
-        res = l_num * r_num; 
+    case TOK_OBRACKET:
+        val = parse_array(branched);
         break;
-    case TOK_SLASH: 
-        res = l_num / r_num; 
-        break; 
     default:
-        assert("Unreachable" && false);
+        val = parse_builtin(branched);
         break;
-    }   
+    }
+
+    while (parser.token.type == TOK_OBRACKET) {
+        val = parse_index(val, branched);
+    }
 
-    ARR_PUSH(numbers, res, float);
+    return val;
 }
 
-static void perform_comparison_op(NumStack *numbers, TokType tok_type)
+// '[1, 2, 3]'
+static Value parse_array(bool branched)
 {
-    if (ARR_IS_EMPTY(numbers)) {
-        report_error("expected right-hand side number to perform comparison operation");
+    advance(); // consume '['
+
+    DoubleArr elements;
+    ARR_INIT(&elements);
+
+    if (parser.token.type == TOK_CBRACKET) {
+        advance(); // the empty array
+    } else {
+        while (1)
+        {
+            Value element = parse_expression(branched, END_ELEMENT);
+            if (element.type == VAL_ARRAY) {
+                report_error("an array element must be a number");
+            }
+            ARR_PUSH(&elements, value_as_double(value_result(element)), double);
+
+            if (parser.token.type != TOK_COMMA) break;
+            advance();
+        }
+        consume(TOK_CBRACKET, "expected ']' after the array elements");
     }
 
-    float r_num = ARR_TOP(numbers);
-    ARR_POP(numbers);
+    Value val = INT_VALUE(0);
+    if (branched) {
+        Array *arr = new_array(elements.size);
+        if (elements.size > 0) {
+            memcpy(arr->data, elements.data, sizeof(double) * elements.size);
+        }
+        val = ARRAY_VALUE(arr);
+    }
 
-    if (ARR_IS_EMPTY(numbers)) {
-        report_error("expected left-hand side number to perform comparison operation");
+    ARR_FREE(&elements);
+    return val;
+}
+
+// 'sum(a)', 'min(a)', 'max(a)', 'len(a)', 'fill(length, value)'
+static Value parse_builtin(bool branched)
+{
+    Token name = parser.token;
+    advance(); // consume the name, the tokenizer has seen the '('
+    advance(); // consume '('
+
+    Value args[2];
+    int args_count = 0;
+    int expected = name.type == TOK_FILL ? 2 : 1;
+
+    if (parser.token.type != TOK_CPAREN) {
+        while (1)
+        {
+            Value arg = parse_expression(branched, END_ARGUMENT);
+            if (args_count < expected) args[args_count] = arg;
+            else release_value(arg);
+            args_count++;
+
+            if (parser.token.type != TOK_COMMA) break;
+            advance();
+        }
     }
+    consume(TOK_CPAREN, "expected ')' after the arguments");
 
-    float l_num = ARR_TOP(numbers);
-    ARR_POP(numbers);
+    char err_buffer[ERR_MSG_SIZE];
+    if (args_count != expected) {
+        snprintf(err_buffer, ERR_MSG_SIZE, "'%.*s' takes %d argument%s, but got %d", name.len, TOKEN_TEXT(parser.program, name), expected, expected > 1 ? "s" : "", args_count);
+        report_error(err_buffer);
+    }
 
-    float res = 0;
-    switch (tok_type)
+    if (!branched) return INT_VALUE(0);
+
+    if (name.type == TOK_FILL)
     {
-    case TOK_LT:
-        res = l_num < r_num;
-        break;
-    case TOK_GT: 
-        res = l_num > r_num;
-        break;
-    case TOK_LE:
-        res = l_num <= r_num;
-        break;
-    case TOK_GE:
-        res = l_num >= r_num;
-        break;
-    case TOK_EQ:
-        res = l_num == r_num;
-        break;
-    case TOK_NE:
-        res = l_num != r_num;
-        break;
+        Value len = value_result(args[0]);
+        Value fill = value_result(args[1]);
+        double n = len.type == VAL_ARRAY ? -1 : value_as_double(len);
+        if (!(n >= 0 && n <= INT32_MAX / (int)sizeof(double)) || n != (int)n) {
+            report_error("the length of 'fill' must be a whole number, not negative and not too big");
+        }
+        if (fill.type == VAL_ARRAY) {
+            report_error("an array element must be a number");
+        }
+
+        Array *arr = new_array((int)n);
+        for (int i = 0; i < arr->len; i++) {
+            arr->data[i] = value_as_double(fill);
+        }
+        return ARRAY_VALUE(arr);
+    }
+
+    Value arg = args[0];
+    if (arg.type != VAL_ARRAY) {
+        snprintf(err_buffer, ERR_MSG_SIZE, "'%.*s' expects an array", name.len, TOKEN_TEXT(parser.program, name));
+        report_error(err_buffer);
+    }
+    if ((name.type == TOK_MIN || name.type == TOK_MAX) && arg.arr->len == 0) {
+        snprintf(err_buffer, ERR_MSG_SIZE, "'%.*s' of an empty array", name.len, TOKEN_TEXT(parser.program, name));
+        report_error(err_buffer);
+    }
+
+    Value res;
+    switch (name.type)
+    {
+    case TOK_SUM: res = DOUBLE_VALUE(array_sum(arg.arr)); break;
+    case TOK_MIN: res = DOUBLE_VALUE(array_min(arg.arr)); break;
+    case TOK_MAX: res = DOUBLE_VALUE(array_max(arg.arr)); break;
+    case TOK_LEN: res = INT_VALUE(arg.arr->len); break;
     default:
         assert("Unreachable" && false);
+        res = INT_VALUE(0);
         break;
     }
 
-    ARR_PUSH(numbers, res, float);
+    release_value(arg);
+    return res;
 }
 
-static void perform_logical_op(NumStack *numbers, TokType tok_type)
+// 'val[index]', val is consumed
+static Value parse_index(Value val, bool branched)
 {
-    if (ARR_IS_EMPTY(numbers)) {
-        report_error("expected right-hand side number to perform logical operation");
+    advance(); // consume '['
+    Value index = parse_expression(branched, END_ELEMENT);
+    consume(TOK_CBRACKET, "expected ']' after the index");
+
+    if (!branched) return INT_VALUE(0);
+
+    int i = check_index(val, index);
+    Value element = DOUBLE_VALUE(val.arr->data[i]);
+    release_value(val);
+    return element;
+}
+
+static int check_index(Value val, Value index)
+{
+    if (val.type != VAL_ARRAY) {
+        report_error("only an array can be indexed");
     }
 
-    float r_num = ARR_TOP(numbers);
-    ARR_POP(numbers);
+    index = value_result(index);
+    if (index.type == VAL_ARRAY) {
+        report_error("an index must be a number");
+    }
 
-    if (ARR_IS_EMPTY(numbers)) {
-        report_error("expected left-hand side number to perform logical operation");
+    double i = value_as_double(index);
+    if (!(i >= 0 && i < val.arr->len) || i != (int)i) {
+        char err_buffer[ERR_MSG_SIZE];
+        snprintf(err_buffer, ERR_MSG_SIZE, "index %g out of range for an array of length %d", i, val.arr->len);
+        report_error(err_buffer);
     }
 
-    float l_num = ARR_TOP(numbers);
-    ARR_POP(numbers);
+    return (int)i;
+}
 
-    float res = 0;
-    if (tok_type == TOK_AND) res = l_num && r_num;
-    else if (tok_type == TOK_OR) res = l_num || r_num;
-    else assert("Unreachable" && false);
+Op get_op_from_OpTable(TokType tok_type)
+{
+    for (size_t i = 0; OpTable[i].prec != 0; i++) {
+        if (OpTable[i].tok_type == tok_type) {
+            return OpTable[i];
+        }
+    }
 
-    ARR_PUSH(numbers, res, float);
+    return (Op){0, 0, 0};
 }
 
-// ARR_TOP is not usable because data of OpStack is a struct
-static Op OpStack_top(OpStack operators) {
-    return operators.size > 0 ? operators.data[operators.size - 1] : (Op){0};
+void perform_arithmetic_op(NumStack *numbers, TokType tok_type)
+{
+    Value r_val = NumStack_pop(numbers, "expected right-hand side number to perform arithmetic operation");
+    Value l_val = NumStack_pop(numbers, "expected left-hand side number to perform arithmetic operation");
+
+    if (l_val.type == VAL_ARRAY || r_val.type == VAL_ARRAY) {
+        check_lengths(l_val, r_val);
+        ARR_PUSH(numbers, array_arithmetic(tok_type, l_val, r_val), Value);
+        return;
+    }
+
+    Value res;
+
+    // Fast path: integers stay integers, unless the result overflows or isn't whole
+    if (l_val.type == VAL_INT && r_val.type == VAL_INT && numeric_model == NUM_TAGGED)
+    {
+        int64_t l_num = l_val.i, r_num = r_val.i, n;
+        bool exact = false;
+        switch (tok_type)
+        {
+        case TOK_PLUS:
+            exact = !__builtin_add_overflow(l_num, r_num, &n);
+            break;
+        case TOK_MINUS:
+            exact = !__builtin_sub_overflow(l_num, r_num, &n);
+            break;
+        case TOK_STAR:
+            exact = !__builtin_mul_overflow(l_num, r_num, &n);
+            break;
+        case TOK_SLASH:
+            exact = r_num != 0 && !(l_num == INT64_MIN && r_num == -1) && l_num % r_num == 0;
+            if (exact) n = l_num / r_num;
+            break;
+        default:
+            assert("Unreachable" && false);
+            break;
+        }
+
+        if (exact) {
+            ARR_PUSH(numbers, INT_VALUE(n), Value);
+            return;
+        }
+    }
+
+    if (numeric_model == NUM_FLOAT)
+    {
+        float l_num = value_as_double(l_val);
+        float r_num = value_as_double(r_val);
+        float f;
+        switch (tok_type)
+        {
+        case TOK_PLUS: 
+            f = l_num + r_num; 
+            break;
+        case TOK_MINUS: 
+            f = l_num - r_num; 
+            break;
+        case TOK_STAR: 
+            f = l_num * r_num; 
+            break;
+        case TOK_SLASH: 
+            f = l_num / r_num; 
+            break; 
+        default:
+            assert("Unreachable" && false);
+            break;
+        }
+        res = DOUBLE_VALUE(f);
+    }
+    else
+    {
+        double l_num = value_as_double(l_val);
+        double r_num = value_as_double(r_val);
+        double d;
+        switch (tok_type)
+        {
+        case TOK_PLUS: 
+            d = l_num + r_num; 
+            break;
+        case TOK_MINUS: 
+            d = l_num - r_num; 
+            break;
+        case TOK_STAR: 
+            d = l_num * r_num; 
+            break;
+        case TOK_SLASH: 
+            d = l_num / r_num; 
+            break; 
+        default:
+            assert("Unreachable" && false);
+            break;
+        }
+        res = DOUBLE_VALUE(d);
+    }
+
+    ARR_PUSH(numbers, res, Value);
 }
 
-static float lookup_variable(char *name_addr, int name_len)
+void perform_comparison_op(NumStack *numbers, TokType tok_type)
 {
-    for (int i = 0; i < variables.size; i++) {
-        if (name_len == variables.data[i].name_len &&
-            strncmp(variables.data[i].name_addr, name_addr, name_len) == 0) 
+    Value r_val = NumStack_pop(numbers, "expected right-hand side number to perform comparison operation");
+    Value l_val = NumStack_pop(numbers, "expected left-hand side number to perform comparison operation");
+
+    // Arrays are compared element by element, 'if' tests that all the elements are true
+    if (l_val.type == VAL_ARRAY || r_val.type == VAL_ARRAY) {
+        check_lengths(l_val, r_val);
+        ARR_PUSH(numbers, array_comparison(tok_type, l_val, r_val), Value);
+        return;
+    }
+
+    bool res = false;
+
+    // Fast path: two integers are compared exactly, without converting them.
+    // With --float every value is a float held in a double, so comparing the doubles is the same.
+    if (l_val.type == VAL_INT && r_val.type == VAL_INT && numeric_model == NUM_TAGGED)
+    {
+        int64_t l_num = l_val.i, r_num = r_val.i;
+        switch (tok_type)
         {
-            return variables.data[i].value;
+        case TOK_LT: res = l_num < r_num; break;
+        case TOK_GT: res = l_num > r_num; break;
+        case TOK_LE: res = l_num <= r_num; break;
+        case TOK_GE: res = l_num >= r_num; break;
+        case TOK_EQ: res = l_num == r_num; break;
+        case TOK_NE: res = l_num != r_num; break;
+        default:
+            assert("Unreachable" && false);
+            break;
+        }
+    }
+    else
+    {
+        double l_num = value_as_double(l_val);
+        double r_num = value_as_double(r_val);
+        switch (tok_type)
+        {
+        case TOK_LT: res = l_num < r_num; break;
+        case TOK_GT: res = l_num > r_num; break;
+        case TOK_LE: res = l_num <= r_num; break;
+        case TOK_GE: res = l_num >= r_num; break;
+        case TOK_EQ: res = l_num == r_num; break;
+        case TOK_NE: res = l_num != r_num; break;
+        default:
+            assert("Unreachable" && false);
+            break;
         }
     }
 
-    char err_buffer[ERR_MSG_SIZE];
-    snprintf(err_buffer, ERR_MSG_SIZE, "variable '%.*s' not declared", name_len, name_addr);
-    report_error(err_buffer);
-    return -1;
+    ARR_PUSH(numbers, value_from_bool(res), Value);
+}
+
+static void perform_logical_op(NumStack *numbers, TokType tok_type)
+{
+    Value r_val = NumStack_pop(numbers, "expected right-hand side number to perform logical operation");
+    Value l_val = NumStack_pop(numbers, "expected left-hand side number to perform logical operation");
+
+    bool res = false;
+    if (tok_type == TOK_AND) res = value_is_true(l_val) && value_is_true(r_val);
+    else if (tok_type == TOK_OR) res = value_is_true(l_val) || value_is_true(r_val);
+    else assert("Unreachable" && false);
+
+    release_value(l_val);
+    release_value(r_val);
+    ARR_PUSH(numbers, value_from_bool(res), Value);
+}
+
+static Value NumStack_pop(NumStack *numbers, char *err_msg)
+{
+    if (ARR_IS_EMPTY(numbers)) {
+        report_error(err_msg);
+    }
+
+    Value val = numbers->data[numbers->size - 1];
+    ARR_POP(numbers);
+    return val;
+}
+
+static void check_lengths(Value l_val, Value r_val)
+{
+    if (l_val.type == VAL_ARRAY && r_val.type == VAL_ARRAY && l_val.arr->len != r_val.arr->len) {
+        char err_buffer[ERR_MSG_SIZE];
+        snprintf(err_buffer, ERR_MSG_SIZE, "operation between arrays of different length (%d and %d)", l_val.arr->len, r_val.arr->len);
+        report_error(err_buffer);
+    }
+}
+
+// ARR_TOP is not usable because data of OpStack is a struct
+static Op OpStack_top(OpStack operators) {
+    return operators.size > 0 ? operators.data[operators.size - 1] : (Op){0};
+}
+
+// The verifier checked that it's declared
+static Value lookup_variable(Token token)
+{
+    COUNT(loads);
+    Value val = variables.data[token.name].value;
+    retain_value(val);
+    return val;
 }
@@ -1,9 +1,91 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-typedef struct TokenArr TokenArr;
+#include "tokenizer.h"
 
-void init_parser(TokenArr token_arr);
-void parse_tokens(void);
+#include <time.h>
+
+typedef enum OpFamily {
+    GROUPING,
+    ARITHMETIC,
+    COMPARISON,
+    LOGICAL,
+} OpFamily;
+
+typedef struct Op {
+    OpFamily family;
+    int prec;
+    TokType tok_type;
+} Op;
+
+/* There are 5 different precedence levels. 
+Don't confuse them with OpFamily! 
+Operators of the same family, might have a different precedence; e.g. '+' and '*'. */
+#define MAX_PREC 6
+
+// An error message, "Line <n>: " excluded
+#define ERR_MSG_SIZE 256
+
+/* A parenthesis left open, or closed without being opened, is accepted by a run: the closing one was always optional
+(see examples/06_expression.jis). jis --check sets this, and reports them as errors. */
+extern bool strict_parens;
+
+// 'exec' inside 'exec', not counting tail calls
+#define DEFAULT_MAX_TASK_DEPTH 100000
+extern int max_task_depth;
+
+/* --cost counts the operations of the runs, the same on any machine and any number of threads:
+the tokens the parser consumes, the expressions evaluated, the operators applied by family,
+the loads and stores of variables, the tasks executed or spawned and the iterations of the loops.
+print_cost() prints them as JSON. */
+extern bool count_cost;
+void print_cost(FILE *out);
+
+// 0 for no limit
+typedef struct ExecLimits {
+    int64_t max_steps;
+    int64_t max_millis;
+} ExecLimits;
+
+/* The budget of a run, shared by the tasks it spawns. A step is an iteration of a 'while' or an 'exec':
+only there the budget is checked, so that a statement costs nothing more. Threads take steps from it in chunks,
+and check the deadline when they take one. */
+typedef struct ExecBudget {
+    _Atomic int64_t steps_taken;
+    int64_t max_steps;
+    struct timespec deadline; // CLOCK_MONOTONIC
+    bool has_deadline;
+    _Atomic bool exhausted;
+} ExecBudget;
+
+typedef enum RunResult {
+    RUN_OK,
+    RUN_ERROR,
+    RUN_OUT_OF_BUDGET,
+} RunResult;
+
+// The exit status of a run stopped by its budget
+#define EXIT_OUT_OF_BUDGET 3
+
+void init_parser(Program *program);
+RunResult parse_tokens(void);
+void set_parser_output(FILE *out); // after init_parser(), which prints to stdout
+void init_exec_budget(ExecBudget *budget, ExecLimits limits); // the time starts now
+void set_exec_budget(ExecBudget *budget); // after init_parser(), which sets no limits
+int64_t check_statement(int64_t cursor);
+
+// A variable set before the program runs
+typedef struct Define {
+    int name;
+    Value value;
+} Define;
+
+/* Snapshots (see snapshot.h): save() is called at the first top-level statement after the line,
+or at the end of the program, and the run stops with an error if it fails. */
+void set_snapshot_line(int line, bool (*save)(void)); // after init_parser()
+
+RunResult run_with_defines(Program *program, const Define *defines, int count, FILE *out, ExecBudget *budget);
+void free_parser(void);
+Op get_op_from_OpTable(TokType tok_type);
 
 #endif
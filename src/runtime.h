@@ -0,0 +1,151 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include "parser.h"
+#include "utils.h"
+#include "scheduler.h"
+#include "memo.h"
+#include "tier.h"
+#include "parallel.h"
+
+#include <setjmp.h>
+
+/* The state of a run, on each thread. parser.c walks the tokens, and shares it with the modules it hands
+parts of the run to: memoization (memo.c), tiered execution (tier.c), the parallel statements (parallel.c)
+and snapshots (snapshot.c). */
+
+#define GLOBAL_SCOPE 0
+
+typedef struct Spawned Spawned;
+typedef Spawned *SpawnedPtr;
+DECLARE_ARR(SpawnedArr, SpawnedPtr)
+
+/* The blocks being executed. A block pushes its frame and returns, and execute() ends it at its '}':
+so 'exec' doesn't recurse on the C stack, and neither do the 'if' and 'while' inside tasks. */
+typedef enum FrameKind {
+    FRAME_TASK,  // returns after the 'exec', or ends execute() if return_to is -1
+    FRAME_IF,    // skips the 'else' at its end
+    FRAME_ELSE,
+    FRAME_WHILE, // goes back to the condition at its end
+} FrameKind;
+
+typedef struct Frame {
+    FrameKind kind;
+    int64_t return_to; // task: the token after the 'exec', while: the condition
+    int scope;     // scope at return_to
+    int task;      // task: its name
+    int memo_task; // task: the pure task whose outputs are cached at its end, -1 if none
+    int memo_slot;
+} Frame;
+
+DECLARE_ARR(FrameArr, Frame)
+
+// Counted by --cost on each thread, added to total_cost when its run or spawned task ends
+typedef struct Cost {
+    int64_t tokens;      // consumed by advance()
+    int64_t expressions;
+    int64_t arithmetic;  // operators applied, by family
+    int64_t comparison;
+    int64_t logical;
+    int64_t loads;       // of variables
+    int64_t stores;
+    int64_t calls;       // 'exec' and 'spawn'
+    int64_t iterations;  // of a 'while'
+} Cost;
+
+#define COUNT(field) do { if (count_cost) parser.cost.field++; } while (0)
+
+typedef struct Parser {
+    int64_t cursor;
+    int scope;
+    Token token;
+    TokenArr token_arr;
+    Program *program;
+    FILE *out;          // stdout, the buffer of a spawned task, or the connection of a request
+    jmp_buf *on_error;  // where an error goes, after being printed
+    SpawnedArr spawned; // not yet joined by 'wait'
+    SpawnedArr deferred; // top-level statements running on the scheduler, not yet joined (see parallel.c)
+    Spawned *running;   // the spawned task, or the statement deferred, this thread runs; NULL for a run
+    Parallel *parallel; // NULL if the statements run one after the other
+    int64_t stop;       // execute() returns at this token, at the top level; -1 at the end of the program
+    FrameArr frames;
+    int task_depth;     // task frames in frames
+    ExecBudget *budget; // NULL for no limits
+    int64_t steps_left; // taken from the budget
+    uint8_t *shapes;    // Shape of the statement or condition at each token, NULL if not running
+    PureTaskPtr *memo;  // by task name, NULL if memoization is off
+    Tier *tier;         // the loops and tasks counted and compiled, NULL until one is counted
+    int snapshot_line;  // 0 if no snapshot is taken
+    bool (*save_snapshot)(void);
+    Cost cost;
+} Parser;
+
+// Variables and tasks are indexed by their interned name
+typedef struct Variable {
+    bool declared;
+    bool written; // stored by a spawned task, so merged at the 'wait'
+    Value value;
+} Variable;
+
+typedef struct Task {
+    bool declared;
+    int64_t proc_start;
+} Task;
+
+DECLARE_ARR(VarArr, Variable)
+DECLARE_ARR(TaskArr, Task)
+
+// The output of a spawned task is kept in memory until it's joined, counted by its memory budget
+typedef enum OutputState {
+    OUTPUT_KEPT,
+    OUTPUT_DROPPED, // over the budget: the error is reported after the print (see check_output())
+    OUTPUT_ERROR,   // the error replaces it, past the budget
+} OutputState;
+
+/* 'spawn Task;' runs the task on a copy of the variables and of the tasks, taken at the spawn.
+Neither the spawner nor the other spawned tasks see its stores, until the 'wait':
+then, in the order they were spawned, the output of each task is printed
+and the variables it stored are copied back. So the result doesn't depend on the scheduling.
+A spawned task waits for the tasks it spawned before it ends, and so does the program;
+the spawns of a task run with 'exec' are joined by the next 'wait' after it, as if they were made in its place. */
+struct Spawned {
+    Program *program;
+    int64_t proc_start;
+    int task;     // -1 for a top-level statement deferred
+    int64_t stop; // a top-level statement: the token after it
+    VarArr variables;
+    TaskArr tasks;
+    char *output;
+    size_t output_len;
+    size_t output_cap;
+    OutputState output_state;
+    bool failed; // its output ends with the error
+    MemBudget *budget; // of the thread that spawned it
+    ExecBudget *exec_budget;
+    uint8_t *shapes;
+    Work *work;
+};
+
+DECLARE_ARR(NumStack, Value)
+
+extern _Thread_local Parser parser;
+extern _Thread_local VarArr variables;
+extern _Thread_local TaskArr tasks;
+
+void jump(int64_t cursor, int scope);
+void take_steps(void);
+
+// Loop back-edges and 'exec's: the only places where a program can run for long
+static inline void take_step(void)
+{
+    if (--parser.steps_left < 0) take_steps();
+}
+
+void check_output(void); // after printing to parser.out
+Spawned *new_spawned(int64_t start, int task);
+void run_spawned(void *arg);
+void join_first(SpawnedArr *list, int64_t count);
+void perform_arithmetic_op(NumStack *numbers, TokType tok_type);
+void perform_comparison_op(NumStack *numbers, TokType tok_type);
+
+#endif // RUNTIME_H
@@ -0,0 +1,179 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "scheduler.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+struct Work {
+    void (*fn)(void *arg);
+    void *arg;
+    bool done;
+};
+
+typedef Work *WorkPtr;
+DECLARE_ARR(WorkArr, WorkPtr)
+
+// The front of the deque is at 'head', the back at 'items.size'
+typedef struct Deque {
+    WorkArr items;
+    int head;
+} Deque;
+
+/* A single lock protects all the deques: the work is coarse (a whole task),
+so what matters is that threads take work from each other, not lock-free deques. */
+typedef struct Scheduler {
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // work was pushed or done
+    Deque *deques; // deque 0 belongs to the main thread
+    pthread_t *threads;
+    int workers;
+    bool started;
+    bool stopping;
+} Scheduler;
+
+static void start_scheduler(void);
+static void *worker_loop(void *arg);
+static Work *take_work(void);
+static void run_work(Work *work);
+
+static Scheduler scheduler = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .changed = PTHREAD_COND_INITIALIZER,
+};
+
+static _Thread_local int worker_id = 0;
+
+Work *spawn_work(void (*fn)(void *arg), void *arg)
+{
+    Work *work = reallocate(NULL, sizeof(Work));
+    work->fn = fn;
+    work->arg = arg;
+    work->done = false;
+
+    pthread_mutex_lock(&scheduler.lock);
+    if (!scheduler.started) start_scheduler();
+    ARR_PUSH(&scheduler.deques[worker_id].items, work, WorkPtr);
+    pthread_cond_broadcast(&scheduler.changed);
+    pthread_mutex_unlock(&scheduler.lock);
+
+    return work;
+}
+
+void wait_work(Work *work)
+{
+    pthread_mutex_lock(&scheduler.lock);
+    while (!work->done)
+    {
+        Work *other = take_work();
+        if (other != NULL) {
+            pthread_mutex_unlock(&scheduler.lock);
+            run_work(other);
+            pthread_mutex_lock(&scheduler.lock);
+        } else {
+            pthread_cond_wait(&scheduler.changed, &scheduler.lock);
+        }
+    }
+    pthread_mutex_unlock(&scheduler.lock);
+
+    reallocate(work, 0);
+}
+
+// All the work has been waited
+void stop_scheduler(void)
+{
+    pthread_mutex_lock(&scheduler.lock);
+    if (!scheduler.started) {
+        pthread_mutex_unlock(&scheduler.lock);
+        return;
+    }
+    scheduler.stopping = true;
+    pthread_cond_broadcast(&scheduler.changed);
+    pthread_mutex_unlock(&scheduler.lock);
+
+    for (int i = 1; i < scheduler.workers; i++) {
+        pthread_join(scheduler.threads[i], NULL);
+    }
+    for (int i = 0; i < scheduler.workers; i++) {
+        ARR_FREE(&scheduler.deques[i].items);
+    }
+    FREE_ARRAY(scheduler.deques);
+    FREE_ARRAY(scheduler.threads);
+    scheduler.started = false;
+    scheduler.stopping = false;
+}
+
+// Called with the lock held
+static void start_scheduler(void)
+{
+    char *env = getenv("JIS_THREADS");
+    int workers = env != NULL ? atoi(env) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+
+    scheduler.workers = workers;
+    scheduler.deques = GROW_ARRAY(Deque, NULL, workers);
+    scheduler.threads = GROW_ARRAY(pthread_t, NULL, workers);
+    memset(scheduler.deques, 0, sizeof(Deque) * workers);
+    scheduler.started = true;
+
+    // If a thread can't be created, the ones started so far do the work
+    for (int i = 1; i < workers; i++) {
+        if (pthread_create(&scheduler.threads[i], NULL, worker_loop, (void *)(intptr_t)i) != 0) {
+            scheduler.workers = i;
+            break;
+        }
+    }
+}
+
+static void *worker_loop(void *arg)
+{
+    worker_id = (int)(intptr_t)arg;
+
+    pthread_mutex_lock(&scheduler.lock);
+    while (!scheduler.stopping)
+    {
+        Work *work = take_work();
+        if (work != NULL) {
+            pthread_mutex_unlock(&scheduler.lock);
+            run_work(work);
+            pthread_mutex_lock(&scheduler.lock);
+        } else {
+            pthread_cond_wait(&scheduler.changed, &scheduler.lock);
+        }
+    }
+    pthread_mutex_unlock(&scheduler.lock);
+
+    return NULL;
+}
+
+// Called with the lock held. The newest work of its own deque, or the oldest of another one.
+static Work *take_work(void)
+{
+    Deque *own = &scheduler.deques[worker_id];
+    if (own->items.size > own->head) {
+        Work *work = own->items.data[--own->items.size];
+        if (own->items.size == own->head) own->items.size = own->head = 0;
+        return work;
+    }
+
+    for (int i = 1; i < scheduler.workers; i++) {
+        Deque *victim = &scheduler.deques[(worker_id + i) % scheduler.workers];
+        if (victim->items.size > victim->head) {
+            Work *work = victim->items.data[victim->head++];
+            if (victim->items.size == victim->head) victim->items.size = victim->head = 0;
+            return work;
+        }
+    }
+
+    return NULL;
+}
+
+static void run_work(Work *work)
+{
+    work->fn(work->arg);
+
+    pthread_mutex_lock(&scheduler.lock);
+    work->done = true;
+    pthread_cond_broadcast(&scheduler.changed);
+    pthread_mutex_unlock(&scheduler.lock);
+}
@@ -0,0 +1,18 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "utils.h"
+
+/* A work-stealing thread pool. Each thread has its own deque of work:
+it pushes and takes from the back of its own, and when it's empty, it steals from the front of the others'.
+A thread waiting for some work runs other work meanwhile, so waiting inside a work doesn't block a thread.
+The threads are started at the first spawn_work(): $JIS_THREADS of them, the main one included,
+or one per cpu. */
+
+typedef struct Work Work;
+
+Work *spawn_work(void (*fn)(void *arg), void *arg);
+void wait_work(Work *work); // frees work
+void stop_scheduler(void);
+
+#endif // SCHEDULER_H
@@ -0,0 +1,364 @@
+#define _GNU_SOURCE // fopencookie()
+
+#include "server.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "optimizer.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OUTPUT_BUFFER_SIZE 4096
+
+/* A client has this long to send its program, and each send of the output can't block longer:
+an idle connection doesn't hold a worker. */
+#define SOCKET_TIMEOUT_MILLIS 5000
+
+/* What the optimizer may allocate, at most, for each token of the program it's given (inlining included):
+it can't be stopped halfway, so it runs only if the budget has room for it. */
+#define OPTIMIZER_BYTES_PER_TOKEN 4096
+
+typedef struct Server {
+    int listen_fd;
+    int opt_level;
+    int64_t max_memory;
+    ExecLimits limits;
+} Server;
+
+/* Everything a request owns, so that it can be freed
+when the request goes over its budget in the middle of tokenizing or optimizing. */
+typedef struct Request {
+    int fd;
+    FILE *out;
+    Program program;
+    MemBudget budget;
+    jmp_buf *on_over_budget;
+} Request;
+
+static void *serve_loop(void *arg);
+static void run_request(Request *request);
+static int run_source(Request *request);
+static void jump_over_budget(void);
+static bool read_source(Request *request);
+static bool set_timeout(int fd, int option, int64_t millis);
+static int64_t now_millis(void);
+static FILE *open_output(int fd);
+static ssize_t write_output(void *cookie, const char *buffer, size_t size);
+static bool send_all(int fd, const void *data, size_t size);
+static bool recv_all(int fd, void *data, size_t size);
+static bool make_address(const char *socket_path, struct sockaddr_un *address);
+
+static Server server;
+
+static _Thread_local Request *current_request;
+
+int serve(const char *socket_path, int opt_level, int workers, int64_t max_memory, ExecLimits limits)
+{
+    struct sockaddr_un address;
+    if (!make_address(socket_path, &address)) return EXIT_FAILURE;
+
+    // A socket left by a previous server is replaced, any other file is not
+    struct stat st;
+    if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(socket_path);
+
+    server.listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.listen_fd == -1
+        || bind(server.listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0
+        || listen(server.listen_fd, SOMAXCONN) != 0)
+    {
+        fprintf(stderr, "Unable to listen on '%s': %s.\n", socket_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    server.opt_level = opt_level;
+    server.max_memory = max_memory;
+    server.limits = limits;
+
+    if (workers < 1) workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+
+    // The main thread is a worker too
+    for (int i = 1; i < workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serve_loop, NULL) != 0) break;
+        pthread_detach(thread);
+    }
+    serve_loop(NULL);
+
+    return EXIT_SUCCESS;
+}
+
+// Each worker takes the next connection itself
+static void *serve_loop(void *arg)
+{
+    (void)arg;
+
+    while (1)
+    {
+        int fd = accept(server.listen_fd, NULL, NULL);
+        if (fd == -1) {
+            // Out of file descriptors, or something like that: give the other requests time to end
+            if (errno != EINTR && errno != ECONNABORTED) {
+                nanosleep(&(struct timespec){ .tv_nsec = 10 * 1000 * 1000 }, NULL);
+            }
+            continue;
+        }
+
+        set_timeout(fd, SO_SNDTIMEO, SOCKET_TIMEOUT_MILLIS);
+
+        Request request = { .fd = fd };
+        run_request(&request);
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static void run_request(Request *request)
+{
+    request->out = open_output(request->fd);
+    if (request->out == NULL) return;
+
+    request->budget = (MemBudget){ .used = 0, .limit = server.max_memory };
+    jmp_buf on_over_budget;
+    request->on_over_budget = &on_over_budget;
+    current_request = request;
+    mem_budget = &request->budget;
+    over_budget = jump_over_budget;
+
+    int32_t status;
+    if (setjmp(on_over_budget) == 0) {
+        status = run_source(request);
+    } else {
+        fprintf(request->out, "Memory limit exceeded.\n");
+        status = EXIT_FAILURE;
+    }
+
+    free_program(&request->program);
+    FREE_ARRAY(request->program.text);
+    mem_budget = NULL;
+    over_budget = NULL;
+    current_request = NULL;
+
+    fclose(request->out);
+    uint32_t end = 0;
+    if (send_all(request->fd, &end, sizeof(end))) {
+        send_all(request->fd, &status, sizeof(status));
+    }
+}
+
+static int run_source(Request *request)
+{
+    Program *program = &request->program;
+
+    if (!read_source(request)) {
+        fprintf(request->out, "Unable to read the program.\n");
+        return EXIT_FAILURE;
+    }
+
+    bool tokenization_err = false;
+    init_tokenizer(program->text);
+    print_lex_errors(request->out);
+    collect_tokens(program, &tokenization_err);
+    if (tokenization_err) return EXIT_FAILURE;
+
+    /* The optimizer can't be stopped halfway: it's skipped if the budget has no room for what it may take,
+    and what it keeps, or frees, is counted once it's done */
+    int64_t room = request->budget.limit - atomic_load(&request->budget.used);
+    if (server.opt_level > 0 && program->tokens.size <= room / OPTIMIZER_BYTES_PER_TOKEN) {
+        MemBudget optimizer_budget = { .used = 0, .limit = INT64_MAX };
+        mem_budget = &optimizer_budget;
+        optimize_program(program);
+        mem_budget = &request->budget;
+        atomic_fetch_add(&request->budget.used, optimizer_budget.used);
+        if (atomic_load(&request->budget.used) > request->budget.limit) jump_over_budget();
+    }
+
+    // The time limit counts from when the program starts
+    ExecBudget budget;
+    init_exec_budget(&budget, server.limits);
+
+    init_parser(program);
+    set_parser_output(request->out);
+    set_exec_budget(&budget);
+    RunResult result = parse_tokens();
+    free_parser();
+
+    if (result == RUN_OUT_OF_BUDGET) return EXIT_OUT_OF_BUDGET;
+    return result == RUN_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// The parser reports going over the budget as an error of the program, before that it ends the request
+static void jump_over_budget(void)
+{
+    longjmp(*current_request->on_over_budget, 1);
+}
+
+/* The source code is everything the client sends before shutting down its side,
+within SOCKET_TIMEOUT_MILLIS of the connection: each recv() waits only for the time left. */
+static bool read_source(Request *request)
+{
+    Program *program = &request->program;
+    size_t len = 0;
+    size_t cap = 0;
+    int64_t deadline = now_millis() + SOCKET_TIMEOUT_MILLIS;
+
+    while (1)
+    {
+        if (len + 1 >= cap) {
+            cap = GROW_CAPACITY(cap);
+            program->text = GROW_ARRAY(char, program->text, cap);
+        }
+
+        int64_t left = deadline - now_millis();
+        if (left <= 0 || !set_timeout(request->fd, SO_RCVTIMEO, left)) return false;
+
+        ssize_t bytes = recv(request->fd, &program->text[len], cap - len - 1, 0);
+        if (bytes == 0) break;
+        if (bytes == -1) {
+            if (errno == EINTR) continue;
+            return false; // EAGAIN when it times out
+        }
+        len += bytes;
+    }
+
+    program->text[len] = '\0';
+    program->text_len = len + 1;
+    program->source_len = len;
+    return true;
+}
+
+static bool set_timeout(int fd, int option, int64_t millis)
+{
+    struct timeval timeout = { .tv_sec = millis / 1000, .tv_usec = millis % 1000 * 1000 };
+    return setsockopt(fd, SOL_SOCKET, option, &timeout, sizeof(timeout)) == 0;
+}
+
+static int64_t now_millis(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// The output of a program is sent in frames as the buffer fills up
+static FILE *open_output(int fd)
+{
+    FILE *out = fopencookie((void *)(intptr_t)fd, "w", (cookie_io_functions_t){ .write = write_output });
+    if (out != NULL) setvbuf(out, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    return out;
+}
+
+static ssize_t write_output(void *cookie, const char *buffer, size_t size)
+{
+    int fd = (int)(intptr_t)cookie;
+    uint32_t len = size;
+    if (size == 0) return 0; // a frame of length 0 would end the output
+    if (!send_all(fd, &len, sizeof(len)) || !send_all(fd, buffer, size)) return -1;
+    return size;
+}
+
+// The client isn't a signal away from killing the server
+static bool send_all(int fd, const void *data, size_t size)
+{
+    const char *bytes = data;
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+static bool recv_all(int fd, void *data, size_t size)
+{
+    char *bytes = data;
+    while (size > 0)
+    {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if (received == 0) return false;
+        if (received == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes += received;
+        size -= received;
+    }
+    return true;
+}
+
+static bool make_address(const char *socket_path, struct sockaddr_un *address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "Socket path '%s' is too long.\n", socket_path);
+        return false;
+    }
+    strcpy(address->sun_path, socket_path);
+    return true;
+}
+
+/*
+ *
+ *  Client
+ */
+
+int submit(const char *socket_path, const char *source_code, size_t source_len)
+{
+    struct sockaddr_un address;
+    if (!make_address(socket_path, &address)) return EXIT_FAILURE;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Unable to connect to '%s': %s.\n", socket_path, strerror(errno));
+        if (fd != -1) close(fd);
+        return EXIT_FAILURE;
+    }
+
+    if (!send_all(fd, source_code, source_len) || shutdown(fd, SHUT_WR) != 0) {
+        fprintf(stderr, "Unable to send the program to '%s'.\n", socket_path);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    char buffer[OUTPUT_BUFFER_SIZE];
+    int32_t status = EXIT_FAILURE;
+    while (1)
+    {
+        uint32_t len;
+        if (!recv_all(fd, &len, sizeof(len))) {
+            fprintf(stderr, "The server closed the connection.\n");
+            break;
+        }
+        if (len == 0) {
+            if (!recv_all(fd, &status, sizeof(status))) status = EXIT_FAILURE;
+            break;
+        }
+
+        while (len > 0) {
+            uint32_t chunk = len < sizeof(buffer) ? len : sizeof(buffer);
+            if (!recv_all(fd, buffer, chunk)) break;
+            fwrite(buffer, 1, chunk, stdout);
+            len -= chunk;
+        }
+        if (len > 0) {
+            fprintf(stderr, "The server closed the connection.\n");
+            break;
+        }
+    }
+
+    close(fd);
+    return status;
+}
@@ -0,0 +1,17 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "utils.h"
+#include "parser.h"
+
+/* jis --serve <socket> runs the programs sent to a Unix socket, on a pool of worker threads,
+each in a fresh interpreter state and under a memory limit, without starting a process for each one.
+
+A client sends the source code of a program, then shuts down its side of the connection, within 5 seconds.
+The server sends back what the program prints, in frames: a 32-bit length (host order) followed by that many bytes,
+as the output is produced. A frame of length 0 ends the output, and is followed by the 32-bit exit status. */
+
+int serve(const char *socket_path, int opt_level, int workers, int64_t max_memory, ExecLimits limits);
+int submit(const char *socket_path, const char *source_code, size_t source_len); // returns the exit status
+
+#endif // SERVER_H
@@ -0,0 +1,238 @@
+#define _XOPEN_SOURCE 700 // realpath()
+
+#include "snapshot.h"
+#include "parser.h"
+#include "runtime.h"
+
+#include <limits.h>
+#include <unistd.h>
+
+#define SNAPSHOT_MAGIC "JISS"
+#define SNAPSHOT_VERSION 2
+
+// Followed by the path of the program, then by the state of the run (see write_run_state())
+typedef struct SnapshotHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_hash;
+    uint64_t source_len;
+    uint32_t opt_level;
+    uint32_t numeric_model;
+    uint32_t token_size; // the cursor is an index in the tokens of this build
+    uint32_t names_count;
+    uint64_t tokens_count;
+    uint32_t path_len;
+} SnapshotHeader;
+
+static bool save(void);
+static FILE *open_snapshot(const char *snap_path, SnapshotHeader *header, char **source_path);
+static void write_run_state(FILE *file);
+static void write_value(FILE *file, Value val);
+static bool read_run_state(FILE *file);
+static bool read_value(FILE *file, Value *val);
+
+// What save() writes, set by arm_snapshot()
+static SnapshotHeader armed;
+static char armed_path[PATH_MAX];
+static const char *armed_snap_path;
+
+void arm_snapshot(Program *program, int line, const char *snap_path, const char *source_path, int opt_level)
+{
+    armed = (SnapshotHeader){
+        .version = SNAPSHOT_VERSION,
+        .source_hash = hash_bytes(program->text, program->source_len),
+        .source_len = program->source_len,
+        .opt_level = opt_level,
+        .numeric_model = numeric_model,
+        .token_size = sizeof(Token),
+        .tokens_count = program->tokens.size,
+        .names_count = program->names.size,
+    };
+    memcpy(armed.magic, SNAPSHOT_MAGIC, 4);
+
+    // Absolute, so that it can be restored from another directory
+    if (realpath(source_path, armed_path) == NULL) {
+        snprintf(armed_path, sizeof(armed_path), "%s", source_path);
+    }
+    armed.path_len = strlen(armed_path);
+    armed_snap_path = snap_path;
+
+    set_snapshot_line(line, save);
+}
+
+// Written next to the final file and renamed, so that a failed save doesn't leave half a snapshot
+static bool save(void)
+{
+    char tmp_path[PATH_MAX + 32];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", armed_snap_path, (long)getpid());
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (file == NULL) return false;
+
+    fwrite(&armed, sizeof(armed), 1, file);
+    fwrite(armed_path, 1, armed.path_len, file);
+    write_run_state(file);
+
+    bool ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp_path, armed_snap_path) != 0) {
+        remove(tmp_path);
+        return false;
+    }
+    return true;
+}
+
+bool read_snapshot_info(const char *snap_path, SnapshotInfo *info)
+{
+    SnapshotHeader header;
+    FILE *file = open_snapshot(snap_path, &header, &info->source_path);
+    if (file == NULL) return false;
+    fclose(file);
+
+    info->opt_level = header.opt_level;
+    info->numeric_model = header.numeric_model;
+    return true;
+}
+
+bool restore_snapshot(Program *program, const char *snap_path)
+{
+    SnapshotHeader header;
+    char *source_path;
+    FILE *file = open_snapshot(snap_path, &header, &source_path);
+    if (file == NULL) return false;
+
+    bool ok = false;
+    if (header.source_hash != hash_bytes(program->text, program->source_len) || header.source_len != program->source_len) {
+        fprintf(stderr, "The snapshot '%s' is of another version of '%s'.\n", snap_path, source_path);
+    } else if (header.tokens_count != (uint64_t)program->tokens.size || header.names_count != (uint32_t)program->names.size) {
+        fprintf(stderr, "The snapshot '%s' doesn't fit the program as compiled by this build.\n", snap_path);
+    } else if (!(ok = read_run_state(file))) {
+        fprintf(stderr, "The snapshot '%s' is corrupted.\n", snap_path);
+    }
+
+    free(source_path);
+    fclose(file);
+    return ok;
+}
+
+// Positioned after the path, NULL if it isn't a snapshot of this build
+static FILE *open_snapshot(const char *snap_path, SnapshotHeader *header, char **source_path)
+{
+    FILE *file = fopen(snap_path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to open file '%s'.\n", snap_path);
+        return NULL;
+    }
+
+    bool valid = fread(header, sizeof(*header), 1, file) == 1
+        && memcmp(header->magic, SNAPSHOT_MAGIC, 4) == 0
+        && header->version == SNAPSHOT_VERSION
+        && header->token_size == sizeof(Token)
+        && header->path_len < PATH_MAX;
+
+    *source_path = valid ? malloc(header->path_len + 1) : NULL;
+    if (valid && (*source_path == NULL || fread(*source_path, 1, header->path_len, file) != header->path_len)) {
+        free(*source_path);
+        valid = false;
+    }
+
+    if (!valid) {
+        fprintf(stderr, "'%s' isn't a snapshot of this version of jis.\n", snap_path);
+        fclose(file);
+        return NULL;
+    }
+
+    (*source_path)[header->path_len] = '\0';
+    return file;
+}
+
+/*
+ *
+ *  State of the run
+ */
+
+// Written by take_snapshot() in parser.c, between two top-level statements
+static void write_run_state(FILE *file)
+{
+    int64_t head[3] = { parser.cursor, parser.scope, variables.size };
+    fwrite(head, sizeof(int64_t), 3, file);
+
+    for (int i = 0; i < variables.size; i++)
+    {
+        uint8_t declared[2] = { variables.data[i].declared, tasks.data[i].declared };
+        fwrite(declared, 1, 2, file);
+        fwrite(&tasks.data[i].proc_start, sizeof(int64_t), 1, file);
+        if (declared[0]) write_value(file, variables.data[i].value);
+    }
+}
+
+// A number is its type and its 8 bytes, an array its length and its elements
+static void write_value(FILE *file, Value val)
+{
+    uint8_t type = val.type;
+    fwrite(&type, 1, 1, file);
+    if (val.type == VAL_ARRAY) {
+        int32_t len = val.arr->len;
+        fwrite(&len, sizeof(int32_t), 1, file);
+        fwrite(val.arr->data, sizeof(double), len, file);
+    } else if (val.type == VAL_INT) {
+        fwrite(&val.i, sizeof(int64_t), 1, file);
+    } else {
+        fwrite(&val.d, sizeof(double), 1, file);
+    }
+}
+
+static bool read_run_state(FILE *file)
+{
+    int64_t head[3];
+    int64_t size = parser.token_arr.size;
+    if (fread(head, sizeof(int64_t), 3, file) != 3 || head[0] < 0 || head[0] > size
+        || head[1] != GLOBAL_SCOPE || head[2] != variables.size)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < variables.size; i++)
+    {
+        uint8_t declared[2];
+        int64_t proc_start;
+        if (fread(declared, 1, 2, file) != 2 || fread(&proc_start, sizeof(int64_t), 1, file) != 1
+            || proc_start < 0 || proc_start > size)
+        {
+            return false;
+        }
+
+        Variable *var = &variables.data[i];
+        if (declared[0] && !read_value(file, &var->value)) return false;
+        var->declared = declared[0];
+        tasks.data[i].declared = declared[1];
+        tasks.data[i].proc_start = proc_start;
+    }
+
+    jump(head[0], head[1]);
+    return true;
+}
+
+static bool read_value(FILE *file, Value *val)
+{
+    uint8_t type;
+    if (fread(&type, 1, 1, file) != 1) return false;
+
+    if (type == VAL_ARRAY) {
+        int32_t len;
+        if (fread(&len, sizeof(int32_t), 1, file) != 1 || len < 0) return false;
+        Array *arr = new_array(len);
+        if (fread(arr->data, sizeof(double), len, file) != (size_t)len) {
+            release_value(ARRAY_VALUE(arr)); // a truncated snapshot
+            return false;
+        }
+        *val = ARRAY_VALUE(arr);
+        return true;
+    }
+    if (type == VAL_INT) {
+        *val = INT_VALUE(0);
+        return fread(&val->i, sizeof(int64_t), 1, file) == 1;
+    }
+    *val = DOUBLE_VALUE(0);
+    return type == VAL_DOUBLE && fread(&val->d, sizeof(double), 1, file) == 1;
+}
@@ -0,0 +1,24 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "tokenizer.h"
+
+/* jis --snapshot-after <line> <out.snap> <path> saves the state of the run once it's past a line,
+at the first top-level statement after it: the variables, the tasks and where the run is.
+jis --restore <out.snap> resumes a run from there, without running what comes before, e.g. a slow setup.
+
+A snapshot holds the path of the program and a hash of its source, and is rejected if the source changed.
+It's taken on the program as optimized, so it also holds the optimization level and the numeric model,
+which the restored run uses. */
+
+typedef struct SnapshotInfo {
+    char *source_path; // the caller frees it
+    int opt_level;
+    NumericModel numeric_model;
+} SnapshotInfo;
+
+void arm_snapshot(Program *program, int line, const char *snap_path, const char *source_path, int opt_level); // after init_parser()
+bool read_snapshot_info(const char *snap_path, SnapshotInfo *info); // prints why it can't be read
+bool restore_snapshot(Program *program, const char *snap_path); // after init_parser(), prints why it can't be restored
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,370 @@
+#define _POSIX_C_SOURCE 200809L // open_memstream(), getline()
+
+#include "sweep.h"
+#include "scheduler.h"
+#include "batch.h"
+#include "verifier.h"
+
+#include <ctype.h>
+#include <limits.h>
+
+// The works (runs or batches of them) started ahead of the one being printed, so that only their outputs are kept waiting
+#define SWEEP_WINDOW 256
+
+typedef struct Inputs {
+    Program *program;
+    int *names;    // the variable of each column
+    int cols;
+    Value *values; // rows * cols, by row
+    int rows;
+} Inputs;
+
+typedef struct Run {
+    int row;
+    Work *work;  // of the first run of each batch
+    char *output;
+    size_t output_len;
+    RunResult result;
+} Run;
+
+static void run_input(void *arg);
+static void run_lanes(void *arg);
+static void print_input(int row);
+static bool expand_ranges(char **ranges, int count);
+static bool read_csv(const char *path);
+static bool add_column(const char *name, size_t len);
+static bool parse_number(const char *text, size_t len, Value *value);
+static bool verify_inputs(void);
+
+static Inputs inputs;
+static ExecLimits sweep_limits;
+static Batch *batch;
+static Run *runs;
+
+int sweep(Program *program, SweepSpec spec, ExecLimits limits)
+{
+    inputs = (Inputs){ .program = program };
+    sweep_limits = limits;
+
+    bool ok = spec.csv_path != NULL ? read_csv(spec.csv_path) : expand_ranges(spec.ranges, spec.range_count);
+    if (ok && inputs.rows == 0) {
+        fprintf(stderr, "There are no inputs to sweep.\n");
+        ok = false;
+    }
+    if (ok && !verify_inputs()) {
+        FREE_ARRAY(inputs.names);
+        FREE_ARRAY(inputs.values);
+        return EXIT_FAILURE;
+    }
+
+    batch = NULL;
+    if (ok && spec.batch) {
+        const char *reason;
+        batch = compile_batch(program, &reason);
+        if (batch == NULL) fprintf(stderr, "Running the inputs one at a time: %s.\n", reason);
+    }
+
+    // Without a batch, each run is a work of its own
+    int status = ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    int lanes = batch != NULL ? BATCH_LANES : 1;
+    runs = ok ? GROW_ARRAY(Run, NULL, inputs.rows) : NULL;
+    int started = 0;
+
+    for (int i = 0; ok && i < inputs.rows; i++)
+    {
+        for (; started < inputs.rows && started < i + SWEEP_WINDOW * lanes; started++) {
+            runs[started] = (Run){ .row = started };
+            if (started % lanes == 0) {
+                runs[started].work = spawn_work(batch != NULL ? run_lanes : run_input, &runs[started]);
+            }
+        }
+        if (i % lanes == 0) wait_work(runs[i].work);
+
+        print_input(i);
+        fwrite(runs[i].output, 1, runs[i].output_len, stdout);
+        free(runs[i].output);
+
+        if (status == EXIT_SUCCESS && runs[i].result != RUN_OK) {
+            status = runs[i].result == RUN_OUT_OF_BUDGET ? EXIT_OUT_OF_BUDGET : EXIT_FAILURE;
+        }
+    }
+
+    if (batch != NULL) free_batch(batch);
+    FREE_ARRAY(runs);
+    FREE_ARRAY(inputs.names);
+    FREE_ARRAY(inputs.values);
+    return status;
+}
+
+// Runs on any thread of the scheduler
+static void run_input(void *arg)
+{
+    Run *run = arg;
+
+    Define defines[inputs.cols];
+    for (int j = 0; j < inputs.cols; j++) {
+        defines[j] = (Define){ .name = inputs.names[j], .value = inputs.values[run->row * inputs.cols + j] };
+    }
+
+    FILE *out = open_memstream(&run->output, &run->output_len);
+    if (out == NULL) {
+        run->result = RUN_ERROR;
+        return;
+    }
+
+    // The time limit counts from when the run starts
+    ExecBudget budget;
+    init_exec_budget(&budget, sweep_limits);
+    run->result = run_with_defines(inputs.program, defines, inputs.cols, out, &budget);
+    fclose(out);
+}
+
+// Runs on any thread of the scheduler, the inputs from this one on, as the lanes of a batch
+static void run_lanes(void *arg)
+{
+    Run *first = arg;
+    int lanes = inputs.rows - first->row < BATCH_LANES ? inputs.rows - first->row : BATCH_LANES;
+
+    Define defines[lanes * inputs.cols + 1];
+    FILE *outs[BATCH_LANES];
+    RunResult results[BATCH_LANES];
+    bool ok = true;
+
+    for (int k = 0; k < lanes; k++)
+    {
+        Run *run = &first[k];
+        for (int j = 0; j < inputs.cols; j++) {
+            defines[k * inputs.cols + j] = (Define){ .name = inputs.names[j], .value = inputs.values[run->row * inputs.cols + j] };
+        }
+        outs[k] = open_memstream(&run->output, &run->output_len);
+        if (outs[k] == NULL) ok = false;
+    }
+
+    if (ok) run_batch(batch, defines, inputs.cols, lanes, outs, results, sweep_limits);
+
+    for (int k = 0; k < lanes; k++) {
+        if (outs[k] != NULL) fclose(outs[k]);
+        first[k].result = ok ? results[k] : RUN_ERROR;
+    }
+}
+
+static void print_input(int row)
+{
+    Program *program = inputs.program;
+
+    printf("---");
+    for (int j = 0; j < inputs.cols; j++)
+    {
+        Name name = program->names.data[inputs.names[j]];
+        Value value = value_result(inputs.values[row * inputs.cols + j]);
+        printf(" %.*s=", name.len, &program->text[name.start]);
+        if (value.type == VAL_INT) printf("%lld", (long long)value.i);
+        else printf("%g", value.d);
+    }
+    printf(" ---\n");
+}
+
+/* Every combination of the values of the ranges, "name=start:end[:step]".
+The values are integers if start and step are, doubles otherwise. */
+static bool expand_ranges(char **ranges, int count)
+{
+    Value starts[count], steps[count];
+    int64_t lengths[count];
+    int64_t rows = 1;
+
+    for (int j = 0; j < count; j++)
+    {
+        char *range = ranges[j];
+        char *eq = strchr(range, '=');
+        char *colon = eq != NULL ? strchr(eq, ':') : NULL;
+        if (colon == NULL) {
+            fprintf(stderr, "Expected name=start:end[:step], but got '%s'.\n", range);
+            return false;
+        }
+        char *step_colon = strchr(colon + 1, ':');
+        char *end_text = colon + 1;
+        size_t end_len = step_colon != NULL ? (size_t)(step_colon - end_text) : strlen(end_text);
+
+        Value end;
+        steps[j] = INT_VALUE(1);
+        if (!add_column(range, eq - range)
+            || !parse_number(eq + 1, colon - eq - 1, &starts[j])
+            || !parse_number(end_text, end_len, &end)
+            || (step_colon != NULL && !parse_number(step_colon + 1, strlen(step_colon + 1), &steps[j])))
+        {
+            return false;
+        }
+
+        double step = value_as_double(steps[j]);
+        double span = value_as_double(end) - value_as_double(starts[j]);
+        if (step == 0) {
+            fprintf(stderr, "The step of '%s' is 0.\n", range);
+            return false;
+        }
+
+        if (span / step < 0) lengths[j] = 0;
+        else if (starts[j].type == VAL_INT && end.type == VAL_INT && steps[j].type == VAL_INT) lengths[j] = (int64_t)(span / step) + 1;
+        else lengths[j] = (int64_t)(span / step + 1e-9) + 1; // 0:1:0.1 ends at 1, despite the rounding
+
+        if (lengths[j] > INT_MAX || (rows *= lengths[j]) > INT_MAX / count) {
+            fprintf(stderr, "Too many inputs to sweep.\n");
+            return false;
+        }
+    }
+
+    inputs.rows = rows;
+    inputs.values = GROW_ARRAY(Value, NULL, rows * count + 1);
+
+    for (int i = 0; i < rows; i++)
+    {
+        int64_t rest = i;
+        for (int j = count - 1; j >= 0; j--)
+        {
+            int64_t k = rest % lengths[j];
+            rest /= lengths[j];
+
+            Value *value = &inputs.values[i * count + j];
+            if (starts[j].type == VAL_INT && steps[j].type == VAL_INT) {
+                *value = INT_VALUE(starts[j].i + k * steps[j].i);
+            } else {
+                *value = DOUBLE_VALUE(value_as_double(starts[j]) + k * value_as_double(steps[j]));
+            }
+        }
+    }
+
+    return true;
+}
+
+// The first line names the variables, each of the others is an input. Empty lines are skipped.
+static bool read_csv(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Unable to open file '%s'.\n", path);
+        return false;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int line_num = 0;
+    int capacity = 0;
+    bool ok = true;
+
+    while (ok && (len = getline(&line, &cap, file)) != -1)
+    {
+        line_num++;
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+        if (len == 0) continue;
+
+        bool header = inputs.cols == 0;
+        if (!header && inputs.rows == INT_MAX / inputs.cols - 1) {
+            fprintf(stderr, "Too many inputs to sweep.\n");
+            ok = false;
+            break;
+        }
+        if (!header && inputs.rows == capacity) {
+            capacity = GROW_CAPACITY(capacity);
+            inputs.values = GROW_ARRAY(Value, inputs.values, (size_t)capacity * inputs.cols);
+        }
+
+        int fields = 0;
+        char *field = line;
+        while (ok)
+        {
+            char *comma = strchr(field, ',');
+            size_t field_len = comma != NULL ? (size_t)(comma - field) : strlen(field);
+
+            // Spaces around a field are ignored
+            while (field_len > 0 && *field == ' ') field++, field_len--;
+            while (field_len > 0 && field[field_len - 1] == ' ') field_len--;
+
+            if (header) {
+                ok = add_column(field, field_len);
+            } else if (fields < inputs.cols) {
+                ok = parse_number(field, field_len, &inputs.values[inputs.rows * inputs.cols + fields]);
+            }
+            fields++;
+
+            if (comma == NULL) break;
+            field = comma + 1;
+        }
+
+        if (ok && !header && fields != inputs.cols) {
+            fprintf(stderr, "Expected %d values, but got %d.\n", inputs.cols, fields);
+            ok = false;
+        }
+        if (!ok) {
+            fprintf(stderr, "In line %d of '%s'.\n", line_num, path);
+            break;
+        }
+        if (!header) inputs.rows++;
+    }
+
+    free(line);
+    fclose(file);
+    return ok;
+}
+
+// A variable of the program, to set in each run
+static bool add_column(const char *name, size_t len)
+{
+    Program *program = inputs.program;
+
+    if (len == 0 || !(isalpha(name[0]) || name[0] == '_') || isupper(name[0])) {
+        fprintf(stderr, "'%.*s' isn't a variable name.\n", (int)len, name);
+        return false;
+    }
+
+    int found = -1;
+    for (int i = 0; i < program->names.size; i++) {
+        Name n = program->names.data[i];
+        if ((size_t)n.len == len && memcmp(&program->text[n.start], name, len) == 0) found = i;
+    }
+    if (found == -1) {
+        fprintf(stderr, "The program doesn't use the variable '%.*s'.\n", (int)len, name);
+        return false;
+    }
+    for (int j = 0; j < inputs.cols; j++) {
+        if (inputs.names[j] == found) {
+            fprintf(stderr, "The variable '%.*s' is swept twice.\n", (int)len, name);
+            return false;
+        }
+    }
+
+    inputs.names = GROW_ARRAY(int, inputs.names, inputs.cols + 1);
+    inputs.names[inputs.cols++] = found;
+    return true;
+}
+
+/* The program is verified once, with the variables swept declared, since it doesn't depend on their values.
+Its errors are printed once, instead of by every run. */
+static bool verify_inputs(void)
+{
+    Program *program = inputs.program;
+    bool *declared = GROW_ARRAY(bool, NULL, program->names.size + 1);
+    memset(declared, 0, sizeof(bool) * (program->names.size + 1));
+    for (int j = 0; j < inputs.cols; j++) declared[inputs.names[j]] = true;
+
+    bool ok = verify_program(program, declared, stdout);
+    FREE_ARRAY(declared);
+    return ok;
+}
+
+// Read like a literal of the program, with a sign
+static bool parse_number(const char *text, size_t len, Value *value)
+{
+    char buffer[len + 1];
+    memcpy(buffer, text, len);
+    buffer[len] = '\0';
+
+    char *end;
+    strtod(buffer, &end);
+    if (len == 0 || *end != '\0' || strpbrk(buffer, "eEnNxX") != NULL) {
+        fprintf(stderr, "'%s' isn't a number.\n", buffer);
+        return false;
+    }
+
+    *value = value_from_literal(buffer, len);
+    return true;
+}
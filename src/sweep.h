@@ -0,0 +1,26 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "parser.h"
+
+/* jis --sweep runs a program once for each input, a setting of some of its variables, on the threads of the scheduler.
+The program is tokenized and optimized once and the runs share it, each with variables of its own,
+set before it starts (an assignment in the program still replaces them).
+
+The inputs are the values of ranges, --sweep name=start:end[:step] with the end included,
+every combination of them when there are more, the first one changing the slowest;
+or the rows of a CSV file, --sweep-csv <path>, whose first line names the variables.
+The output of each run is printed in the order of the inputs, after a line with the input: '--- name=value ---'.
+With --batch, they run in lockstep, BATCH_LANES at a time, if the program can (see batch.h).
+The program is verified once, before any run: if it has errors, they are printed and nothing runs. */
+
+typedef struct SweepSpec {
+    char **ranges; // "name=start:end[:step]"
+    int range_count;
+    char *csv_path; // used instead of the ranges if not NULL
+    bool batch;     // run the inputs in lockstep, see batch.h
+} SweepSpec;
+
+int sweep(Program *program, SweepSpec spec, ExecLimits limits); // the exit status of the first run that fails, or 0
+
+#endif // SWEEP_H
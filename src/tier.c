@@ -0,0 +1,723 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime()
+
+#include "tier.h"
+#include "runtime.h"
+#include "utils.h"
+#include "trace.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+
+/* Loops and tasks run on the tokens until they are hot: a 'while' whose back edge is taken tier_threshold times,
+or a task executed as many times, is compiled then into steps with postfix expressions, run on the same variables
+and values by the same operations, so the output and the errors are the same. The statements run once never pay for it.
+A 'while' promoted at its back edge goes on compiled from there, in place of its frame (on-stack replacement).
+Only assignments, 'print', 'if' and 'while' on variables and numbers are compiled: a region with anything else,
+or with an expression the parser would report as malformed, stays on the tokens. */
+
+typedef enum CodeKind {
+    C_NUMBER,
+    C_VAR,
+    C_ARITHMETIC,
+    C_COMPARISON,
+    C_SHORT,     // the left-hand side of '&&' or '||': if it decides the result, it is it, and the code skips to skip_to
+    C_SHORT_END, // the right-hand side, as the result
+} CodeKind;
+
+typedef struct Code {
+    CodeKind kind;
+    TokType tok_type; // operator
+    int name;         // variable
+    int line;         // of the token the parser would be at, where an error is reported
+    int skip_to;
+    Value value;      // number
+} Code;
+
+typedef enum StepKind {
+    S_ASSIGN,
+    S_PRINT,
+    S_BRANCH,    // the condition of an 'if' or a 'while', to 'target' if false
+    S_JUMP,
+    S_BACK_EDGE, // of a 'while': takes a step and goes to its condition
+    S_END,
+} StepKind;
+
+typedef struct Step {
+    StepKind kind;
+    int64_t token;  // the variable assigned, 'print', or the first token of the condition
+    bool temp;      // assignment: to a temporary of the optimizer, stored as it is
+    bool loop;      // branch: of a 'while'
+    int code_first; // its expression: code[code_first, code_last)
+    int code_last;
+    int target;
+} Step;
+
+DECLARE_ARR(CodeArr, Code)
+DECLARE_ARR(StepArr, Step)
+
+typedef struct Region {
+    RegionKind kind;
+    int64_t start;
+    CodeArr code;
+    StepArr steps;
+    int back_edge;        // loop: the step it goes on from, in place of its frame
+    int64_t end;          // loop: the token after it
+    NumStack stack;       // big enough for any of its expressions
+    const char *rejected; // why it isn't compiled, NULL if it is
+    int64_t nanos;        // spent compiling it
+    int64_t runs;
+} Region;
+
+// The loops and tasks counted, in a hash table by their start
+typedef struct HotSpot {
+    int64_t start;  // -1 if the slot is free
+    int count;
+    Region *region; // NULL until promoted
+} HotSpot;
+
+struct Tier {
+    HotSpot *spots;
+    int cap; // a power of 2
+    int size;
+};
+
+typedef struct PendingOp {
+    Op op;
+    int short_code; // its C_SHORT, -1 if none
+} PendingOp;
+
+DECLARE_ARR(PendingOpArr, PendingOp)
+
+typedef struct RegionCompiler {
+    Region *region;
+    Token *tokens;
+    int64_t size;
+    int64_t cursor;
+    int loops;        // nested in the one being compiled
+    int depth;        // of the stack of the expression
+    PendingOpArr ops;
+    jmp_buf on_reject;
+    const char *reason;
+} RegionCompiler;
+
+// Promotions of the runs so far, merged by free_tier()
+typedef struct TierStat {
+    RegionKind kind;
+    int64_t start;
+    int promotions;
+    int64_t nanos;
+    int64_t runs;
+    const char *rejected;
+} TierStat;
+
+DECLARE_ARR(TierStatArr, TierStat)
+
+static HotSpot *find_hot_spot(int64_t start, bool add);
+static Region *compile_region(int64_t start, RegionKind kind);
+static void reject_region(RegionCompiler *rc, const char *reason);
+static void compile_steps(RegionCompiler *rc);
+static void compile_step(RegionCompiler *rc);
+static int push_step(RegionCompiler *rc, Step step);
+static void compile_expression(RegionCompiler *rc, TokType end, Step *step);
+static void emit_pending_op(RegionCompiler *rc, int line);
+static void push_code(RegionCompiler *rc, Code code, int effect);
+static void run_region(Region *region, int pc);
+static Value run_code(Region *region, Step *step);
+
+int tier_threshold = DEFAULT_TIER_THRESHOLD;
+bool count_tier_stats = false;
+static TierStatArr tier_stats;
+static pthread_mutex_t tier_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local RegionCompiler region_compiler;
+
+/* Counts a back edge of the 'while' at 'start', or a call of the task whose body starts at 'start'.
+Returns its compiled form, compiling it when it becomes hot; NULL if it's still cold, or can't be compiled. */
+Region *count_region(int64_t start, RegionKind kind)
+{
+    if (tier_threshold == 0) return NULL;
+
+    HotSpot *spot = find_hot_spot(start, true);
+    if (spot->region != NULL) return spot->region->rejected == NULL ? spot->region : NULL;
+    if (++spot->count < tier_threshold) return NULL;
+
+    spot->region = compile_region(start, kind);
+    return spot->region->rejected == NULL ? spot->region : NULL;
+}
+
+// Its compiled form, if it's been promoted, without counting
+Region *hot_region(int64_t start)
+{
+    if (parser.tier == NULL) return NULL;
+    HotSpot *spot = find_hot_spot(start, false);
+    return spot != NULL && spot->region != NULL && spot->region->rejected == NULL ? spot->region : NULL;
+}
+
+static HotSpot *find_hot_spot(int64_t start, bool add)
+{
+    Tier *tier = parser.tier;
+    if (tier == NULL) {
+        if (!add) return NULL;
+        tier = parser.tier = reallocate(NULL, sizeof(Tier));
+        *tier = (Tier){0};
+    }
+
+    if (add && (tier->size + 1) * 2 > tier->cap)
+    {
+        HotSpot *old = tier->spots;
+        int old_cap = tier->cap;
+        tier->cap = old_cap == 0 ? 16 : old_cap * 2;
+        tier->spots = GROW_ARRAY(HotSpot, NULL, tier->cap);
+        for (int i = 0; i < tier->cap; i++) tier->spots[i] = (HotSpot){ .start = -1 };
+        for (int i = 0; i < old_cap; i++) {
+            if (old[i].start == -1) continue;
+            int j = (uint32_t)old[i].start * 2654435761u & (tier->cap - 1);
+            while (tier->spots[j].start != -1) j = (j + 1) & (tier->cap - 1);
+            tier->spots[j] = old[i];
+        }
+        FREE_ARRAY(old);
+    }
+    if (tier->cap == 0) return NULL;
+
+    int i = (uint32_t)start * 2654435761u & (tier->cap - 1);
+    while (tier->spots[i].start != start) {
+        if (tier->spots[i].start == -1) {
+            if (!add) return NULL;
+            tier->spots[i] = (HotSpot){ .start = start };
+            tier->size++;
+            break;
+        }
+        i = (i + 1) & (tier->cap - 1);
+    }
+    return &tier->spots[i];
+}
+
+static Region *compile_region(int64_t start, RegionKind kind)
+{
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    Region *region = reallocate(NULL, sizeof(Region));
+    *region = (Region){ .kind = kind, .start = start, .back_edge = -1 };
+    ARR_INIT(&region->code);
+    ARR_INIT(&region->steps);
+    ARR_INIT(&region->stack);
+
+    RegionCompiler *rc = &region_compiler;
+    *rc = (RegionCompiler){ .region = region, .tokens = parser.token_arr.data, .size = parser.token_arr.size, .cursor = start };
+    ARR_INIT(&rc->ops);
+
+    if (setjmp(rc->on_reject) == 0)
+    {
+        if (kind == REGION_LOOP) {
+            compile_step(rc);
+        } else {
+            rc->cursor++; // '{'
+            compile_steps(rc);
+        }
+        push_step(rc, (Step){ .kind = S_END });
+        region->end = rc->cursor;
+    }
+    else
+    {
+        region->rejected = rc->reason;
+        ARR_FREE(&region->code);
+        ARR_FREE(&region->steps);
+        ARR_FREE(&region->stack);
+    }
+    ARR_FREE(&rc->ops);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    region->nanos = (int64_t)(t1.tv_sec - t0.tv_sec) * 1000000000 + (t1.tv_nsec - t0.tv_nsec);
+    return region;
+}
+
+static void reject_region(RegionCompiler *rc, const char *reason)
+{
+    rc->reason = reason;
+    longjmp(rc->on_reject, 1);
+}
+
+// The statements up to the '}' that closes the block, consumed
+static void compile_steps(RegionCompiler *rc)
+{
+    while (rc->cursor < rc->size && rc->tokens[rc->cursor].type != TOK_CBRACE) {
+        compile_step(rc);
+    }
+    if (rc->cursor >= rc->size) reject_region(rc, "a block isn't closed");
+    rc->cursor++;
+}
+
+static void compile_step(RegionCompiler *rc)
+{
+    Token *t = rc->tokens;
+    StepArr *steps = &rc->region->steps;
+    int64_t at = rc->cursor;
+
+    switch (t[at].type)
+    {
+    case TOK_VAR:
+    {
+        if (at + 1 >= rc->size || t[at + 1].type != TOK_ASSIGN) reject_region(rc, "it stores an array element");
+        Step step = { .kind = S_ASSIGN, .token = at, .temp = TOKEN_TEXT(parser.program, t[at])[0] == '$' };
+        rc->cursor += 2;
+        compile_expression(rc, TOK_SEMICOLON, &step);
+        push_step(rc, step);
+        break;
+    }
+    case TOK_PRINT:
+    {
+        Step step = { .kind = S_PRINT, .token = at };
+        rc->cursor++;
+        compile_expression(rc, TOK_SEMICOLON, &step);
+        push_step(rc, step);
+        break;
+    }
+    case TOK_IF:
+    {
+        Step branch = { .kind = S_BRANCH, .token = at + 1 };
+        rc->cursor++;
+        compile_expression(rc, TOK_OBRACE, &branch);
+        int b = push_step(rc, branch);
+        compile_steps(rc);
+
+        if (rc->cursor < rc->size && t[rc->cursor].type == TOK_ELSE) {
+            int j = push_step(rc, (Step){ .kind = S_JUMP });
+            steps->data[b].target = steps->size;
+            if (rc->cursor + 1 >= rc->size || t[rc->cursor + 1].type != TOK_OBRACE) reject_region(rc, "it has errors");
+            rc->cursor += 2; // 'else' and '{'
+            compile_steps(rc);
+            steps->data[j].target = steps->size;
+        } else {
+            steps->data[b].target = steps->size;
+        }
+        break;
+    }
+    case TOK_WHILE:
+    {
+        Step branch = { .kind = S_BRANCH, .token = at + 1, .loop = true };
+        rc->cursor++;
+        compile_expression(rc, TOK_OBRACE, &branch);
+        int b = push_step(rc, branch);
+
+        rc->loops++;
+        compile_steps(rc);
+        rc->loops--;
+
+        int back = push_step(rc, (Step){ .kind = S_BACK_EDGE, .token = at + 1, .target = b });
+        if (rc->loops == 0 && rc->region->back_edge == -1) rc->region->back_edge = back;
+        steps->data[b].target = steps->size;
+        break;
+    }
+    case TOK_EXEC_TASK:
+        reject_region(rc, "it executes a task");
+        break;
+    case TOK_SPAWN:
+    case TOK_WAIT:
+        reject_region(rc, "it spawns or waits for tasks");
+        break;
+    default:
+        reject_region(rc, "it has errors");
+        break;
+    }
+}
+
+static int push_step(RegionCompiler *rc, Step step)
+{
+    ARR_PUSH(&rc->region->steps, step, Step);
+    return rc->region->steps.size - 1;
+}
+
+/* Same precedence parsing of parse_expression(), emitting the operators when it would perform them,
+with the line of the token it would be at. Up to 'end', consumed. */
+static void compile_expression(RegionCompiler *rc, TokType end, Step *step)
+{
+    Token *t = rc->tokens;
+    Region *region = rc->region;
+    int prec_lvl = 0;
+    rc->depth = 0;
+    rc->ops.size = 0;
+    step->code_first = region->code.size;
+
+    while (1)
+    {
+        if (rc->cursor >= rc->size) reject_region(rc, "it has errors");
+        Token token = t[rc->cursor];
+        if (token.type == end) break;
+
+        if (token.type == TOK_NUMBER || token.type == TOK_VAR)
+        {
+            if (token.type == TOK_VAR && rc->cursor + 1 < rc->size && t[rc->cursor + 1].type == TOK_OBRACKET) {
+                reject_region(rc, "it uses arrays");
+            }
+            Code code = { .kind = token.type == TOK_NUMBER ? C_NUMBER : C_VAR, .name = token.name, .value = token.value };
+            push_code(rc, code, 1);
+            rc->cursor++;
+            continue;
+        }
+        if (token.type == TOK_OBRACKET || (token.type >= TOK_SUM && token.type <= TOK_FILL)) {
+            reject_region(rc, "it uses arrays");
+        }
+
+        Op op = get_op_from_OpTable(token.type);
+        if (op.prec == 0) reject_region(rc, "it has errors");
+
+        if (op.tok_type == TOK_OPAREN || op.tok_type == TOK_CPAREN) {
+            prec_lvl += op.tok_type == TOK_OPAREN ? 1 : -1;
+            if (prec_lvl < 0) reject_region(rc, "it has errors");
+            rc->cursor++;
+            continue;
+        }
+
+        op.prec += MAX_PREC * prec_lvl;
+        while (rc->ops.size > 0 && rc->ops.data[rc->ops.size - 1].op.prec >= op.prec) {
+            emit_pending_op(rc, token.line);
+        }
+
+        PendingOp pending = { op, -1 };
+        if (op.family == LOGICAL && rc->depth > 0) {
+            pending.short_code = region->code.size;
+            push_code(rc, (Code){ .kind = C_SHORT, .tok_type = op.tok_type }, 0);
+        }
+        ARR_PUSH(&rc->ops, pending, PendingOp);
+        rc->cursor++;
+    }
+
+    // The terminator is consumed before the last operators are performed
+    int line = rc->cursor + 1 < rc->size ? t[rc->cursor + 1].line : 0;
+    while (rc->ops.size > 0) {
+        emit_pending_op(rc, line);
+    }
+    if (prec_lvl != 0 || rc->depth > 1) reject_region(rc, "it has errors");
+
+    step->code_last = region->code.size;
+    rc->cursor++;
+}
+
+static void emit_pending_op(RegionCompiler *rc, int line)
+{
+    PendingOp pending = rc->ops.data[--rc->ops.size];
+    if (rc->depth < 2) reject_region(rc, "it has errors");
+
+    if (pending.short_code != -1) {
+        push_code(rc, (Code){ .kind = C_SHORT_END }, -1);
+        rc->region->code.data[pending.short_code].skip_to = rc->region->code.size;
+        return;
+    }
+
+    Code code = { .tok_type = pending.op.tok_type, .line = line };
+    switch (pending.op.family)
+    {
+    case ARITHMETIC:
+        code.kind = C_ARITHMETIC;
+        break;
+    case COMPARISON:
+        code.kind = C_COMPARISON;
+        break;
+    default:
+        reject_region(rc, "it has errors"); // a logical operator without a left-hand side
+        break;
+    }
+    push_code(rc, code, -1);
+}
+
+// 'effect' is on the depth of the stack
+static void push_code(RegionCompiler *rc, Code code, int effect)
+{
+    Region *region = rc->region;
+    ARR_PUSH(&region->code, code, Code);
+    rc->depth += effect;
+
+    if (rc->depth >= region->stack.cap) {
+        region->stack.cap = rc->depth + 1;
+        region->stack.data = GROW_ARRAY(Value, region->stack.data, region->stack.cap);
+    }
+}
+
+// Continues after the loop, at 'scope'
+void run_loop_region(Region *region, bool from_back_edge, int scope)
+{
+    run_region(region, from_back_edge ? region->back_edge : 0);
+    jump(region->end, scope);
+}
+
+void run_task_region(Region *region, Token name)
+{
+    (void)name; // traced only
+    TRACE3(task__enter, name.line, TOKEN_TEXT(parser.program, name), name.len);
+    run_region(region, 0);
+    TRACE3(task__exit, name.line, TOKEN_TEXT(parser.program, name), name.len);
+}
+
+// Until its S_END, or until its loop ends when 'pc' is the back edge
+static void run_region(Region *region, int pc)
+{
+    Step *steps = region->steps.data;
+    Token *tokens = parser.token_arr.data;
+    Token s_token = parser.token;
+    region->runs++;
+
+    while (1)
+    {
+        Step *step = &steps[pc];
+        switch (step->kind)
+        {
+        case S_ASSIGN:
+        {
+            Value val = run_code(region, step);
+            Variable *var = &variables.data[tokens[step->token].name];
+            COUNT(stores);
+            if (var->value.type == VAL_ARRAY) release_value(var->value);
+            var->declared = true;
+            var->written = true;
+            var->value = step->temp || numeric_model == NUM_TAGGED ? val : value_result(val);
+            TRACE3(var__store, tokens[step->token].line, TOKEN_TEXT(parser.program, tokens[step->token]), tokens[step->token].len);
+            pc++;
+            break;
+        }
+        case S_PRINT:
+        {
+            TRACE1(print, tokens[step->token].line);
+            Value val = run_code(region, step);
+            print_value(parser.out, value_result(val));
+            release_value(val);
+            check_output();
+            pc++;
+            break;
+        }
+        case S_BRANCH:
+        {
+            Value val = value_result(run_code(region, step));
+            bool res = value_is_true(val);
+            release_value(val);
+            if (!res) {
+                pc = step->target;
+                break;
+            }
+            if (step->loop) {
+                COUNT(iterations);
+                TRACE1(while__iteration, tokens[step->token].line);
+            }
+            pc++;
+            break;
+        }
+        case S_JUMP:
+            pc = step->target;
+            break;
+        case S_BACK_EDGE:
+            parser.token.line = tokens[step->token].line; // of the condition, if the budget runs out
+            take_step();
+            pc = step->target;
+            break;
+        case S_END:
+            parser.token = s_token;
+            return;
+        }
+    }
+}
+
+static Value run_code(Region *region, Step *step)
+{
+    Code *codes = region->code.data;
+    NumStack *stack = &region->stack;
+    stack->size = 0;
+    COUNT(expressions);
+
+    // A variable, or a variable and a number, the most common expressions: on integers, without the stack
+    if (numeric_model == NUM_TAGGED && codes[step->code_first].kind == C_VAR)
+    {
+        Code *code = &codes[step->code_first];
+        Value l_val = variables.data[code->name].value;
+        if (step->code_last - step->code_first == 1 && l_val.type != VAL_ARRAY) {
+            COUNT(loads);
+            return l_val;
+        }
+
+        Value r_val = code[1].value;
+        int64_t n;
+        if (step->code_last - step->code_first == 3 && l_val.type == VAL_INT && code[1].kind == C_NUMBER && r_val.type == VAL_INT)
+        {
+            bool res;
+            bool done = code[2].kind == C_COMPARISON;
+            switch (done ? code[2].tok_type : TOK_EQ)
+            {
+            case TOK_LT: res = l_val.i < r_val.i; break;
+            case TOK_GT: res = l_val.i > r_val.i; break;
+            case TOK_LE: res = l_val.i <= r_val.i; break;
+            case TOK_GE: res = l_val.i >= r_val.i; break;
+            default: done = false; break;
+            }
+            if (done) {
+                COUNT(loads);
+                COUNT(comparison);
+                return INT_VALUE(res);
+            }
+            if (code[2].kind == C_ARITHMETIC && (code[2].tok_type == TOK_PLUS ? !__builtin_add_overflow(l_val.i, r_val.i, &n)
+                : code[2].tok_type == TOK_MINUS && !__builtin_sub_overflow(l_val.i, r_val.i, &n)))
+            {
+                COUNT(loads);
+                COUNT(arithmetic);
+                return INT_VALUE(n);
+            }
+        }
+    }
+
+    for (int i = step->code_first; i < step->code_last; i++)
+    {
+        Code *code = &codes[i];
+        switch (code->kind)
+        {
+        case C_NUMBER:
+            stack->data[stack->size++] = code->value;
+            break;
+        case C_VAR:
+        {
+            Value val = variables.data[code->name].value;
+            COUNT(loads);
+            if (val.type == VAL_ARRAY) retain_value(val);
+            stack->data[stack->size++] = val;
+            break;
+        }
+        case C_ARITHMETIC:
+        {
+            // The fast path of perform_arithmetic_op(), without the stack of the parser
+            Value *l_val = &stack->data[stack->size - 2], *r_val = l_val + 1;
+            int64_t n;
+            COUNT(arithmetic);
+            if (l_val->type == VAL_INT && r_val->type == VAL_INT && numeric_model == NUM_TAGGED && code->tok_type != TOK_SLASH
+                && !(code->tok_type == TOK_PLUS ? __builtin_add_overflow(l_val->i, r_val->i, &n)
+                     : code->tok_type == TOK_MINUS ? __builtin_sub_overflow(l_val->i, r_val->i, &n)
+                     : __builtin_mul_overflow(l_val->i, r_val->i, &n)))
+            {
+                l_val->i = n;
+                stack->size--;
+                break;
+            }
+            parser.token.line = code->line;
+            perform_arithmetic_op(stack, code->tok_type);
+            break;
+        }
+        case C_COMPARISON:
+        {
+            Value *l_val = &stack->data[stack->size - 2], *r_val = l_val + 1;
+            COUNT(comparison);
+            if (l_val->type == VAL_INT && r_val->type == VAL_INT && numeric_model == NUM_TAGGED)
+            {
+                int64_t l_num = l_val->i, r_num = r_val->i;
+                bool res = false;
+                switch (code->tok_type)
+                {
+                case TOK_LT: res = l_num < r_num; break;
+                case TOK_GT: res = l_num > r_num; break;
+                case TOK_LE: res = l_num <= r_num; break;
+                case TOK_GE: res = l_num >= r_num; break;
+                case TOK_EQ: res = l_num == r_num; break;
+                case TOK_NE: res = l_num != r_num; break;
+                default:
+                    assert("Unreachable" && false);
+                    break;
+                }
+                *l_val = value_from_bool(res);
+                stack->size--;
+                break;
+            }
+            parser.token.line = code->line;
+            perform_comparison_op(stack, code->tok_type);
+            break;
+        }
+        case C_SHORT:
+        {
+            Value *lhs = &stack->data[stack->size - 1];
+            bool res = value_is_true(*lhs);
+            release_value(*lhs);
+            if ((code->tok_type == TOK_AND && !res) || (code->tok_type == TOK_OR && res)) {
+                COUNT(logical);
+                *lhs = value_from_bool(res);
+                i = code->skip_to - 1;
+            } else {
+                stack->size--;
+            }
+            break;
+        }
+        case C_SHORT_END:
+        {
+            Value *rhs = &stack->data[stack->size - 1];
+            COUNT(logical);
+            bool res = value_is_true(*rhs);
+            release_value(*rhs);
+            *rhs = value_from_bool(res);
+            break;
+        }
+        }
+    }
+
+    // An empty expression is 0, like in parse_expression()
+    return stack->size > 0 ? stack->data[--stack->size] : INT_VALUE(0);
+}
+
+// The run ends: what it promoted is added to the stats
+void free_tier(Tier *tier)
+{
+    if (tier == NULL) return;
+
+    if (count_tier_stats) pthread_mutex_lock(&tier_stats_lock);
+    for (int i = 0; i < tier->cap; i++)
+    {
+        Region *region = tier->spots[i].region;
+        if (region == NULL) continue;
+
+        if (count_tier_stats) {
+            int s = 0;
+            while (s < tier_stats.size && tier_stats.data[s].start != region->start) s++;
+            if (s == tier_stats.size) {
+                ARR_PUSH(&tier_stats, ((TierStat){ .kind = region->kind, .start = region->start, .rejected = region->rejected }), TierStat);
+            }
+            tier_stats.data[s].promotions++;
+            tier_stats.data[s].nanos += region->nanos;
+            tier_stats.data[s].runs += region->runs;
+        }
+
+        ARR_FREE(&region->code);
+        ARR_FREE(&region->steps);
+        ARR_FREE(&region->stack);
+        reallocate(region, 0);
+    }
+    if (count_tier_stats) pthread_mutex_unlock(&tier_stats_lock);
+
+    FREE_ARRAY(tier->spots);
+    reallocate(tier, 0);
+}
+
+static int compare_tier_stats(const void *a, const void *b)
+{
+    int64_t diff = ((const TierStat *)a)->start - ((const TierStat *)b)->start;
+    return (diff > 0) - (diff < 0);
+}
+
+// In the order of the program
+void print_tier_stats(Program *program, FILE *out)
+{
+    Token *tokens = program->tokens.data;
+    if (tier_stats.size == 0) fprintf(out, "Nothing was promoted.\n");
+    else qsort(tier_stats.data, tier_stats.size, sizeof(TierStat), compare_tier_stats);
+
+    for (int i = 0; i < tier_stats.size; i++)
+    {
+        TierStat *stat = &tier_stats.data[i];
+        if (stat->kind == REGION_LOOP) {
+            fprintf(out, "line %d, while: ", tokens[stat->start].line);
+        } else {
+            Token name = tokens[stat->start - 1];
+            fprintf(out, "line %d, task %.*s: ", name.line, name.len, TOKEN_TEXT(program, name));
+        }
+
+        const char *counted = stat->kind == REGION_LOOP ? "back edges" : "calls";
+        if (stat->rejected != NULL) {
+            fprintf(out, "hot after %d %s, but not compiled: %s\n", tier_threshold, counted, stat->rejected);
+            continue;
+        }
+        fprintf(out, "promoted after %d %s, compiled in %.1f us", tier_threshold, counted, stat->nanos / 1000.0);
+        if (stat->promotions > 1) fprintf(out, " (in %d runs)", stat->promotions);
+        fprintf(out, ", then run %" PRId64 " times\n", stat->runs);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef TIER_H
+#define TIER_H
+
+#include "tokenizer.h"
+
+/* Loops and tasks run on the tokens, until a 'while' takes its back edge, or a task is executed, tier_threshold times:
+then they are compiled (see tier.c). 0 never compiles them. --tier-stats reports them. */
+#define DEFAULT_TIER_THRESHOLD 1000
+extern int tier_threshold;
+extern bool count_tier_stats;
+void print_tier_stats(Program *program, FILE *out);
+
+// What tiered execution compiles, once it's hot
+typedef enum RegionKind {
+    REGION_LOOP, // starts at 'while'
+    REGION_TASK, // starts at the '{' of the body
+} RegionKind;
+
+typedef struct Region Region;
+typedef struct Tier Tier; // parser.tier, the regions of the run
+
+Region *count_region(int64_t start, RegionKind kind);
+Region *hot_region(int64_t start);
+void run_loop_region(Region *region, bool from_back_edge, int scope);
+void run_task_region(Region *region, Token name);
+void free_tier(Tier *tier);
+
+#endif // TIER_H
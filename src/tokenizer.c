@@ -1,32 +1,176 @@
 #include "tokenizer.h"
+#include "trace.h"
 #include "utils.h"
 
+#include <limits.h>
+
 static void advance(void);
 static char look_ahead(void);
 
 static bool is_digit(char c);
 static bool is_alpha(char c);
 static bool is_upp(char c);
+static bool is_number_part(char c);
+static bool is_identifier_part(char c);
 
 static int get_number_len(bool *error);
-static int get_identifier_len(void);
-
+static int get_identifier_len(bool *error);
+static void check_token_len(int len, bool (*is_part)(char), bool *error);
+static char next_char(void);
+static bool starts_statement(TokType prev);
+
+static void lex(Program *program, TokenArr *ta, bool *error);
+static int64_t find_token(Program *program, size_t offset);
+static int count_lines(Program *program, size_t from, size_t to);
 static void create_token(Token *token, TokType type, int len);
+static void lex_error(bool *error);
+static void grow_name_slots(Program *program);
 static char *tok_type_to_string(TokType tt);
 
-// I have no reason for now to change this variable from being a global one.
-Tokenizer tokenizer;
+// Each thread tokenizes its own program (the requests of the server)
+_Thread_local Tokenizer tokenizer;
 
 void init_tokenizer(char *source_code)
 {
     tokenizer.source_code = source_code;
+    tokenizer.len = strlen(source_code);
     tokenizer.cursor = -1;
     tokenizer.line = 1;
     tokenizer.ch = 0;
+    tokenizer.out = stdout;
+    tokenizer.prev = TOK_SEMICOLON;
     advance();
 }
 
-void collect_tokens(TokenArr *ta, bool *error)
+void collect_tokens(Program *program, bool *error)
+{
+    TRACE1(tokenize__start, tokenizer.len);
+    lex(program, &program->tokens, error);
+    TRACE1(tokenize__end, program->tokens.size);
+}
+
+/* Replaces the bytes [start, end) of the source code with text.
+Tokens don't span lines, so only the lines touched by the edit are lexed again;
+the tokens and the names after them are moved by the difference in bytes and lines.
+That move, and the one of the text, are linear in the size of the program, but they are plain loops, with no lexing.
+Lexing errors of those lines are printed and reported in error. */
+TokenEdit edit_program(Program *program, size_t start, size_t end, const char *text, size_t len, bool *error)
+{
+    char *src = program->text;
+    assert(start <= end && end <= program->source_len);
+
+    // The lines touched by the edit: [line_from, line_to)
+    size_t line_from = start;
+    while (line_from > 0 && src[line_from - 1] != '\n') line_from--;
+    size_t line_to = end;
+    while (line_to < program->source_len && src[line_to] != '\n') line_to++;
+    if (line_to < program->source_len) line_to++; // with its '\n'
+
+    TokenEdit edit;
+    edit.first = find_token(program, line_from);
+    edit.removed = find_token(program, line_to) - edit.first;
+
+    int line = edit.first > 0
+        ? program->tokens.data[edit.first - 1].line + count_lines(program, program->tokens.data[edit.first - 1].start, line_from)
+        : 1 + count_lines(program, 0, line_from);
+    int old_lines = count_lines(program, line_from, line_to);
+
+    /* A name refers to the text of its first occurrence:
+    if the edit overwrites it, the name is copied after the source code, with the text of the optimizer. */
+    for (int i = 0; i < program->names.size; i++)
+    {
+        Name *name = &program->names.data[i];
+        if (name->start < end && name->start + name->len > start) {
+            program->text = GROW_ARRAY(char, program->text, program->text_len + name->len);
+            memcpy(&program->text[program->text_len], &program->text[name->start], name->len);
+            name->start = program->text_len;
+            program->text_len += name->len;
+        }
+    }
+
+    // Everything after the edit is moved, the '\0' and the appended text included
+    long delta = (long)len - (long)(end - start);
+    if (delta > 0) {
+        program->text = GROW_ARRAY(char, program->text, program->text_len + delta);
+    }
+    memmove(&program->text[end + delta], &program->text[end], program->text_len - end);
+    memcpy(&program->text[start], text, len);
+    program->text_len += delta;
+    program->source_len += delta;
+    line_to += delta;
+
+    for (int i = 0; i < program->names.size; i++) {
+        if (program->names.data[i].start >= end) program->names.data[i].start += delta;
+    }
+
+    // Lex the touched lines again
+    TokenArr lexed;
+    ARR_INIT(&lexed);
+    tokenizer.source_code = program->text;
+    tokenizer.len = line_to;
+    tokenizer.cursor = (int64_t)line_from - 1;
+    tokenizer.line = line;
+    tokenizer.ch = 0;
+    tokenizer.prev = edit.first > 0 ? program->tokens.data[edit.first - 1].type : TOK_SEMICOLON;
+    advance();
+    lex(program, &lexed, error);
+    edit.added = lexed.size;
+    edit.lexed_from = line_from;
+    edit.lexed_to = line_to;
+    edit.delta = delta;
+
+    // Splice them in, and move the tokens after them
+    int line_delta = count_lines(program, line_from, line_to) - old_lines;
+    int64_t tail = program->tokens.size - (edit.first + edit.removed);
+    int64_t new_size = program->tokens.size - edit.removed + edit.added;
+    if (new_size > program->tokens.cap) {
+        program->tokens.cap = new_size;
+        program->tokens.data = GROW_ARRAY(Token, program->tokens.data, new_size);
+    }
+
+    Token *tokens = program->tokens.data;
+    memmove(&tokens[edit.first + edit.added], &tokens[edit.first + edit.removed], sizeof(Token) * tail);
+    if (edit.added > 0) {
+        memcpy(&tokens[edit.first], lexed.data, sizeof(Token) * edit.added);
+    }
+    for (int64_t i = edit.first + edit.added; i < new_size; i++) {
+        tokens[i].start += delta;
+        tokens[i].line += line_delta;
+    }
+    program->tokens.size = new_size;
+
+    // A 'wait;' right after the edit is a keyword only if a statement starts there now: it's replaced too if it changed
+    int64_t next = edit.first + edit.added;
+    if (next + 1 < new_size && match("wait", TOKEN_TEXT(program, tokens[next]), tokens[next].len)
+        && tokens[next + 1].type == TOK_SEMICOLON && tokens[next + 1].line == tokens[next].line)
+    {
+        TokType prev = next > 0 ? tokens[next - 1].type : TOK_SEMICOLON;
+        TokType type = starts_statement(prev) ? TOK_WAIT : TOK_VAR;
+        int name = type == TOK_VAR ? intern_name(program, tokens[next].start, tokens[next].len) : -1;
+        if (type != tokens[next].type && (type == TOK_WAIT || name != -1)) {
+            tokens[next].type = type;
+            tokens[next].name = name;
+            edit.removed++;
+            edit.added++;
+        }
+    }
+
+    ARR_FREE(&lexed);
+    return edit;
+}
+
+void record_lex_errors(OffsetArr *errors)
+{
+    tokenizer.errors = errors;
+}
+
+// After init_tokenizer(), which prints them to stdout
+void print_lex_errors(FILE *out)
+{
+    tokenizer.out = out;
+}
+
+static void lex(Program *program, TokenArr *ta, bool *error)
 {
     while (tokenizer.ch != '\0') // eof
     {
@@ -40,6 +184,15 @@ void collect_tokens(TokenArr *ta, bool *error)
         case ')':
             create_token(&token, TOK_CPAREN, 1);
             break;
+        case '[':
+            create_token(&token, TOK_OBRACKET, 1);
+            break;
+        case ']':
+            create_token(&token, TOK_CBRACKET, 1);
+            break;
+        case ',':
+            create_token(&token, TOK_COMMA, 1);
+            break;
 
         case '+':
             create_token(&token, TOK_PLUS, 1);
@@ -52,7 +205,7 @@ void collect_tokens(TokenArr *ta, bool *error)
             break;
         case '/': {
             if (look_ahead() == '/') {
-                while (look_ahead() != '\n') advance();
+                while (look_ahead() != '\n' && look_ahead() != '\0') advance();
             } else {
                 create_token(&token, TOK_SLASH, 1);
             }
@@ -63,8 +216,8 @@ void collect_tokens(TokenArr *ta, bool *error)
                 advance();
                 create_token(&token, TOK_NE, 2);
             } else {
-                printf("Line %d: error: unknown token '%c'.\n", tokenizer.line, tokenizer.ch);
-                *error = true;
+                fprintf(tokenizer.out, "Line %d: error: unknown token '%c'.\n", tokenizer.line, tokenizer.ch);
+                lex_error(error);
             }
         } break;
         
@@ -120,6 +273,11 @@ void collect_tokens(TokenArr *ta, bool *error)
             break;
 
        case '\n':
+            if (tokenizer.line == INT_MAX) {
+                fprintf(tokenizer.out, "Line %d: error: too many lines.\n", tokenizer.line);
+                lex_error(error);
+                return;
+            }
             tokenizer.line++;
             break;
 
@@ -133,11 +291,14 @@ void collect_tokens(TokenArr *ta, bool *error)
             if (is_digit(tokenizer.ch) || tokenizer.ch == '.') {
                 int num_len = get_number_len(error);
                 create_token(&token, TOK_NUMBER, num_len);
+
+                // Literals are converted once, not each time they are evaluated
+                token.value = value_from_literal(&tokenizer.source_code[token.start], num_len);
             } 
             else if (is_alpha(tokenizer.ch) || tokenizer.ch == '_') 
             {
                 char *start = &tokenizer.source_code[tokenizer.cursor];
-                int len = get_identifier_len();
+                int len = get_identifier_len(error);
 
                 TokType type = TOK_VAR;
 
@@ -147,12 +308,28 @@ void collect_tokens(TokenArr *ta, bool *error)
                 else if (match("print", start, len)) type = TOK_PRINT;
                 else if (match("exec", start, len)) type = TOK_EXEC_TASK;
                 else if (is_upp(start[0])) type = TOK_TASK;
+                // Builtins are recognized only when called, so they are still valid variable names
+                else if (match("sum", start, len) && next_char() == '(') type = TOK_SUM;
+                else if (match("min", start, len) && next_char() == '(') type = TOK_MIN;
+                else if (match("max", start, len) && next_char() == '(') type = TOK_MAX;
+                else if (match("len", start, len) && next_char() == '(') type = TOK_LEN;
+                else if (match("fill", start, len) && next_char() == '(') type = TOK_FILL;
+                // The same for 'spawn Task;', and for 'wait;' where a statement starts ('print wait;' reads a variable)
+                else if (match("spawn", start, len) && is_upp(next_char())) type = TOK_SPAWN;
+                else if (match("wait", start, len) && next_char() == ';' && starts_statement(tokenizer.prev)) type = TOK_WAIT;
 
                 create_token(&token, type, len);
+                if (type == TOK_VAR || type == TOK_TASK) {
+                    token.name = intern_name(program, token.start, len);
+                    if (token.name == -1) {
+                        fprintf(tokenizer.out, "Line %d: error: more than %d names.\n", tokenizer.line, MAX_NAMES);
+                        lex_error(error);
+                    }
+                }
 
             } else {
-                printf("Line %d: error: unknown token starting with '%c'.\n", tokenizer.line, tokenizer.ch);
-                *error = true;
+                fprintf(tokenizer.out, "Line %d: error: unknown token starting with '%c'.\n", tokenizer.line, tokenizer.ch);
+                lex_error(error);
             }
         } break;
         }
@@ -160,23 +337,112 @@ void collect_tokens(TokenArr *ta, bool *error)
         advance();
         
         // Skip ' ', '\t', '\n', '\0'
-        if (token.start != NULL) {
+        if (token.len > 0) {
             ARR_PUSH(ta, token, Token);
+            tokenizer.prev = token.type;
         }
     }
 }
 
+static void lex_error(bool *error)
+{
+    *error = true;
+    if (tokenizer.errors != NULL) {
+        ARR_PUSH(tokenizer.errors, (size_t)tokenizer.cursor, size_t);
+    }
+}
+
+// Index of the first token starting at offset or after it
+static int64_t find_token(Program *program, size_t offset)
+{
+    int64_t lo = 0, hi = program->tokens.size;
+    while (lo < hi) {
+        int64_t mid = lo + (hi - lo) / 2;
+        if (program->tokens.data[mid].start < offset) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int count_lines(Program *program, size_t from, size_t to)
+{
+    int lines = 0;
+    for (size_t i = from; i < to; i++) {
+        if (program->text[i] == '\n') lines++;
+    }
+    return lines;
+}
+
 static void create_token(Token *token, TokType type, int len)
 {
-    token->start = &tokenizer.source_code[tokenizer.cursor - (len-1)];
+    token->start = tokenizer.cursor - (len-1);
     token->len = len;
     token->type = type;
     token->line = tokenizer.line;
+    token->name = -1;
+}
+
+/* Names are interned in an open-addressing hash table.
+A slot holds the index of a name in program->names, or -1 if empty. */
+int intern_name(Program *program, size_t start, int len)
+{
+    // At MAX_NAMES, the table is half full: it only has to find the names already there
+    if (program->names.size + 1 > program->name_slots_cap / 2 && program->names.size < MAX_NAMES) {
+        grow_name_slots(program);
+    }
+
+    char *text = &program->text[start];
+    size_t mask = program->name_slots_cap - 1;
+    size_t slot = hash_bytes(text, len) & mask;
+
+    while (program->name_slots[slot] != -1)
+    {
+        Name name = program->names.data[program->name_slots[slot]];
+        if (name.len == len && strncmp(&program->text[name.start], text, len) == 0) {
+            return program->name_slots[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (program->names.size == MAX_NAMES) return -1;
+
+    Name name = {start, len};
+    ARR_PUSH(&program->names, name, Name);
+    program->name_slots[slot] = program->names.size - 1;
+    return program->names.size - 1;
+}
+
+static void grow_name_slots(Program *program)
+{
+    int cap = program->name_slots_cap < 64 ? 64 : program->name_slots_cap * 2;
+    while (program->names.size + 1 > cap / 2) cap *= 2;
+
+    FREE_ARRAY(program->name_slots);
+    program->name_slots = GROW_ARRAY(int, NULL, cap);
+    program->name_slots_cap = cap;
+    memset(program->name_slots, -1, sizeof(int) * cap);
+
+    size_t mask = cap - 1;
+    for (int i = 0; i < program->names.size; i++) {
+        Name name = program->names.data[i];
+        size_t slot = hash_bytes(&program->text[name.start], name.len) & mask;
+        while (program->name_slots[slot] != -1) slot = (slot + 1) & mask;
+        program->name_slots[slot] = i;
+    }
+}
+
+void free_program(Program *program)
+{
+    ARR_FREE(&program->tokens);
+    ARR_FREE(&program->names);
+    FREE_ARRAY(program->name_slots);
+    program->name_slots = NULL;
+    program->name_slots_cap = 0;
 }
 
 static void advance(void)
 {
-    if ((size_t)tokenizer.cursor + 1 < strlen(tokenizer.source_code)) {
+    if ((size_t)tokenizer.cursor + 1 < tokenizer.len) {
         tokenizer.cursor++;
         tokenizer.ch = tokenizer.source_code[tokenizer.cursor];
     } else {
@@ -184,15 +450,13 @@ static void advance(void)
     }
 }
 
+// '\0' at the end, even when only a part of the text is lexed
 static char look_ahead(void)
 {
-    int i;
-    if ((size_t)tokenizer.cursor + 1 < strlen(tokenizer.source_code)) {
-        i = tokenizer.cursor + 1;
-    } else {
-        i = tokenizer.cursor; 
+    if ((size_t)tokenizer.cursor + 1 < tokenizer.len) {
+        return tokenizer.source_code[tokenizer.cursor + 1];
     }
-    return tokenizer.source_code[i];
+    return '\0';
 }
 
 static bool is_digit(char c) {
@@ -212,19 +476,20 @@ static int get_number_len(bool *error)
 
     int len = 1;
     int dots = tokenizer.ch == '.' ? 1 : 0;
-    while (is_digit(look_ahead()) || look_ahead() == '.') {
+    while ((is_digit(look_ahead()) || look_ahead() == '.') && len < INT_MAX) {
         if (look_ahead() == '.') dots++;
         len++;
         advance();
     }
+    check_token_len(len, is_number_part, error);
 
     if (tokenizer.ch == '.') {
-        printf("Line %d: '.' at the end of number.\n", tokenizer.line);
-        *error = true;
+        fprintf(tokenizer.out, "Line %d: '.' at the end of number.\n", tokenizer.line);
+        lex_error(error);
     }
     if (dots > 1) {
-        printf("Line %d: more than a single '.' in number.\n", tokenizer.line);
-        *error = true;
+        fprintf(tokenizer.out, "Line %d: more than a single '.' in number.\n", tokenizer.line);
+        lex_error(error);
     }
 
     /* NOTE: With this approach, if a string like '123abc' is encountered, 
@@ -233,21 +498,47 @@ static int get_number_len(bool *error)
     return len;
 }
 
-static int get_identifier_len(void) 
+static int get_identifier_len(bool *error) 
 {
     int len = 1;
-    while (is_alpha(look_ahead()) || look_ahead() == '_' || is_digit(look_ahead())) {
+    while (is_identifier_part(look_ahead()) && len < INT_MAX) {
         len++;
         advance();
     }
+    check_token_len(len, is_identifier_part, error);
     return len;
 }
 
-void print_token(Token token)
+static bool is_number_part(char c) { return is_digit(c) || c == '.'; }
+
+static bool is_identifier_part(char c) { return is_alpha(c) || c == '_' || is_digit(c); }
+
+// Token::len is an int: a longer token is an error, and the rest of it is skipped
+static void check_token_len(int len, bool (*is_part)(char), bool *error)
 {
-    for (int i = 0; i < token.len; i++) {
-        printf("%c", token.start[i]);
-    }
+    if (len < INT_MAX || !is_part(look_ahead())) return;
+
+    fprintf(tokenizer.out, "Line %d: error: token longer than %d characters.\n", tokenizer.line, INT_MAX);
+    lex_error(error);
+    while (is_part(look_ahead())) advance();
+}
+
+// The first char after the identifier ending at the cursor, on the same line
+static char next_char(void)
+{
+    size_t i = tokenizer.cursor + 1;
+    while (i < tokenizer.len && (tokenizer.source_code[i] == ' ' || tokenizer.source_code[i] == '\t')) i++;
+    return i < tokenizer.len ? tokenizer.source_code[i] : '\0';
+}
+
+static bool starts_statement(TokType prev)
+{
+    return prev == TOK_SEMICOLON || prev == TOK_OBRACE || prev == TOK_CBRACE;
+}
+
+void print_token(Program *program, Token token)
+{
+    printf("%.*s", token.len, TOKEN_TEXT(program, token));
     printf(": %s", tok_type_to_string(token.type));
 }
 
@@ -259,6 +550,9 @@ static char *tok_type_to_string(TokType tt)
     case  TOK_CPAREN: return "CLOSE_PAREN";
     case   TOK_OBRACE: return "OPEN_BRACE";
     case  TOK_CBRACE: return "CLOSE_BRACE";
+    case TOK_OBRACKET: return "OPEN_BRACKET";
+    case TOK_CBRACKET: return "CLOSE_BRACKET";
+    case    TOK_COMMA: return "COMMA";
 
     case         TOK_PLUS: return "PLUS";
     case        TOK_MINUS: return "MINUS";
@@ -285,6 +579,13 @@ static char *tok_type_to_string(TokType tt)
     case      TOK_PRINT: return "PRINT";
     case TOK_TASK: return "PROC_NAME";
     case TOK_EXEC_TASK: return "EXEC_PROC";
+    case        TOK_SUM: return "SUM";
+    case        TOK_MIN: return "MIN";
+    case        TOK_MAX: return "MAX";
+    case        TOK_LEN: return "LEN";
+    case       TOK_FILL: return "FILL";
+    case      TOK_SPAWN: return "SPAWN";
+    case       TOK_WAIT: return "WAIT";
     
     case      TOK_SEMICOLON: return "SEMICOLON";
         
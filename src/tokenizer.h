@@ -2,12 +2,15 @@
 #define TOKENIZER_H
 
 #include "utils.h"
+#include "value.h"
 
 typedef enum TokType 
 {
-    // (), {}
+    // (), {}, [], ','
     TOK_OPAREN, TOK_CPAREN,
     TOK_CBRACE,
+    TOK_OBRACKET, TOK_CBRACKET,
+    TOK_COMMA,
     
     // +, -, *, /
     TOK_PLUS, TOK_MINUS, 
@@ -31,6 +34,12 @@ typedef enum TokType
 
     // if, else, while, print
     TOK_IF, TOK_ELSE, TOK_WHILE, TOK_EXEC_TASK, TOK_PRINT, 
+
+    // sum(), min(), max(), len(), fill()
+    TOK_SUM, TOK_MIN, TOK_MAX, TOK_LEN, TOK_FILL,
+
+    // spawn, wait
+    TOK_SPAWN, TOK_WAIT,
     
     // my_var, MyProc
     TOK_VAR, TOK_TASK,
@@ -40,24 +49,74 @@ typedef enum TokType
 a procedure is the set of steps to be performed to accomplish the task.
 So, the body of the task is called procedure. */
 
+/* Tokens don't hold pointers: the text of a token is at 'start' in the program text,
+so the token array can be saved to a file and mapped back as it is.
+The text can be longer than 4 GiB, so 'start' has 64 bits; it sits next to 'len', so a token is still 40 bytes.
+The other fields stay ints, and the tokenizer reports an error past their limits: a token (an identifier or a number)
+can't be longer than INT_MAX, a program can't have more lines, nor more than MAX_NAMES names. */
+
+#define MAX_NAMES (1 << 29) // the table interning them has twice as many int slots
+
 typedef struct Token {
     TokType type;
-    char *start;
     int len;
+    size_t start;
     int line;
+    int name;    // interned name of TOK_VAR and TOK_TASK, -1 otherwise
+    Value value; // value of TOK_NUMBER
 } Token;
 
+typedef struct Name {
+    size_t start;
+    int len;
+} Name;
+
 DECLARE_ARR(TokenArr, Token)
+DECLARE_ARR(NameArr, Name)
+DECLARE_ARR(OffsetArr, size_t)
+
+typedef struct Program {
+    char *text;     // source code, followed by the text of the tokens added by the optimizer
+    size_t text_len;
+    size_t source_len; // the source code is text[0, source_len), followed by '\0'
+    TokenArr tokens;
+    NameArr names;  // a variable or a task is referred by the index of its name
+    int *name_slots; // hash table of the names, built when needed
+    int name_slots_cap;
+    void *mapping;  // the .jisc file the program is mapped from, NULL if none
+    size_t mapping_len;
+} Program;
+
+#define TOKEN_TEXT(program, token) (&(program)->text[(token).start])
 
 typedef struct Tokenizer {
     char *source_code;
-    int cursor;
+    size_t len; // strlen(source_code), computed once
+    int64_t cursor;
     char ch; // Syntatic sugar for src[cursor] 
     int line; // Should line be inside or outside of the tokenizer?
+    OffsetArr *errors; // if not NULL, the offset of each error is added to it
+    FILE *out; // where errors are printed
+    TokType prev; // of the last token lexed, TOK_SEMICOLON before the first one
 } Tokenizer;
 
+// What edit_program() changed in the token array
+typedef struct TokenEdit {
+    int64_t first;   // index of the first token replaced
+    int64_t removed; // tokens removed from 'first' on
+    int64_t added;   // tokens added in their place
+    size_t lexed_from; // the lines lexed again, [lexed_from, lexed_to) in the new text
+    size_t lexed_to;
+    long delta;  // bytes added by the edit, negative if removed
+} TokenEdit;
+
 void init_tokenizer(char *source_code);
-void collect_tokens(TokenArr *ta, bool *error);
-void print_token(Token token);
+void collect_tokens(Program *program, bool *error);
+TokenEdit edit_program(Program *program, size_t start, size_t end, const char *text, size_t len, bool *error);
+void record_lex_errors(OffsetArr *errors);
+void print_lex_errors(FILE *out);
+void print_token(Program *program, Token token);
+int intern_name(Program *program, size_t start, int len); // -1 if it's new and there are MAX_NAMES already
+void free_program(Program *program);
 
 #endif // TOKENIZER_H
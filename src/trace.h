@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Static tracepoints (USDT) of the provider 'jis', for perf and bpftrace:
+
+    tokenize__start(source_len)         tokenize__end(tokens)
+    task__enter(line, name, name_len)   task__exit(line, name, name_len)
+    while__iteration(line)
+    var__store(line, name, name_len)
+    print(line)
+
+A name isn't terminated by '\0', e.g. in bpftrace: str(arg1, arg2).
+They are built only with -DJIS_TRACE (CFLAGS=-DJIS_TRACE sh build.sh) where <sys/sdt.h> is installed;
+otherwise they are no-ops, and their arguments aren't even evaluated. */
+
+#if defined(JIS_TRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_ENABLED
+#endif
+#endif
+
+#ifdef TRACE_ENABLED
+#define TRACE1(probe, a) STAP_PROBE1(jis, probe, a)
+#define TRACE3(probe, a, b, c) STAP_PROBE3(jis, probe, a, b, c)
+#else
+#define TRACE1(probe, a) ((void)0)
+#define TRACE3(probe, a, b, c) ((void)0)
+#endif
+
+#endif // TRACE_H
@@ -1,9 +1,26 @@
 #include "utils.h"
 
+#include <malloc.h>
+
+_Thread_local MemBudget *mem_budget = NULL;
+_Thread_local void (*over_budget)(void) = NULL;
+
 void *reallocate(void *pointer, size_t new_size) 
 {
+    // The usable size is what the allocator really holds, so frees match allocations exactly
+    int64_t old_size = 0;
+    if (mem_budget != NULL) {
+        old_size = (int64_t)malloc_usable_size(pointer);
+        int64_t grow = (int64_t)new_size - old_size;
+        if (grow > 0 && atomic_load(&mem_budget->used) + grow > mem_budget->limit) {
+            assert(over_budget != NULL);
+            over_budget();
+        }
+    }
+
     if (new_size == 0) {
         free(pointer);
+        if (mem_budget != NULL) atomic_fetch_sub(&mem_budget->used, old_size);
         return NULL;
     }
 
@@ -11,6 +28,10 @@ void *reallocate(void *pointer, size_t new_size)
     
     if (res == NULL) exit(1); // TODO improve this exit to make more clear what happened
 
+    if (mem_budget != NULL) {
+        atomic_fetch_add(&mem_budget->used, (int64_t)malloc_usable_size(res) - old_size);
+    }
+
     return res;
 }
 
@@ -18,3 +39,14 @@ bool match(const char *str_lit, char *str_addr, size_t str_len)
 {
     return strlen(str_lit) == str_len && strncmp(str_lit, str_addr, str_len) == 0;
 }
+
+// FNV-1a
+uint64_t hash_bytes(const char *bytes, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
 
 #define GROW_CAPACITY(capacity) \
     ((capacity) < 8 ? 8 : (capacity) * 2)
@@ -15,10 +17,11 @@
 
 #define FREE_ARRAY(pointer) reallocate(pointer, 0)
 
+// 64-bit sizes: a generated program can have more than 2^31 tokens
 #define DECLARE_ARR(name, type) \
     typedef struct name { \
-        int size; \
-        int cap; \
+        int64_t size; \
+        int64_t cap; \
         type *data; \
     } name;
 
@@ -32,7 +35,7 @@
 #define ARR_PUSH(stack, element, type) \
     do { \
         if ((stack)->cap < (stack)->size + 1) { \
-            size_t old_cap = (stack)->cap; \
+            int64_t old_cap = (stack)->cap; \
             (stack)->cap = GROW_CAPACITY(old_cap); \
             (stack)->data = GROW_ARRAY(type, (stack)->data, (stack)->cap); \
         } \
@@ -59,8 +62,20 @@
         ARR_INIT(stack); \
     } while(0)
 
+/* A budget limits the memory allocated through reallocate() by the threads that use it,
+e.g. all the threads running a request of the server. Going over it calls over_budget() of the thread,
+which doesn't return. */
+typedef struct MemBudget {
+    _Atomic int64_t used;
+    int64_t limit;
+} MemBudget;
+
+extern _Thread_local MemBudget *mem_budget;
+extern _Thread_local void (*over_budget)(void);
+
 void *reallocate(void *pointer, size_t new_size);
 
 bool match(const char *str_lit, char *str_addr, size_t str_len);
+uint64_t hash_bytes(const char *bytes, size_t len);
 
 #endif // UTILS_H
@@ -0,0 +1,123 @@
+#include "value.h"
+
+#include <errno.h>
+#include <inttypes.h>
+
+NumericModel numeric_model = NUM_TAGGED;
+
+static Value parse_literal(const char *buffer, int len)
+{
+    if (numeric_model == NUM_FLOAT) {
+        return DOUBLE_VALUE((float)atoi(buffer));
+    }
+
+    // A whole number too big for an integer is read as a double
+    if (memchr(buffer, '.', len) == NULL) {
+        errno = 0;
+        long long n = strtoll(buffer, NULL, 10);
+        if (errno != ERANGE) return INT_VALUE(n);
+    }
+
+    return DOUBLE_VALUE(strtod(buffer, NULL));
+}
+
+// A literal can be as long as a token (up to INT_MAX): a long one is copied on the heap, not on the stack
+Value value_from_literal(const char *literal, int len)
+{
+    char small[64];
+    char *buffer = len < (int)sizeof(small) ? small : malloc((size_t)len + 1);
+    if (buffer == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(buffer, literal, len);
+    buffer[len] = '\0';
+
+    Value val = parse_literal(buffer, len);
+    if (buffer != small) free(buffer);
+    return val;
+}
+
+Value value_from_bool(bool b)
+{
+    return numeric_model == NUM_FLOAT ? DOUBLE_VALUE(b) : INT_VALUE(b);
+}
+
+// The value of an expression, as it is stored, printed or tested
+Value value_result(Value val)
+{
+    if (numeric_model == NUM_FLOAT && val.type != VAL_ARRAY) {
+        return DOUBLE_VALUE((float)(int)(float)value_as_double(val));
+    }
+    return val;
+}
+
+// An array is true when all its elements are, so 'if a == b {' tests every element
+bool value_is_true(Value val)
+{
+    switch (val.type)
+    {
+    case VAL_INT:
+        return val.i != 0;
+    case VAL_DOUBLE:
+        return val.d != 0;
+    case VAL_ARRAY:
+        for (int i = 0; i < val.arr->len; i++) {
+            if (val.arr->data[i] == 0) return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Same type and same value, used to compare literals
+bool value_equals(Value a, Value b)
+{
+    if (a.type != b.type) return false;
+    if (a.type == VAL_ARRAY) return a.arr == b.arr;
+    return a.type == VAL_INT ? a.i == b.i : memcmp(&a.d, &b.d, sizeof(double)) == 0;
+}
+
+// Not meaningful for an array, the parser checks it first
+double value_as_double(Value val)
+{
+    return val.type == VAL_INT ? (double)val.i : val.d;
+}
+
+// An integer prints like the float of the same value did, without going through one
+void print_value(FILE *out, Value val)
+{
+    if (val.type == VAL_ARRAY) {
+        fprintf(out, "[");
+        for (int i = 0; i < val.arr->len; i++) {
+            fprintf(out, i > 0 ? ", %f" : "%f", val.arr->data[i]);
+        }
+        fprintf(out, "]\n");
+    } else if (numeric_model == NUM_FLOAT) {
+        fprintf(out, "%f\n", (float)value_as_double(val));
+    } else if (val.type == VAL_INT) {
+        fprintf(out, "%" PRId64 ".000000\n", val.i);
+    } else {
+        fprintf(out, "%f\n", val.d);
+    }
+}
+
+Array *new_array(int len)
+{
+    Array *arr = reallocate(NULL, sizeof(Array) + sizeof(double) * len);
+    atomic_init(&arr->refs, 1);
+    arr->len = len;
+    return arr;
+}
+
+void retain_value(Value val)
+{
+    if (val.type == VAL_ARRAY) atomic_fetch_add_explicit(&val.arr->refs, 1, memory_order_relaxed);
+}
+
+void release_value(Value val)
+{
+    if (val.type == VAL_ARRAY && atomic_fetch_sub_explicit(&val.arr->refs, 1, memory_order_acq_rel) == 1) {
+        reallocate(val.arr, 0);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef VALUE_H
+#define VALUE_H
+
+#include "utils.h"
+
+#include <stdatomic.h>
+
+/* A value is either a 64-bit integer or a double.
+Integers stay integers through '+', '-', '*' and the exact '/', so counters are exact up to 2^63;
+a result that doesn't fit, or isn't whole, is promoted to a double (see perform_arithmetic_op()).
+Comparisons and logical operators give the integer 0 or 1. */
+
+typedef enum ValueType {
+    VAL_INT, // first, so a zeroed Value is the integer 0
+    VAL_DOUBLE,
+    VAL_ARRAY,
+} ValueType;
+
+/* An array has a fixed length and holds doubles.
+It is shared by reference counting: a Value holding it, on a variable or on the stack of numbers, owns a reference.
+Storing an element into a shared array copies it first, so arrays behave as values.
+The count is atomic because spawned tasks share the arrays of the variables they start with. */
+typedef struct Array {
+    atomic_int refs;
+    int len;
+    double data[];
+} Array;
+
+typedef struct Value {
+    ValueType type;
+    union {
+        int64_t i;
+        double d;
+        Array *arr;
+    };
+} Value;
+
+/* NUM_FLOAT (--float) is the numeric model of the first versions of Jis, kept as it was:
+literals are read with atoi(), every operation is performed on floats
+and the result of an expression is truncated to an int before being stored, printed or tested. */
+typedef enum NumericModel {
+    NUM_TAGGED,
+    NUM_FLOAT,
+} NumericModel;
+
+extern NumericModel numeric_model;
+
+#define INT_VALUE(n) ((Value){.type = VAL_INT, .i = (n)})
+#define DOUBLE_VALUE(n) ((Value){.type = VAL_DOUBLE, .d = (n)})
+#define ARRAY_VALUE(a) ((Value){.type = VAL_ARRAY, .arr = (a)})
+
+Value value_from_literal(const char *literal, int len);
+Value value_from_bool(bool b);
+Value value_result(Value val);
+bool value_is_true(Value val);
+bool value_equals(Value a, Value b);
+double value_as_double(Value val);
+void print_value(FILE *out, Value val);
+
+Array *new_array(int len);
+void retain_value(Value val);
+void release_value(Value val);
+
+#endif // VALUE_H
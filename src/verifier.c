@@ -0,0 +1,867 @@
+#define _POSIX_C_SOURCE 200809L // open_memstream()
+
+#include "verifier.h"
+#include "parser.h"
+
+/* The references are checked on sets of names (a bit for each name): the names declared on every path to a point,
+and those that the tasks spawned declare at the next 'wait'.
+A body adds the same names whatever is declared where it starts, so it's summarized once by what it adds ('gen'),
+and an 'exec' adds what every body of the task adds, along with what's declared where the task is declared
+(a body starts with what's declared at its declaration and at every 'exec' of it, and the latter is already declared there).
+So the work is linear: the summaries are computed from the tasks executed to those executing them,
+then the top level is walked, and every body once, from the tasks executing to those executed,
+with what is declared whenever it starts. Only the tasks that execute each other, directly or not, are walked again
+until what they start with doesn't change, starting from the assumption that everything is declared. */
+
+typedef uint64_t *NameSet;
+
+DECLARE_ARR(IntArr, int)
+
+typedef struct Decl {
+    int name;
+    int64_t body;    // first token of the body
+    int next;        // the next declaration of the same task, -1 if none
+    NameSet at_decl; // declared where the task is declared
+    NameSet gen;     // declared by the body, whatever it starts with
+    NameSet entry;   // declared whenever the body starts
+    NameSet sites;   // of the first declaration of a task: declared at every 'exec' or 'spawn' of it
+    bool has_sites;
+    bool broken;     // it has a syntax error: the body isn't walked, it declares the variables it stores to
+} Decl;
+
+typedef struct Error {
+    int line;
+    int64_t token;
+    char msg[ERR_MSG_SIZE];
+} Error;
+
+DECLARE_ARR(DeclArr, Decl)
+DECLARE_ARR(ErrorArr, Error)
+
+/* What a walk adds at an 'exec': GEN summarizes a body (what it starts with isn't known, the task is assumed declared),
+LEARN walks the top level to find what's declared at each declaration, CHECK walks with what's declared
+and reports the errors (if report is set) and the 'exec' of each task. */
+typedef enum WalkMode {
+    WALK_GEN,
+    WALK_LEARN,
+    WALK_CHECK,
+} WalkMode;
+
+/* Changed in place: a branch adds to the trail the names it declares, so they are taken back
+without copying the set. The pending names are few, if any: they are also kept in a list. */
+typedef struct Flow {
+    NameSet declared;
+    IntArr trail;
+    NameSet pending_set; // declared by the tasks spawned, at the next 'wait'
+    IntArr pending;
+} Flow;
+
+typedef struct Verifier {
+    Program *program;
+    Token *tokens;
+    int64_t size;
+    int words;
+    DeclArr decls;      // in the order of the program
+    int *first_decl;    // by name, -1 if it isn't a task
+    int next_decl;      // the declaration met next by the walk of the top level
+    IntArr calls;       // the tasks executed or spawned by each body, from calls_of[name]
+    int64_t *calls_of;  // by name, calls_of[name + 1] is where those of the next name start
+    int *scc;           // by name, the group of tasks that execute each other
+    IntArr order;       // the tasks, the groups from those executed to those executing them
+    IntArr groups;      // the start of each group in order
+    int group;          // the group being walked
+    WalkMode mode;
+    bool report;
+    uint64_t *broken;   // by token, the top-level statements with a syntax error, NULL if none
+    uint64_t *dead;     // by token, the 'exec' and 'spawn' of a task not declared where a body runs, NULL if none
+    bool new_dead;
+    bool at_changed;    // what's declared where a task is declared again, known after the top level is walked
+    NameSet scratch;    // empty between two uses
+    NameSet exit;
+    ErrorArr errors;
+} Verifier;
+
+static void check_syntax(Verifier *v);
+static int64_t skip_statement(Token *t, int64_t size, int64_t cursor);
+static void find_decls(Verifier *v);
+static void find_stores(Verifier *v, int64_t cursor, NameSet set);
+static void find_calls(Verifier *v);
+static void find_groups(Verifier *v);
+static bool recursive_group(Verifier *v, int first, int last);
+static void summarize(Verifier *v, int first, int last);
+static void walk_top(Verifier *v, const bool *declared, WalkMode mode);
+static void walk_group(Verifier *v, int first, int last);
+static void entry_of(Verifier *v, Decl *decl, NameSet entry);
+static void walk_body(Verifier *v, Decl *decl, NameSet entry);
+static int64_t walk_block(Verifier *v, int64_t cursor, int scope, Flow *flow);
+static int64_t walk_statement(Verifier *v, int64_t cursor, int scope, Flow *flow);
+static int64_t walk_reads(Verifier *v, int64_t cursor, TokType end, Flow *flow);
+static void walk_task_ref(Verifier *v, int64_t cursor, Flow *flow, bool spawned);
+static void add_error(Verifier *v, int64_t token, const char *what, const char *fmt);
+static int compare_errors(const void *a, const void *b);
+
+static NameSet new_set(Verifier *v, bool full);
+static void copy_set(Verifier *v, NameSet dst, NameSet src);
+static bool same_set(Verifier *v, NameSet a, NameSet b);
+static void meet_set(Verifier *v, NameSet dst, NameSet src);
+static void join_set(Verifier *v, NameSet dst, NameSet src);
+static void init_flow(Verifier *v, Flow *flow);
+static void free_flow(Flow *flow);
+static void declare(Flow *flow, int name);
+static void declare_set(Verifier *v, Flow *flow, NameSet set);
+static void add_pending(Verifier *v, Flow *flow, NameSet set);
+static void clear_pending(Flow *flow);
+static void copy_pending(Flow *flow, IntArr *names);
+static void set_pending(Flow *flow, IntArr *names);
+static void undo_trail(Flow *flow, int64_t mark);
+static void meet_branches(Verifier *v, Flow *flow, int64_t mark, int64_t taken_end, IntArr *taken_pending);
+
+#define HAS(set, name) (((set)[(name) / 64] >> ((name) % 64)) & 1)
+#define ADD(set, name) ((set)[(name) / 64] |= (uint64_t)1 << ((name) % 64))
+#define DEL(set, name) ((set)[(name) / 64] &= ~((uint64_t)1 << ((name) % 64)))
+
+bool verify_program(Program *program, const bool *declared, FILE *out)
+{
+    Verifier v = {
+        .program = program,
+        .tokens = program->tokens.data,
+        .size = program->tokens.size,
+        .words = (program->names.size + 63) / 64 + 1,
+    };
+    ARR_INIT(&v.decls);
+    ARR_INIT(&v.calls);
+    ARR_INIT(&v.order);
+    ARR_INIT(&v.groups);
+    ARR_INIT(&v.errors);
+    v.scratch = new_set(&v, false);
+    v.exit = new_set(&v, false);
+
+    // The statements with a syntax error are left out, but the references in the others are still checked
+    check_syntax(&v);
+    int64_t syntax_errors = v.errors.size;
+    find_decls(&v);
+    find_calls(&v);
+    find_groups(&v);
+
+    /* A summary assumes that the tasks a body executes are declared. When one isn't where the body runs,
+    it's an error, and it's all done again without it, so that the errors after it are still found.
+    It's done again also if what's declared at a declaration of a task declared more than once isn't what was assumed:
+    the first time, everything. */
+    do {
+        v.new_dead = false;
+        v.at_changed = false;
+        v.errors.size = syntax_errors;
+        for (int i = 0; i < v.decls.size; i++) {
+            v.decls.data[i].has_sites = false;
+            memset(v.decls.data[i].entry, 0xff, sizeof(uint64_t) * v.words);
+        }
+
+        // From the tasks executed to those executing them
+        for (int i = 0; i + 1 < v.groups.size; i++) {
+            summarize(&v, v.groups.data[i], v.groups.data[i + 1]);
+        }
+
+        walk_top(&v, declared, WALK_LEARN);
+        walk_top(&v, declared, WALK_CHECK);
+
+        // From the tasks executing to those executed
+        for (int i = v.groups.size - 2; i >= 0; i--) {
+            walk_group(&v, v.groups.data[i], v.groups.data[i + 1]);
+        }
+    } while (v.new_dead || v.at_changed);
+    bool ok = v.broken == NULL && v.errors.size == 0;
+
+    if (v.errors.size > 0) qsort(v.errors.data, v.errors.size, sizeof(Error), compare_errors);
+    for (int i = 0; i < v.errors.size; i++) {
+        Error *error = &v.errors.data[i];
+        // The same error in a copy of the tokens, like a task inlined by the optimizer, is printed once
+        if (i > 0 && error->line == error[-1].line && strcmp(error->msg, error[-1].msg) == 0) continue;
+        fprintf(out, "Line %d: %s.\n", error->line, error->msg);
+    }
+
+    for (int i = 0; i < v.decls.size; i++) {
+        Decl *decl = &v.decls.data[i];
+        free(decl->at_decl);
+        free(decl->gen);
+        free(decl->entry);
+        free(decl->sites);
+    }
+    free(v.decls.data);
+    free(v.calls.data);
+    free(v.order.data);
+    free(v.groups.data);
+    free(v.errors.data);
+    free(v.first_decl);
+    free(v.calls_of);
+    free(v.scc);
+    free(v.scratch);
+    free(v.exit);
+    free(v.broken);
+    free(v.dead);
+    return ok;
+}
+
+/* Every top-level statement is parsed without being executed, on a parser of its own.
+After an error, checking goes on from the next statement. The parser prints the error: it's taken back
+from the output, to be printed with the others by line. */
+static void check_syntax(Verifier *v)
+{
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&text, &len);
+    if (out == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    init_parser(v->program);
+    set_parser_output(out);
+
+    int64_t cursor = 0;
+    while (cursor < v->size)
+    {
+        size_t start = len;
+        int64_t next = check_statement(cursor);
+        if (next == -1)
+        {
+            next = skip_statement(v->tokens, v->size, cursor);
+            if (v->broken == NULL) v->broken = calloc(v->size / 64 + 1, sizeof(uint64_t));
+            ADD(v->broken, cursor);
+
+            // "Line <line>: <message>.\n"
+            fflush(out);
+            Error error = { .token = cursor };
+            int skipped = 0;
+            if (sscanf(text + start, "Line %d: %n", &error.line, &skipped) == 1 && skipped > 0) {
+                int msg_len = (int)(len - start) - skipped - 2;
+                snprintf(error.msg, ERR_MSG_SIZE, "%.*s", msg_len > 0 ? msg_len : 0, text + start + skipped);
+                ARR_PUSH(&v->errors, error, Error);
+            }
+        }
+        cursor = next;
+    }
+
+    free_parser();
+    fclose(out);
+    free(text);
+}
+
+// Up to the ';' or the '}' (and its 'else') that ends the statement at cursor
+static int64_t skip_statement(Token *t, int64_t size, int64_t cursor)
+{
+    int depth = 0;
+    for (int64_t i = cursor; i < size; i++)
+    {
+        if (t[i].type == TOK_OBRACE) depth++;
+        else if (t[i].type == TOK_SEMICOLON && depth == 0) return i + 1;
+        else if (t[i].type == TOK_CBRACE && --depth <= 0) {
+            if (depth == 0 && i + 1 < size && t[i + 1].type == TOK_ELSE) continue;
+            return i + 1;
+        }
+    }
+    return size;
+}
+
+// The syntax is valid, so a declaration is a task name followed by '{', at the top level
+static void find_decls(Verifier *v)
+{
+    int names = v->program->names.size;
+    v->first_decl = malloc(sizeof(int) * (names + 1));
+    for (int i = 0; i < names; i++) v->first_decl[i] = -1;
+
+    int64_t cursor = 0;
+    while (cursor < v->size)
+    {
+        Token token = v->tokens[cursor];
+        if (token.type == TOK_TASK)
+        {
+            Decl decl = { .name = token.name, .body = cursor + 2, .next = -1 };
+            decl.at_decl = new_set(v, v->first_decl[token.name] != -1);
+            decl.broken = v->broken != NULL && HAS(v->broken, cursor);
+            decl.gen = new_set(v, false);
+            if (decl.broken) find_stores(v, cursor, decl.gen);
+            decl.entry = new_set(v, true);
+
+            int *last = &v->first_decl[token.name];
+            while (*last != -1) last = &v->decls.data[*last].next;
+            *last = v->decls.size;
+            if (v->first_decl[token.name] == v->decls.size) decl.sites = new_set(v, false);
+
+            ARR_PUSH(&v->decls, decl, Decl);
+        }
+        cursor = skip_statement(v->tokens, v->size, cursor);
+    }
+}
+
+// The variables stored to in the statement at cursor, which may have a syntax error
+static void find_stores(Verifier *v, int64_t cursor, NameSet set)
+{
+    int64_t end = skip_statement(v->tokens, v->size, cursor);
+    for (int64_t i = cursor; i + 1 < end; i++) {
+        if (v->tokens[i].type == TOK_VAR && v->tokens[i + 1].type == TOK_ASSIGN) ADD(set, v->tokens[i].name);
+    }
+}
+
+// The tasks named after an 'exec' or a 'spawn' in the bodies of each task, by the name of the task
+static void find_calls(Verifier *v)
+{
+    int names = v->program->names.size;
+    v->calls_of = calloc(names + 1, sizeof(int64_t));
+
+    for (int name = 0; name < names; name++)
+    {
+        v->calls_of[name] = v->calls.size;
+        for (int i = v->first_decl[name]; i != -1; i = v->decls.data[i].next)
+        {
+            if (v->decls.data[i].broken) continue;
+            int depth = 1;
+            for (int64_t cursor = v->decls.data[i].body; depth > 0; cursor++) {
+                TokType type = v->tokens[cursor].type;
+                if (type == TOK_OBRACE) depth++;
+                else if (type == TOK_CBRACE) depth--;
+                else if ((type == TOK_EXEC_TASK || type == TOK_SPAWN) && v->first_decl[v->tokens[cursor + 1].name] != -1) {
+                    ARR_PUSH(&v->calls, v->tokens[cursor + 1].name, int);
+                }
+            }
+        }
+    }
+    v->calls_of[names] = v->calls.size;
+}
+
+/* The strongly connected components of the tasks executing each other (Tarjan's algorithm, with a stack of its own
+since the chains of tasks can be long). A group is closed after all the groups it executes. */
+static void find_groups(Verifier *v)
+{
+    int names = v->program->names.size;
+    v->scc = malloc(sizeof(int) * (names + 1));
+    int *index = malloc(sizeof(int) * (names + 1));
+    int *low = malloc(sizeof(int) * (names + 1));
+    int64_t *next_call = malloc(sizeof(int64_t) * (names + 1));
+    IntArr stack, path;
+    ARR_INIT(&stack);
+    ARR_INIT(&path);
+
+    for (int i = 0; i < names; i++) {
+        index[i] = -1;
+        v->scc[i] = -1;
+    }
+    int count = 0;
+
+    for (int root = 0; root < names; root++)
+    {
+        if (v->first_decl[root] == -1 || index[root] != -1) continue;
+
+        index[root] = low[root] = count++;
+        next_call[root] = v->calls_of[root];
+        ARR_PUSH(&stack, root, int);
+        ARR_PUSH(&path, root, int);
+
+        while (path.size > 0)
+        {
+            int name = path.data[path.size - 1];
+            if (next_call[name] < v->calls_of[name + 1])
+            {
+                int callee = v->calls.data[next_call[name]++];
+                if (index[callee] == -1) {
+                    index[callee] = low[callee] = count++;
+                    next_call[callee] = v->calls_of[callee];
+                    ARR_PUSH(&stack, callee, int);
+                    ARR_PUSH(&path, callee, int);
+                } else if (v->scc[callee] == -1 && index[callee] < low[name]) {
+                    low[name] = index[callee]; // still on the stack
+                }
+                continue;
+            }
+
+            ARR_POP(&path);
+            if (path.size > 0) {
+                int caller = path.data[path.size - 1];
+                if (low[name] < low[caller]) low[caller] = low[name];
+            }
+            if (low[name] != index[name]) continue;
+
+            // 'name' is the root of a group: the names above it on the stack
+            ARR_PUSH(&v->groups, v->order.size, int);
+            int member;
+            do {
+                member = stack.data[--stack.size];
+                v->scc[member] = v->groups.size - 1;
+                ARR_PUSH(&v->order, member, int);
+            } while (member != name);
+        }
+    }
+    ARR_PUSH(&v->groups, v->order.size, int);
+
+    free(index);
+    free(low);
+    free(next_call);
+    ARR_FREE(&stack);
+    ARR_FREE(&path);
+}
+
+// More than a task, or a task executing itself
+static bool recursive_group(Verifier *v, int first, int last)
+{
+    if (last - first > 1) return true;
+    int name = v->order.data[first];
+    for (int64_t i = v->calls_of[name]; i < v->calls_of[name + 1]; i++) {
+        if (v->calls.data[i] == name) return true;
+    }
+    return false;
+}
+
+/* What each body of the group declares, with what the tasks it executes declare.
+In a recursive group, it starts from everything and it's computed again until it doesn't change. */
+static void summarize(Verifier *v, int first, int last)
+{
+    bool recursive = recursive_group(v, first, last);
+    for (int i = first; i < last && recursive; i++) {
+        for (int d = v->first_decl[v->order.data[i]]; d != -1; d = v->decls.data[d].next) {
+            memset(v->decls.data[d].gen, 0xff, sizeof(uint64_t) * v->words);
+        }
+    }
+
+    v->mode = WALK_GEN;
+    v->report = false;
+    Flow flow;
+    init_flow(v, &flow);
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = first; i < last; i++) {
+            for (int d = v->first_decl[v->order.data[i]]; d != -1; d = v->decls.data[d].next)
+            {
+                Decl *decl = &v->decls.data[d];
+                if (decl->broken) continue;
+                undo_trail(&flow, 0);
+                clear_pending(&flow);
+                walk_block(v, decl->body, 0, &flow);
+                if (!same_set(v, flow.declared, decl->gen)) {
+                    copy_set(v, decl->gen, flow.declared);
+                    changed = true;
+                }
+            }
+        }
+        changed = changed && recursive;
+    }
+
+    free_flow(&flow);
+}
+
+/* LEARN finds what's declared at each declaration, then CHECK reports the errors and the 'exec' of each task.
+An 'exec' on the top level is affected only by the declarations before it: one after it starts with what it declares. */
+static void walk_top(Verifier *v, const bool *declared, WalkMode mode)
+{
+    v->mode = mode;
+    v->report = mode == WALK_CHECK;
+    v->group = -1;
+
+    Flow flow;
+    init_flow(v, &flow);
+    for (int i = 0; declared != NULL && i < v->program->names.size; i++) {
+        if (declared[i]) declare(&flow, i);
+    }
+
+    // Not walk_block(): a '}' with a syntax error doesn't end the top level
+    v->next_decl = 0;
+    for (int64_t cursor = 0; cursor < v->size;) {
+        cursor = walk_statement(v, cursor, 0, &flow);
+    }
+    free_flow(&flow);
+}
+
+/* The bodies of the group start with what's declared at their declaration and wherever they are executed,
+or with anything if they are never executed: the optimizer drops the stores that only their body would read.
+The groups executing them have already been walked, but in a recursive group the 'exec' of a task of the group
+are found while walking it: it's walked again, from the tasks executing to those executed, until what they start
+with doesn't change. It only loses names, and so does what's declared at each 'exec', so the sites are kept. */
+static void walk_group(Verifier *v, int first, int last)
+{
+    v->mode = WALK_CHECK;
+    v->group = v->scc[v->order.data[first]];
+
+    if (recursive_group(v, first, last))
+    {
+        v->report = false;
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (int i = last - 1; i >= first; i--) {
+                for (int d = v->first_decl[v->order.data[i]]; d != -1; d = v->decls.data[d].next) {
+                    Decl *decl = &v->decls.data[d];
+                    entry_of(v, decl, v->exit);
+                    if (!same_set(v, v->exit, decl->entry)) {
+                        copy_set(v, decl->entry, v->exit);
+                        changed = true;
+                    }
+                    walk_body(v, decl, decl->entry);
+                }
+            }
+        }
+    }
+    else
+    {
+        for (int d = v->first_decl[v->order.data[first]]; d != -1; d = v->decls.data[d].next) {
+            entry_of(v, &v->decls.data[d], v->decls.data[d].entry);
+        }
+    }
+
+    v->report = true;
+    for (int i = first; i < last; i++) {
+        for (int d = v->first_decl[v->order.data[i]]; d != -1; d = v->decls.data[d].next) {
+            walk_body(v, &v->decls.data[d], v->decls.data[d].entry);
+        }
+    }
+}
+
+static void entry_of(Verifier *v, Decl *decl, NameSet entry)
+{
+    Decl *first = &v->decls.data[v->first_decl[decl->name]];
+    memset(entry, 0xff, sizeof(uint64_t) * v->words);
+    if (first->has_sites) {
+        copy_set(v, entry, first->sites);
+        join_set(v, entry, decl->at_decl);
+    }
+}
+
+static void walk_body(Verifier *v, Decl *decl, NameSet entry)
+{
+    if (decl->broken) return;
+
+    // What it starts with is never taken back: it isn't on the trail
+    Flow flow;
+    init_flow(v, &flow);
+    copy_set(v, flow.declared, entry);
+    walk_block(v, decl->body, 0, &flow);
+    free_flow(&flow);
+}
+
+// The statements up to the '}' that closes the block, or up to the end of the program. Returns the token after it.
+static int64_t walk_block(Verifier *v, int64_t cursor, int scope, Flow *flow)
+{
+    while (cursor < v->size && v->tokens[cursor].type != TOK_CBRACE) {
+        cursor = walk_statement(v, cursor, scope, flow);
+    }
+    return cursor + 1;
+}
+
+static int64_t walk_statement(Verifier *v, int64_t cursor, int scope, Flow *flow)
+{
+    Token *t = v->tokens;
+    Token token = t[cursor];
+
+    // A statement with a syntax error isn't walked, but it declares what it stores to, or the reads of it are errors too
+    if (v->broken != NULL && HAS(v->broken, cursor) && token.type != TOK_TASK) {
+        find_stores(v, cursor, v->scratch);
+        declare_set(v, flow, v->scratch);
+        memset(v->scratch, 0, sizeof(uint64_t) * v->words);
+        return skip_statement(t, v->size, cursor);
+    }
+
+    switch (token.type)
+    {
+    case TOK_TASK:
+    {
+        Decl *decl = &v->decls.data[v->next_decl++];
+        declare(flow, token.name);
+        if (v->mode == WALK_LEARN && !same_set(v, decl->at_decl, flow->declared)) {
+            copy_set(v, decl->at_decl, flow->declared);
+            if (v->first_decl[token.name] != v->next_decl - 1) v->at_changed = true;
+        }
+        return skip_statement(t, v->size, cursor);
+    }
+    case TOK_VAR:
+        if (t[cursor + 1].type == TOK_OBRACKET) {
+            if (!HAS(flow->declared, token.name)) add_error(v, cursor, "variable", "%s '%.*s' not declared");
+            return walk_reads(v, cursor + 1, TOK_SEMICOLON, flow);
+        }
+    {
+        int64_t name = cursor;
+        cursor = walk_reads(v, cursor + 2, TOK_SEMICOLON, flow);
+        if (scope == 0) declare(flow, token.name);
+        else if (!HAS(flow->declared, token.name)) add_error(v, name, "variable", "%s '%.*s' declared in local scope");
+        return cursor;
+    }
+    case TOK_PRINT:
+        return walk_reads(v, cursor + 1, TOK_SEMICOLON, flow);
+    case TOK_IF:
+    {
+        cursor = walk_reads(v, cursor + 1, TOK_OBRACE, flow);
+        int64_t mark = flow->trail.size;
+        IntArr pending;
+        copy_pending(flow, &pending);
+
+        cursor = walk_block(v, cursor, scope + 1, flow);
+
+        // The branch not taken starts from the same point, what the branch taken declared stays on the trail
+        int64_t taken_end = flow->trail.size;
+        for (int64_t i = mark; i < taken_end; i++) DEL(flow->declared, flow->trail.data[i]);
+        IntArr taken_pending;
+        copy_pending(flow, &taken_pending);
+        set_pending(flow, &pending);
+        ARR_FREE(&pending);
+
+        if (cursor < v->size && t[cursor].type == TOK_ELSE) {
+            cursor = walk_block(v, cursor + 2, scope + 1, flow);
+        }
+        meet_branches(v, flow, mark, taken_end, &taken_pending);
+        ARR_FREE(&taken_pending);
+        return cursor;
+    }
+    case TOK_WHILE:
+    {
+        cursor = walk_reads(v, cursor + 1, TOK_OBRACE, flow);
+        int64_t mark = flow->trail.size;
+        IntArr pending;
+        copy_pending(flow, &pending);
+
+        cursor = walk_block(v, cursor, scope + 1, flow);
+
+        // What the body declares isn't declared after it, since it may not run
+        undo_trail(flow, mark);
+        set_pending(flow, &pending);
+        ARR_FREE(&pending);
+        return cursor;
+    }
+    case TOK_EXEC_TASK:
+    case TOK_SPAWN:
+        walk_task_ref(v, cursor + 1, flow, token.type == TOK_SPAWN);
+        return cursor + 3;
+    case TOK_WAIT:
+        for (int i = 0; i < flow->pending.size; i++) {
+            if (!HAS(flow->declared, flow->pending.data[i])) declare(flow, flow->pending.data[i]);
+        }
+        clear_pending(flow);
+        return cursor + 2;
+    default:
+        assert("Unreachable, the syntax was checked" && false);
+        return v->size;
+    }
+}
+
+// The variables read up to 'end', which are all the variables in an expression. Returns the token after 'end'.
+static int64_t walk_reads(Verifier *v, int64_t cursor, TokType end, Flow *flow)
+{
+    for (; cursor < v->size && v->tokens[cursor].type != end; cursor++) {
+        Token token = v->tokens[cursor];
+        if (token.type == TOK_VAR && !HAS(flow->declared, token.name)) {
+            add_error(v, cursor, "variable", "%s '%.*s' not declared");
+        }
+    }
+    return cursor + 1;
+}
+
+/* An 'exec' declares what every body of the task declares, a 'spawn' does it at the next 'wait'.
+Their bodies start with what's declared here. If the task isn't declared, nothing runs. */
+static void walk_task_ref(Verifier *v, int64_t cursor, Flow *flow, bool spawned)
+{
+    int name = v->tokens[cursor].name;
+    // Until the errors are reported, an 'exec' found dead runs nothing even where a guess declares the task
+    if (!v->report && v->dead != NULL && HAS(v->dead, cursor)) return;
+    if (v->mode != WALK_GEN && !HAS(flow->declared, name)) {
+        add_error(v, cursor, "task", "%s '%.*s' doesn't exists");
+        if (v->report && v->group != -1) {
+            if (v->dead == NULL) v->dead = calloc(v->size / 64 + 1, sizeof(uint64_t));
+            if (!HAS(v->dead, cursor)) v->new_dead = true;
+            ADD(v->dead, cursor);
+        }
+        return;
+    }
+
+    int first = v->first_decl[name];
+    if (first == -1) return;
+
+    Decl *decl = &v->decls.data[first];
+    if (v->mode == WALK_CHECK && (v->report || v->scc[name] == v->group)) {
+        if (decl->has_sites) meet_set(v, decl->sites, flow->declared);
+        else copy_set(v, decl->sites, flow->declared);
+        decl->has_sites = true;
+    }
+
+    // What's declared here is declared at the start of the body: it stays declared anyway
+    memset(v->exit, 0xff, sizeof(uint64_t) * v->words);
+    for (int i = first; i != -1; i = v->decls.data[i].next) {
+        if (v->mode == WALK_LEARN && i >= v->next_decl) break;
+        // A summary doesn't know what's declared at the first declaration, but it's declared wherever the task is
+        Decl *body = &v->decls.data[i];
+        if (v->mode != WALK_GEN || i != first) join_set(v, v->scratch, body->at_decl);
+        join_set(v, v->scratch, body->gen);
+        meet_set(v, v->exit, v->scratch);
+        memset(v->scratch, 0, sizeof(uint64_t) * v->words);
+    }
+
+    if (spawned) add_pending(v, flow, v->exit);
+    else declare_set(v, flow, v->exit);
+}
+
+static void add_error(Verifier *v, int64_t token, const char *what, const char *fmt)
+{
+    if (!v->report) return;
+
+    Token t = v->tokens[token];
+    Error error = { .line = t.line, .token = token };
+    snprintf(error.msg, ERR_MSG_SIZE, fmt, what, t.len, TOKEN_TEXT(v->program, t));
+    ARR_PUSH(&v->errors, error, Error);
+}
+
+// By line, since the optimizer may move the tokens around
+static int compare_errors(const void *a, const void *b)
+{
+    const Error *x = a, *y = b;
+    if (x->line != y->line) return x->line - y->line;
+    return (x->token > y->token) - (x->token < y->token);
+}
+
+/*
+ *
+ *  Sets of names
+ */
+
+// Not from reallocate(): they are scratch memory, not the program's
+static NameSet new_set(Verifier *v, bool full)
+{
+    NameSet set = malloc(sizeof(uint64_t) * v->words);
+    if (set == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(set, full ? 0xff : 0, sizeof(uint64_t) * v->words);
+    return set;
+}
+
+static void copy_set(Verifier *v, NameSet dst, NameSet src)
+{
+    memcpy(dst, src, sizeof(uint64_t) * v->words);
+}
+
+static bool same_set(Verifier *v, NameSet a, NameSet b)
+{
+    return memcmp(a, b, sizeof(uint64_t) * v->words) == 0;
+}
+
+static void meet_set(Verifier *v, NameSet dst, NameSet src)
+{
+    for (int i = 0; i < v->words; i++) dst[i] &= src[i];
+}
+
+static void join_set(Verifier *v, NameSet dst, NameSet src)
+{
+    for (int i = 0; i < v->words; i++) dst[i] |= src[i];
+}
+
+static void init_flow(Verifier *v, Flow *flow)
+{
+    flow->declared = new_set(v, false);
+    flow->pending_set = new_set(v, false);
+    ARR_INIT(&flow->trail);
+    ARR_INIT(&flow->pending);
+}
+
+static void free_flow(Flow *flow)
+{
+    free(flow->declared);
+    free(flow->pending_set);
+    free(flow->trail.data);
+    free(flow->pending.data);
+}
+
+static void declare(Flow *flow, int name)
+{
+    if (HAS(flow->declared, name)) return;
+    ADD(flow->declared, name);
+    ARR_PUSH(&flow->trail, name, int);
+}
+
+// Only the names not declared yet are added to the trail: a word at a time
+static void declare_set(Verifier *v, Flow *flow, NameSet set)
+{
+    for (int i = 0; i < v->words; i++)
+    {
+        uint64_t added = set[i] & ~flow->declared[i];
+        flow->declared[i] |= added;
+        while (added != 0) {
+            int bit = __builtin_ctzll(added);
+            ARR_PUSH(&flow->trail, i * 64 + bit, int);
+            added &= added - 1;
+        }
+    }
+}
+
+static void add_pending(Verifier *v, Flow *flow, NameSet set)
+{
+    for (int i = 0; i < v->words; i++)
+    {
+        uint64_t added = set[i] & ~flow->pending_set[i];
+        flow->pending_set[i] |= added;
+        while (added != 0) {
+            int bit = __builtin_ctzll(added);
+            ARR_PUSH(&flow->pending, i * 64 + bit, int);
+            added &= added - 1;
+        }
+    }
+}
+
+static void clear_pending(Flow *flow)
+{
+    for (int i = 0; i < flow->pending.size; i++) DEL(flow->pending_set, flow->pending.data[i]);
+    flow->pending.size = 0;
+}
+
+static void copy_pending(Flow *flow, IntArr *names)
+{
+    ARR_INIT(names);
+    for (int i = 0; i < flow->pending.size; i++) ARR_PUSH(names, flow->pending.data[i], int);
+}
+
+// The pending names become a copy of 'names'
+static void set_pending(Flow *flow, IntArr *names)
+{
+    clear_pending(flow);
+    for (int i = 0; i < names->size; i++) {
+        ADD(flow->pending_set, names->data[i]);
+        ARR_PUSH(&flow->pending, names->data[i], int);
+    }
+}
+
+// The names declared after the mark aren't anymore
+static void undo_trail(Flow *flow, int64_t mark)
+{
+    for (int64_t i = mark; i < flow->trail.size; i++) DEL(flow->declared, flow->trail.data[i]);
+    flow->trail.size = mark;
+}
+
+/* After an 'if': the trail holds, from the mark, what the branch taken declared up to taken_end (already taken back),
+then what the other one declared. Only what both declared stays, and so for the pending names. */
+static void meet_branches(Verifier *v, Flow *flow, int64_t mark, int64_t taken_end, IntArr *taken_pending)
+{
+    NameSet taken = v->scratch;
+    for (int64_t i = mark; i < taken_end; i++) ADD(taken, flow->trail.data[i]);
+
+    for (int64_t i = taken_end; i < flow->trail.size; i++) {
+        int name = flow->trail.data[i];
+        if (!HAS(taken, name)) {
+            DEL(flow->declared, name);
+            flow->trail.data[i] = -1;
+        }
+    }
+    for (int64_t i = mark; i < taken_end; i++) DEL(taken, flow->trail.data[i]);
+
+    // What stays is moved down over what the branch taken declared
+    int64_t kept = mark;
+    for (int64_t i = taken_end; i < flow->trail.size; i++) {
+        if (flow->trail.data[i] != -1) flow->trail.data[kept++] = flow->trail.data[i];
+    }
+    flow->trail.size = kept;
+
+    for (int i = 0; i < taken_pending->size; i++) ADD(taken, taken_pending->data[i]);
+    int64_t pending = 0;
+    for (int64_t i = 0; i < flow->pending.size; i++) {
+        int name = flow->pending.data[i];
+        if (HAS(taken, name)) flow->pending.data[pending++] = name;
+        else DEL(flow->pending_set, name);
+    }
+    flow->pending.size = pending;
+    for (int i = 0; i < taken_pending->size; i++) DEL(taken, taken_pending->data[i]);
+}
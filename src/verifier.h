@@ -0,0 +1,20 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include "tokenizer.h"
+
+/* The checks of a program before it runs, on every statement, taken or not:
+the syntax, as the parser reads it (braces and parentheses included), then every reference.
+A variable must be declared on every path to where it's read, and so must a task where it's executed;
+a variable can't be declared in a block, since a store there needs it declared already.
+Tasks are declared only at the top level, but their bodies run where they are executed:
+a body is checked with what is declared at its declaration and at every 'exec' or 'spawn' of it,
+so only the syntax of a task never executed is checked.
+
+The executor runs only verified programs, so it doesn't check these again.
+jis --check <path> runs only this. */
+
+// declared: by name, what is declared before the run (NULL if nothing). Prints every error to out.
+bool verify_program(Program *program, const bool *declared, FILE *out);
+
+#endif // VERIFIER_H
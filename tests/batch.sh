@@ -0,0 +1,88 @@
+# jis --sweep --batch runs the inputs in lockstep and prints the same as running them one at a time;
+# a program it doesn't take runs one input at a time, saying why.
+# Usage: sh tests/batch.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "batch: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+# Lanes leaving the loops and taking the branches at different iterations, over more than 64 inputs
+# (falling back to one input at a time would print why, and differ)
+cat > "$dir/lanes.jis" << 'EOF'
+i = 0;
+j = 0;
+t = 0;
+while i < n {
+    if i > 5 {
+        t = t + i;
+    } else {
+        t = t - 1;
+    }
+    j = 0;
+    while j < i && j < 3 {
+        t = t + 0.5;
+        j = j + 1;
+    }
+    i = i + 1;
+}
+print t;
+
+Count {
+    k = k + 1;
+    if k < n {
+        exec Count;
+    }
+}
+k = 0;
+exec Count;
+print k;
+
+if n > 50 && n < 60 || n == 3 {
+    print 0 - n;
+}
+EOF
+
+for o in -O0 -O1; do
+    ./jis $o --no-cache --sweep n=1:150 "$dir/lanes.jis" > "$dir/one_at_a_time" 2>&1
+    ./jis $o --no-cache --batch --sweep n=1:150 "$dir/lanes.jis" > "$dir/lockstep" 2>&1
+    cmp -s "$dir/one_at_a_time" "$dir/lockstep" || { echo "batch: $o: the lockstep run differs"; failed=1; }
+done
+expect "n=10" "$(sed -n '/^--- n=10 ---$/,/^--- n=11 ---$/p' "$dir/lockstep")" "--- n=10 ---
+36.000000
+10.000000
+--- n=11 ---"
+
+# The limits apply to each input
+cat > "$dir/loop.jis" << 'EOF'
+i = 0;
+while i < n {
+    i = i + 1;
+}
+print i;
+EOF
+./jis --no-cache --batch --max-steps 5 --sweep n=3:7:2 "$dir/loop.jis" > "$dir/out" 2>&1
+expect "limit status" "$?" "3"
+expect "limit" "$(cat "$dir/out")" "--- n=3 ---
+3.000000
+--- n=5 ---
+5.000000
+--- n=7 ---
+Line 2: step limit exceeded, after 5 steps."
+
+expect "float" "$(./jis --no-cache --float --batch --sweep n=1:1 "$dir/loop.jis" 2>&1)" "Running the inputs one at a time: --float doesn't run in lockstep.
+--- n=1 ---
+1.000000"
+
+printf 'a = [n];\nprint a;\n' > "$dir/array.jis"
+expect "array" "$(./jis --no-cache --batch --sweep n=1:1 "$dir/array.jis" 2>&1)" "Running the inputs one at a time: the program uses arrays.
+--- n=1 ---
+[1.000000]"
+
+exit $failed
@@ -0,0 +1,51 @@
+# Programs past the limits of 32-bit offsets: a source of more than 4 GiB runs, and the fields that stay ints
+# (lines and token lengths) report an error past INT_MAX. The sources are generated, several GiB each:
+# it runs only with JIS_BIG_TESTS=1, and it's skipped if there isn't enough memory or disk.
+# Usage: JIS_BIG_TESTS=1 sh tests/big_program.sh, after sh build.sh (run by tests/run.sh)
+
+[ "$JIS_BIG_TESTS" = 1 ] || exit 0
+
+comment=4294967296 # 2^32 bytes, so the statements after it are past 4 GiB
+need_kb=$(( (comment + 1024 * 1024 * 1024) / 1024 ))
+avail_kb=$(awk '/^MemAvailable:/ { print $2 }' /proc/meminfo 2>/dev/null)
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+disk_kb=$(df -Pk "$dir" | awk 'NR == 2 { print $4 }')
+if [ -z "$avail_kb" ] || [ "$avail_kb" -lt "$need_kb" ] || [ "$disk_kb" -lt "$need_kb" ]; then
+    echo "big_program: skipped, it needs $need_kb kB of memory and of disk"
+    exit 0
+fi
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "big_program: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+# A task declared before the comment runs after it, on variables named after it
+{
+    printf 'Twice {\n    b = a * 2;\n}\na = 1;\n//'
+    head -c $comment /dev/zero | tr '\0' 'x'
+    printf '\na = a + 1;\nexec Twice;\nprint b;\n'
+} > "$dir/big.jis"
+expect "past 4 GiB" "$(./jis -O0 --no-cache "$dir/big.jis" 2>&1)" "4.000000"
+
+printf 'print c;\n' >> "$dir/big.jis"
+expect "error past 4 GiB" "$(./jis --check "$dir/big.jis" 2>&1)" "Line 9: variable 'c' not declared."
+rm "$dir/big.jis"
+
+# INT_MAX lines, and a token of INT_MAX + 1 characters
+head -c 2147483647 /dev/zero | tr '\0' '\n' > "$dir/lines.jis"
+expect "lines" "$(./jis --check "$dir/lines.jis" 2>&1)" "Line 2147483647: error: too many lines."
+rm "$dir/lines.jis"
+
+{
+    printf 'a = 1;\nb = '
+    head -c 2147483648 /dev/zero | tr '\0' '1'
+    printf ';\n'
+} > "$dir/token.jis"
+expect "token length" "$(./jis --check "$dir/token.jis" 2>&1)" "Line 2: error: token longer than 2147483647 characters."
+
+exit $failed
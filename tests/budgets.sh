@@ -0,0 +1,63 @@
+# --max-steps and --timeout stop a program at a step (an iteration of a 'while' or an 'exec'), with status 3,
+# and the tasks it spawned share them.
+# Usage: sh tests/budgets.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "budgets: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+cat > "$dir/count.jis" << 'EOF'
+i = 0;
+while i < 10 {
+    print i;
+    i = i + 1;
+}
+EOF
+
+cat > "$dir/tail.jis" << 'EOF'
+i = 0;
+Loop {
+    i = i + 1;
+    exec Loop;
+}
+exec Loop;
+EOF
+
+cat > "$dir/spawned.jis" << 'EOF'
+Spin {
+    i = 0;
+    while 1 {
+        i = i + 1;
+    }
+}
+spawn Spin;
+wait;
+EOF
+
+for o in -O0 -O1; do
+    expect "$o steps" "$(./jis $o --no-cache --max-steps 3 "$dir/count.jis" 2>&1; echo "status $?")" "0.000000
+1.000000
+2.000000
+3.000000
+Line 2: step limit exceeded, after 3 steps.
+status 3"
+    expect "$o enough steps" "$(./jis $o --no-cache --max-steps 10 "$dir/count.jis" 2>&1 | tail -n 1)" "9.000000"
+    expect "$o tail exec" "$(./jis $o --no-cache --max-steps 1000 "$dir/tail.jis" 2>&1; echo "status $?")" "Line 4: step limit exceeded, after 1000 steps.
+status 3"
+    expect "$o spawned" "$(./jis $o --no-cache --max-steps 1000 "$dir/spawned.jis" 2>&1; echo "status $?")" "Line 3: step limit exceeded, after 1000 steps.
+status 3"
+done
+
+# The steps a timeout gets to depend on the machine
+./jis --no-cache --timeout 100 "$dir/spawned.jis" > "$dir/out" 2>&1
+expect "timeout status" "$?" "3"
+expect "timeout" "$(sed 's/after [0-9]* steps/after some steps/' "$dir/out")" "Line 3: time limit exceeded, after some steps."
+
+exit $failed
@@ -0,0 +1,32 @@
+# A .jisc is used only for the source it was compiled from: an edit of one byte, of the same length, compiles it again,
+# and so does a .jisc whose header has the hash of the edited source (a collision of the hash) but the old text.
+# Usage: sh tests/cache_invalidation.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "cache_invalidation: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+printf 'print 1;\n' > "$dir/prog.jis"
+expect "first run" "$(./jis "$dir/prog.jis" 2>&1)" "1.000000"
+[ -f "$dir/prog.jisc" ] || { echo "cache_invalidation: no .jisc written"; exit 1; }
+expect "cached" "$(./jis "$dir/prog.jis" 2>&1)" "1.000000"
+
+printf 'print 2;\n' > "$dir/prog.jis"
+expect "edited" "$(./jis "$dir/prog.jis" 2>&1)" "2.000000"
+
+# The .jisc of 'print 2;' now, with the hash of 'print 3;' (bytes 8 to 15 of the header)
+mkdir "$dir/other"
+printf 'print 3;\n' > "$dir/other/prog.jis"
+JIS_CACHE_DIR="$dir/other" ./jis "$dir/other/prog.jis" > /dev/null 2>&1
+dd if="$(ls "$dir"/other/*.jisc | head -n 1)" of="$dir/prog.jisc" bs=1 skip=8 seek=8 count=8 conv=notrunc 2> /dev/null
+cp "$dir/other/prog.jis" "$dir/prog.jis"
+expect "same hash" "$(./jis "$dir/prog.jis" 2>&1)" "3.000000"
+
+exit $failed
@@ -0,0 +1,59 @@
+# jis --cost prints the counts of a run to stderr as JSON: the same on any number of threads,
+# and with --sweep, the sum of the runs.
+# Usage: sh tests/cost.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "cost: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+cat > "$dir/spawns.jis" << 'EOF'
+x = 0;
+Work {
+    i = 0;
+    while i < n {
+        x = x + i;
+        i = i + 1;
+    }
+}
+i = 0;
+n = 50;
+spawn Work;
+spawn Work;
+wait;
+if x > 10 && x < 5 || 1 {
+    print x;
+}
+EOF
+
+expected='{
+  "tokens": 1101,
+  "expressions": 309,
+  "operators": {"arithmetic": 200, "comparison": 104, "logical": 2},
+  "loads": 507,
+  "stores": 205,
+  "calls": 2,
+  "iterations": 100
+}'
+for threads in 1 4; do
+    expect "$threads threads" "$(JIS_THREADS=$threads ./jis -O0 --no-cache --cost "$dir/spawns.jis" 2>&1 > /dev/null)" "$expected"
+done
+
+# Two runs, which store x = 0 over the input: twice the counts
+expect "sweep" "$(./jis -O0 --no-cache --cost --sweep x=0:1 "$dir/spawns.jis" 2>&1 > /dev/null)" '{
+  "tokens": 2202,
+  "expressions": 618,
+  "operators": {"arithmetic": 400, "comparison": 208, "logical": 4},
+  "loads": 1014,
+  "stores": 410,
+  "calls": 4,
+  "iterations": 200
+}'
+
+exit $failed
@@ -0,0 +1,38 @@
+# jis --float runs with the numbers of the first versions: floats, truncated to an integer when stored, printed or tested.
+# Usage: sh tests/float_model.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+cat > "$dir/float.jis" << 'EOF'
+print 7 / 2;
+x = 1.5 + 1.5;
+print x;
+print 16777217 + 0;
+print 0.1 + 0.2 == 0.3;
+if 0.5 {
+    print 1;
+}
+i = 0;
+t = 0;
+while i < 2000 {
+    t = t + 7 / 2;
+    i = i + 1;
+}
+print t;
+EOF
+
+# The output of the interpreter before the integers, for the same program
+expected="3.000000
+2.000000
+16777216.000000
+1.000000
+6000.000000"
+
+for o in -O0 -O1; do
+    got=$(./jis $o --no-cache --float "$dir/float.jis" 2>&1)
+    if [ "$got" != "$expected" ]; then
+        echo "float_model: $o: expected '$expected', got '$got'"
+        exit 1
+    fi
+done
@@ -0,0 +1,18 @@
+# In tests/inlining.jis, -O1 inlines every 'exec' but those of the recursive task (5) and of the task with a loop (1).
+# Usage: sh tests/inlining_cost.sh, after sh build.sh (run by tests/run.sh)
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "inlining_cost: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+calls() {
+    ./jis "$1" --no-cache --cost tests/inlining.jis 2>&1 > /dev/null | grep -o '"calls": [0-9]*'
+}
+expect "-O0" "$(calls -O0)" '"calls": 21'
+expect "-O1" "$(calls -O1)" '"calls": 6'
+
+exit $failed
@@ -0,0 +1,49 @@
+# --max-depth sets how deep 'exec' nests, while an 'exec' ending its task doesn't count.
+# Usage: sh tests/max_depth.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "max_depth: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+cat > "$dir/body.jis" << 'EOF'
+d = 0;
+Deep {
+    d = d + 1;
+    if d < n {
+        exec Deep;
+        d = d + 0;
+    }
+}
+Tail {
+    d = d + 1;
+    if d < 5000 {
+        exec Tail;
+    }
+}
+exec Tail;
+print d;
+d = 0;
+exec Deep;
+print d;
+EOF
+
+for n in 10 11; do
+    printf 'n = %d;\n' $n | cat - "$dir/body.jis" > "$dir/depth_$n.jis"
+done
+
+for o in -O0 -O1; do
+    expect "$o 10" "$(./jis $o --no-cache --max-depth 10 "$dir/depth_10.jis" 2>&1)" "5000.000000
+10.000000"
+    expect "$o 11" "$(./jis $o --no-cache --max-depth 10 "$dir/depth_11.jis" 2>&1)" "5000.000000
+Line 6: too many nested 'exec' (the limit is 10)."
+done
+expect "0" "$(./jis --no-cache --max-depth 0 "$dir/depth_10.jis" 2>&1 | head -n 1)" "Usage: jis [-O0|-O1] [--no-cache] [--float] [<limits>] [<memo>] [<tier>] [--cost] [--parallel] [--watch] <path>"
+
+exit $failed
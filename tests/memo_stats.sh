@@ -0,0 +1,28 @@
+# In tests/memo.jis, Triangle misses once for each of its 10 inputs and hits on the others;
+# --no-memo, and --max-steps, run every 'exec' and print the same.
+# Usage: sh tests/memo_stats.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "memo_stats: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+for o in -O0 -O1; do
+    ./jis $o --no-cache --memo-stats tests/memo.jis > "$dir/out" 2> "$dir/stats"
+    cmp -s "$dir/out" tests/memo.out || { echo "memo_stats: $o: the output differs from tests/memo.out"; failed=1; }
+    expect "$o stats" "$(cat "$dir/stats")" "Triangle: 21 hits, 10 misses (67.7% hit rate)"
+
+    for flag in --no-memo "--max-steps 100000"; do
+        ./jis $o --no-cache $flag --memo-stats tests/memo.jis > "$dir/out" 2> "$dir/stats"
+        cmp -s "$dir/out" tests/memo.out || { echo "memo_stats: $o $flag: the output differs from tests/memo.out"; failed=1; }
+        expect "$o $flag stats" "$(cat "$dir/stats")" "No task was memoized."
+    done
+done
+
+exit $failed
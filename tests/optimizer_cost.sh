@@ -0,0 +1,34 @@
+# The optimizer hoists 'k * 3 * (k + 1)' out of the loop: -O1 applies its 3 operators once
+# and 2 an iteration, -O0 5 an iteration.
+# Usage: sh tests/optimizer_cost.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "optimizer_cost: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+cat > "$dir/loop.jis" << 'EOF'
+k = 2;
+t = 0;
+i = 0;
+while i < 1000 {
+    t = t + k * 3 * (k + 1);
+    i = i + 1;
+}
+print t;
+EOF
+
+arithmetic() {
+    ./jis "$1" --no-cache --cost "$dir/loop.jis" 2>&1 > /dev/null | grep -o '"arithmetic": [0-9]*'
+}
+expect "-O0" "$(arithmetic -O0)" '"arithmetic": 5000'
+expect "-O1" "$(arithmetic -O1)" '"arithmetic": 2003'
+expect "output" "$(./jis --no-cache "$dir/loop.jis" 2>&1)" "18000.000000"
+
+exit $failed
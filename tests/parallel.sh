@@ -0,0 +1,75 @@
+# jis --parallel prints the same as running the statements one after the other, errors included,
+# on any number of threads.
+# Usage: sh tests/parallel.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+# Loops and tasks independent of each other, and statements reading what they store
+cat > "$dir/statements.jis" << 'EOF'
+a = 0;
+b = 0;
+c = 0;
+i = 0;
+j = 0;
+SumB {
+    j = 0;
+    while j < 20000 {
+        b = b + j;
+        j = j + 1;
+    }
+}
+while i < 30000 {
+    a = a + i;
+    i = i + 1;
+}
+exec SumB;
+print 1;
+c = 5;
+print c;
+print a;
+print b;
+k = 0;
+while k < 10 {
+    print k;
+    k = k + 1;
+}
+arr = [1, 2];
+m = 0;
+while m < 3 {
+    m = m + 1;
+}
+print arr[m];
+print 2;
+EOF
+
+# A loop failing while the statements after it, which don't depend on it, could go on
+cat > "$dir/failing.jis" << 'EOF'
+arr = [1, 2, 3];
+n = 0;
+i = 0;
+while i < 5000 {
+    n = n + arr[i];
+    i = i + 1;
+}
+x = 0;
+while x < 1000 {
+    x = x + 1;
+}
+print x;
+EOF
+
+failed=0
+for prog in statements failing; do
+    ./jis --no-cache "$dir/$prog.jis" > "$dir/expected" 2>&1
+    for threads in 1 2 8; do
+        for run in 1 2 3; do
+            if ! JIS_THREADS=$threads ./jis --no-cache --parallel "$dir/$prog.jis" 2>&1 | cmp -s - "$dir/expected"; then
+                echo "parallel: $prog.jis on $threads threads differs from the sequential run"
+                failed=1
+            fi
+        done
+    done
+done
+
+exit $failed
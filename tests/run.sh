@@ -0,0 +1,25 @@
+# Runs each tests/*.jis with and without the optimizer and compares the output with tests/<name>.out,
+# then the scripts tests/*.sh (each exits non-zero when it fails).
+# Usage: sh tests/run.sh, after sh build.sh
+
+failed=0
+
+for f in tests/*.jis; do
+    for o in -O0 -O1; do
+        if ! ./jis $o --no-cache "$f" 2>&1 | cmp -s - "${f%.jis}.out"; then
+            echo "FAIL $o $f"
+            failed=1
+        fi
+    done
+done
+
+for f in tests/*.sh; do
+    [ "$f" = tests/run.sh ] && continue
+    if ! sh "$f"; then
+        echo "FAIL $f"
+        failed=1
+    fi
+done
+
+[ $failed = 0 ] && echo "all tests passed"
+exit $failed
@@ -0,0 +1,49 @@
+# A server under --max-memory, with one worker: a connection that never sends its program doesn't hold the worker
+# past its timeout, and the output a spawned task keeps until it's joined counts in the memory of the request.
+# The idle connection is opened by perl: that part is skipped without it.
+# Usage: sh tests/serve_limits.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+./jis --workers 1 --max-memory 8 --serve "$dir/sock" 2> /dev/null &
+server=$!
+trap 'kill $server; rm -rf "$dir"' EXIT
+
+i=0
+while [ ! -S "$dir/sock" ] && [ $i -lt 50 ]; do sleep 0.1; i=$((i + 1)); done
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "serve_limits: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+printf 'print 1;\n' > "$dir/one.jis"
+if command -v perl > /dev/null; then
+    perl -MIO::Socket::UNIX -e '$s = IO::Socket::UNIX->new(Peer => $ARGV[0]) or exit 1; open(F, ">$ARGV[1]"); close(F); sleep 20' \
+        "$dir/sock" "$dir/connected" &
+    idle=$!
+    i=0
+    while [ ! -f "$dir/connected" ] && [ $i -lt 50 ]; do sleep 0.1; i=$((i + 1)); done
+    expect "after an idle connection" "$(timeout 15 ./jis --connect "$dir/sock" "$dir/one.jis" 2>&1)" "1.000000"
+    kill $idle 2> /dev/null
+fi
+
+cat > "$dir/loud.jis" <<'JIS'
+Loud {
+    i = 0;
+    while i < 10000000 {
+        print i;
+        i = i + 1;
+    }
+}
+spawn Loud;
+wait;
+JIS
+./jis --connect "$dir/sock" "$dir/loud.jis" > "$dir/loud.out" 2>&1
+expect "spawned output" "$?:$(tail -n 1 "$dir/loud.out")" "1:Line 3: memory limit exceeded."
+
+expect "after the limit" "$(./jis --connect "$dir/sock" "$dir/one.jis" 2>&1)" "1.000000"
+
+exit $failed
@@ -0,0 +1,12 @@
+# tests/arrays.jis prints the same with the scalar kernels (JIS_SIMD=none), with SSE2 and with the best level available.
+# Usage: sh tests/simd_parity.sh, after sh build.sh (run by tests/run.sh)
+
+failed=0
+for level in none sse2; do
+    if ! JIS_SIMD=$level ./jis --no-cache tests/arrays.jis 2>&1 | cmp -s - tests/arrays.out; then
+        echo "simd_parity: JIS_SIMD=$level differs from tests/arrays.out"
+        failed=1
+    fi
+done
+
+exit $failed
@@ -0,0 +1,59 @@
+# jis --snapshot-after saves the state of a run, and jis --restore resumes it: the variables, arrays included,
+# the tasks, and how the program was compiled. A snapshot of another source, or a truncated one, is rejected.
+# Usage: sh tests/snapshot.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "snapshot: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+cat > "$dir/prog.jis" << 'EOF'
+a = fill(1000, 2);
+n = 10;
+Show {
+    print n + sum(a);
+}
+print 7 / 2;
+exec Show;
+n = n + 1;
+a[0] = 5;
+exec Show;
+print len(a);
+EOF
+
+for o in -O0 -O1; do
+    expect "$o run" "$(./jis $o --no-cache --snapshot-after 6 "$dir/prog.snap" "$dir/prog.jis" 2>&1)" "3.500000
+2010.000000
+2014.000000
+1000.000000"
+    expect "$o restore" "$(./jis --no-cache --restore "$dir/prog.snap" 2>&1)" "2010.000000
+2014.000000
+1000.000000"
+done
+
+# The snapshot of a run with --float restores it, and with it the line it was taken at
+./jis --no-cache --float --snapshot-after 5 "$dir/float.snap" "$dir/prog.jis" > /dev/null 2>&1
+expect "float" "$(./jis --no-cache --restore "$dir/float.snap" 2>&1)" "3.000000
+2010.000000
+2014.000000
+1000.000000"
+
+# Cut in the header, and in the elements of the array, which are most of the file
+head -c 100 "$dir/prog.snap" > "$dir/header.snap"
+expect "header" "$(./jis --no-cache --restore "$dir/header.snap" 2>&1; echo "status $?")" "The snapshot '$dir/header.snap' is corrupted.
+status 1"
+head -c $(($(wc -c < "$dir/prog.snap") / 2)) "$dir/prog.snap" > "$dir/array.snap"
+expect "array" "$(./jis --no-cache --restore "$dir/array.snap" 2>&1; echo "status $?")" "The snapshot '$dir/array.snap' is corrupted.
+status 1"
+
+echo 'print 9;' >> "$dir/prog.jis"
+expect "edited" "$(./jis --no-cache --restore "$dir/prog.snap" 2>&1; echo "status $?")" "The snapshot '$dir/prog.snap' is of another version of '$dir/prog.jis'.
+status 1"
+
+exit $failed
@@ -0,0 +1,14 @@
+# tests/unclosed_paren.jis runs, but jis --check reports each parenthesis it leaves open or closes without opening.
+# Usage: sh tests/strict_parens.sh, after sh build.sh (run by tests/run.sh)
+
+expected="Line 2: expected ')'.
+Line 3: expected ')'.
+Line 6: expected ')'.
+Line 14: expected ')'.
+Line 20: unexpected ')', no '(' to close."
+
+got=$(./jis --check tests/unclosed_paren.jis 2>&1)
+if [ "$got" != "$expected" ]; then
+    echo "strict_parens: expected '$expected', got '$got'"
+    exit 1
+fi
@@ -0,0 +1,36 @@
+# tests/superinstructions.jis prints the same with the superinstructions off (JIS_FUSE=0),
+# and with them on, a loop of 'while i < n {' and 'i = i + 1;' consumes a third of the tokens (counted by --cost).
+# Usage: sh tests/superinstructions.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "superinstructions: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+for o in -O0 -O1; do
+    if ! JIS_FUSE=0 ./jis $o --no-cache tests/superinstructions.jis 2>&1 | cmp -s - tests/superinstructions.out; then
+        echo "superinstructions: JIS_FUSE=0 $o differs from tests/superinstructions.out"
+        failed=1
+    fi
+done
+
+cat > "$dir/loop.jis" << 'EOF'
+i = 0;
+while i < 100 {
+    i = i + 1;
+}
+EOF
+
+tokens() {
+    JIS_FUSE=$1 ./jis -O0 --no-cache --cost "$dir/loop.jis" 2>&1 | grep -o '"tokens": [0-9]*'
+}
+expect "fused" "$(tokens 1)" '"tokens": 414'
+expect "not fused" "$(tokens 0)" '"tokens": 1217'
+
+exit $failed
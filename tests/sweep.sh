@@ -0,0 +1,60 @@
+# jis --sweep and --sweep-csv run a program once for each input, and print the runs in the order of the inputs.
+# Usage: sh tests/sweep.sh, after sh build.sh (run by tests/run.sh)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "sweep: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+printf 'print n * 10 + m;\n' > "$dir/sum.jis"
+expect "combinations" "$(./jis --no-cache --sweep n=1:2 --sweep m=0:1:0.5 "$dir/sum.jis" 2>&1)" "--- n=1 m=0 ---
+10.000000
+--- n=1 m=0.5 ---
+10.500000
+--- n=1 m=1 ---
+11.000000
+--- n=2 m=0 ---
+20.000000
+--- n=2 m=0.5 ---
+20.500000
+--- n=2 m=1 ---
+21.000000"
+
+printf 'n,m\n1,2\n3,4.5\n' > "$dir/inputs.csv"
+expect "csv" "$(./jis --no-cache --sweep-csv "$dir/inputs.csv" "$dir/sum.jis" 2>&1)" "--- n=1 m=2 ---
+12.000000
+--- n=3 m=4.5 ---
+34.500000"
+
+# Many more runs than threads, still in order
+expect "order" "$(./jis --no-cache --sweep n=1:500 --sweep m=0:0 "$dir/sum.jis" 2>&1 | grep -v '^---' | tr -d '\n' | cksum)" \
+    "$(i=1; while [ $i -le 500 ]; do printf '%d0.000000' $i; i=$((i + 1)); done | cksum)"
+
+# An error ends its run only, and the status is of the first run that fails
+cat > "$dir/loop.jis" << 'EOF'
+i = 0;
+while i < n {
+    i = i + 1;
+}
+print i;
+EOF
+./jis --no-cache --max-steps 5 --sweep n=3:7:2 "$dir/loop.jis" > "$dir/out" 2>&1
+expect "limit status" "$?" "3"
+expect "limit" "$(cat "$dir/out")" "--- n=3 ---
+3.000000
+--- n=5 ---
+5.000000
+--- n=7 ---
+Line 2: step limit exceeded, after 5 steps."
+
+./jis --no-cache --sweep q=1:3 "$dir/loop.jis" > "$dir/out" 2>&1
+expect "unused status" "$?" "1"
+expect "unused" "$(cat "$dir/out")" "The program doesn't use the variable 'q'."
+
+exit $failed
@@ -0,0 +1,36 @@
+# tests/tiering.jis prints the same whenever its loops and tasks are compiled (--tier-threshold, 0 never),
+# and --tier-stats tells what was promoted, and after how many back edges or calls.
+# Usage: sh tests/tiering.sh, after sh build.sh (run by tests/run.sh)
+
+failed=0
+expect() {
+    if [ "$2" != "$3" ]; then
+        echo "tiering: $1: expected '$3', got '$2'"
+        failed=1
+    fi
+}
+
+for o in -O0 -O1; do
+    for threshold in 0 1 100; do
+        if ! ./jis $o --no-cache --tier-threshold $threshold tests/tiering.jis 2>&1 | cmp -s - tests/tiering.out; then
+            echo "tiering: $o --tier-threshold $threshold differs from tests/tiering.out"
+            failed=1
+        fi
+    done
+done
+
+# The time to compile depends on the machine
+stats() {
+    ./jis -O0 --no-cache $1 --tier-stats tests/tiering.jis 2>&1 > /dev/null | sed 's/compiled in [0-9.]* us/compiled/'
+}
+expect "default" "$(stats)" "line 5, while: promoted after 1000 back edges, compiled, then run 1 times
+line 18, while: promoted after 1000 back edges, compiled, then run 1 times
+line 28, while: promoted after 1000 back edges, compiled, then run 1 times
+line 36, task Step: promoted after 1000 calls, compiled, then run 501 times
+line 39, while: promoted after 1000 back edges, compiled, then run 666 times
+line 46, while: hot after 1000 back edges, but not compiled: it executes a task
+line 58, while: promoted after 1000 back edges, compiled, then run 31 times
+line 68, while: promoted after 1000 back edges, compiled, then run 1 times"
+expect "never" "$(stats '--tier-threshold 0')" "Nothing was promoted."
+
+exit $failed
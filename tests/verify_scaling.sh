@@ -0,0 +1,39 @@
+# The verifier is linear in the tasks: a chain of 3000 tasks, each executing the one before it,
+# and one of 3000 tasks executing each other in a cycle, are checked within a time bound.
+# Usage: sh tests/verify_scaling.sh, after sh build.sh (run by tests/run.sh)
+
+tasks=3000
+bound_ms=2000
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+awk -v n=$tasks 'BEGIN {
+    print "T0 {\n    x0 = 1;\n}"
+    for (i = 1; i < n; i++) printf "T%d {\n    exec T%d;\n    x%d = x%d + 1;\n}\n", i, i - 1, i, i - 1
+    printf "exec T%d;\nprint x%d;\n", n - 1, n - 1
+}' > "$dir/chain.jis"
+
+# The last task stops the cycle: the first one is executed again only if it's asked to
+awk -v n=$tasks 'BEGIN {
+    print "depth = 0;"
+    for (i = 0; i < n - 1; i++) printf "T%d {\n    x%d = 1;\n    exec T%d;\n}\n", i, i, i + 1
+    printf "T%d {\n    depth = depth + 1;\n    if depth < 2 {\n        exec T0;\n    }\n}\n", n - 1
+    printf "exec T0;\nprint x0 + x%d;\n", n - 2
+}' > "$dir/cycle.jis"
+
+failed=0
+for f in chain cycle; do
+    start=$(date +%s%N)
+    out=$(./jis --check --no-cache "$dir/$f.jis" 2>&1)
+    status=$?
+    end=$(date +%s%N)
+    ms=$(( (end - start) / 1000000 ))
+    if [ $status -ne 0 ] || [ -n "$out" ]; then
+        echo "$f: expected no errors, got: $out"
+        failed=1
+    elif [ $ms -gt $bound_ms ]; then
+        echo "$f: checked in $ms ms, over $bound_ms ms"
+        failed=1
+    fi
+done
+exit $failed